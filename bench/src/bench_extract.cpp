@@ -0,0 +1,71 @@
+/*
+ * vibe-player
+ * bench_extract.cpp
+ */
+
+#include "directory_walker.h"
+#include "metadata.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <spdlog/spdlog.h>
+#include <spdlog/sinks/basic_file_sink.h>
+
+// Extraction throughput of MetadataExtractor::extract over a directory of
+// audio files, on one thread. Run it once to warm the page cache; the
+// best of several passes is reported, so it measures parsing and syscalls
+// rather than the disk.
+int main(int argc, char *argv[])
+{
+    namespace fs = std::filesystem;
+
+    if (argc < 2)
+    {
+        std::cerr << "Usage: bench-extract <directory> [passes] [log file]" << std::endl;
+        return EXIT_FAILURE;
+    }
+    const std::string directory = argv[1];
+    const int passes = argc > 2 ? std::max(std::atoi(argv[2]), 1) : 5;
+    const std::string log_path = argc > 3 ? argv[3] : (fs::temp_directory_path() / "bench-extract.log").string();
+
+    // Info level to a file, as vibe-playlist logs during a scan
+    auto logger = spdlog::basic_logger_mt("bench-extract", log_path, true);
+    spdlog::set_default_logger(logger);
+    spdlog::set_level(spdlog::level::info);
+
+    std::vector<std::string> paths = FindAudioFiles(directory);
+    std::sort(paths.begin(), paths.end());
+    if (paths.empty())
+    {
+        std::cerr << "Error: No audio files found" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    double best_ms = 0;
+    size_t extracted = 0;
+    for (int pass = 0; pass < passes; ++pass)
+    {
+        auto start = std::chrono::steady_clock::now();
+        extracted = 0;
+        for (const auto &path : paths)
+        {
+            if (MetadataExtractor::extract(path))
+            {
+                extracted++;
+            }
+        }
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "pass " << pass + 1 << ": " << ms << " ms" << std::endl;
+        best_ms = pass == 0 ? ms : std::min(best_ms, ms);
+    }
+
+    std::cout << extracted << " of " << paths.size() << " files, best " << best_ms << " ms, "
+              << static_cast<uint64_t>(paths.size() / (best_ms / 1000.0)) << " files/s" << std::endl;
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,217 @@
+/*
+ * vibe-player
+ * bench_utf8.cpp
+ */
+
+#include "utf8.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace
+{
+    // Deterministic, so runs and builds see the same strings
+    class Lcg {
+    public:
+        uint32_t next(uint32_t bound)
+        {
+            state_ = state_ * 6364136223846793005ull + 1442695040888963407ull;
+            return static_cast<uint32_t>(state_ >> 33) % bound;
+        }
+
+    private:
+        uint64_t state_ = 42;
+    };
+
+    // The byte-at-a-time validation extract() used before ValidUtf8Prefix
+    // (surrogates rejected too, so both accept the same text), as the
+    // baseline the block-at-a-time version is compared with
+    size_t ScalarValidUtf8Prefix(std::string_view text)
+    {
+        const auto *bytes = reinterpret_cast<const unsigned char *>(text.data());
+        size_t len = text.size();
+        auto continuation = [bytes](size_t at)
+        {
+            return (bytes[at] & 0xC0) == 0x80;
+        };
+
+        size_t i = 0;
+        while (i < len)
+        {
+            unsigned char c = bytes[i];
+            size_t n = 0;
+            if (c <= 0x7F)
+            {
+                n = 1;
+            }
+            else if (c >= 0xC2 && c <= 0xDF)
+            {
+                n = i + 1 < len && continuation(i + 1) ? 2 : 0;
+            }
+            else if (c >= 0xE0 && c <= 0xEF)
+            {
+                bool valid = i + 2 < len && continuation(i + 1) && continuation(i + 2) &&
+                             !(c == 0xE0 && bytes[i + 1] < 0xA0) && !(c == 0xED && bytes[i + 1] > 0x9F);
+                n = valid ? 3 : 0;
+            }
+            else if (c >= 0xF0 && c <= 0xF4)
+            {
+                bool valid = i + 3 < len && continuation(i + 1) && continuation(i + 2) && continuation(i + 3) &&
+                             !(c == 0xF0 && bytes[i + 1] < 0x90) && !(c == 0xF4 && bytes[i + 1] > 0x8F);
+                n = valid ? 4 : 0;
+            }
+            if (n == 0)
+            {
+                break;
+            }
+            i += n;
+        }
+        return i;
+    }
+
+    void AppendCodePoint(std::string &text, uint32_t code_point)
+    {
+        if (code_point < 0x80)
+        {
+            text += static_cast<char>(code_point);
+        }
+        else if (code_point < 0x800)
+        {
+            text += static_cast<char>(0xc0 | (code_point >> 6));
+            text += static_cast<char>(0x80 | (code_point & 0x3f));
+        }
+        else
+        {
+            text += static_cast<char>(0xe0 | (code_point >> 12));
+            text += static_cast<char>(0x80 | ((code_point >> 6) & 0x3f));
+            text += static_cast<char>(0x80 | (code_point & 0x3f));
+        }
+    }
+
+    // Library paths and titles: "/music/Artist 12/Album 3/07 - Title 456.flac"
+    std::vector<std::string> AsciiHeavy(size_t count)
+    {
+        Lcg random;
+        std::vector<std::string> strings;
+        strings.reserve(count);
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (i % 2 == 0)
+            {
+                strings.push_back("/music/Artist " + std::to_string(random.next(5000)) + "/Album " +
+                                  std::to_string(random.next(20)) + "/" + std::to_string(random.next(20)) +
+                                  " - Some Track Title " + std::to_string(random.next(100000)) + ".flac");
+            }
+            else
+            {
+                strings.push_back("Track Title Number " + std::to_string(random.next(100000)));
+            }
+        }
+        return strings;
+    }
+
+    // Japanese and Chinese titles: kana and CJK ideographs with the odd
+    // ASCII space, digit or bracket between them
+    std::vector<std::string> CjkHeavy(size_t count)
+    {
+        Lcg random;
+        std::vector<std::string> strings;
+        strings.reserve(count);
+        for (size_t i = 0; i < count; ++i)
+        {
+            std::string text;
+            size_t length = 6 + random.next(20);
+            for (size_t c = 0; c < length; ++c)
+            {
+                uint32_t kind = random.next(10);
+                if (kind < 5)
+                {
+                    AppendCodePoint(text, 0x4e00 + random.next(0x5000)); // CJK ideograph
+                }
+                else if (kind < 8)
+                {
+                    AppendCodePoint(text, 0x3041 + random.next(0x5e)); // Hiragana
+                }
+                else
+                {
+                    text += " 0123456789()-"[random.next(14)];
+                }
+            }
+            strings.push_back(std::move(text));
+        }
+        return strings;
+    }
+
+    void Run(const char *name, const std::vector<std::string> &strings, int passes)
+    {
+        size_t bytes = 0;
+        for (const auto &text : strings)
+        {
+            bytes += text.size();
+        }
+
+        double best_scalar = 0;
+        double best_validate = 0;
+        double best_sanitize = 0;
+        size_t checksum = 0;
+        size_t scalar_checksum = 0;
+        for (int pass = 0; pass < passes; ++pass)
+        {
+            auto start = std::chrono::steady_clock::now();
+            for (const auto &text : strings)
+            {
+                scalar_checksum += ScalarValidUtf8Prefix(text);
+            }
+            double scalar = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+            start = std::chrono::steady_clock::now();
+            for (const auto &text : strings)
+            {
+                checksum += ValidUtf8Prefix(text);
+            }
+            double validate = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+            // SanitizeUtf8 takes its argument by value, as extract() moves
+            // tags in; copy outside the timed part
+            std::vector<std::string> copies = strings;
+            start = std::chrono::steady_clock::now();
+            for (auto &text : copies)
+            {
+                text = SanitizeUtf8(std::move(text));
+            }
+            double sanitize = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            checksum += copies.back().size();
+            scalar_checksum += copies.back().size();
+
+            best_scalar = pass == 0 ? scalar : std::min(best_scalar, scalar);
+            best_validate = pass == 0 ? validate : std::min(best_validate, validate);
+            best_sanitize = pass == 0 ? sanitize : std::min(best_sanitize, sanitize);
+        }
+
+        std::cout << name << ": " << strings.size() << " strings, " << bytes / 1000000.0 << " MB\n"
+                  << "  scalar baseline " << best_scalar << " ms (" << bytes / 1000.0 / best_scalar << " MB/s)\n"
+                  << "  ValidUtf8Prefix " << best_validate << " ms (" << bytes / 1000.0 / best_validate << " MB/s)\n"
+                  << "  SanitizeUtf8    " << best_sanitize << " ms (" << bytes / 1000.0 / best_sanitize << " MB/s)\n"
+                  << "  speedup over baseline " << best_scalar / best_validate << "x"
+                  << (checksum == scalar_checksum ? "" : " (RESULTS DIFFER)") << std::endl;
+    }
+}
+
+// Throughput of the UTF-8 validation every extracted tag and path goes
+// through, on valid ASCII-heavy and CJK-heavy text. Reports the best of
+// several passes.
+int main(int argc, char *argv[])
+{
+    const size_t count = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1000000;
+    const int passes = argc > 2 ? std::max(std::atoi(argv[2]), 1) : 7;
+
+    Run("ASCII-heavy", AsciiHeavy(count), passes);
+    Run("CJK-heavy", CjkHeavy(count), passes);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,39 @@
+/*
+ * vibe-player
+ * control_client.h
+ */
+
+#ifndef CONTROL_CLIENT_H
+#define CONTROL_CLIENT_H
+
+#include <optional>
+#include <string>
+#include <nlohmann/json.hpp>
+
+// Blocking client for a player's control socket (see ControlServer)
+class ControlClient
+{
+public:
+    ControlClient() = default;
+    ~ControlClient();
+
+    ControlClient(const ControlClient &) = delete;
+    ControlClient &operator=(const ControlClient &) = delete;
+
+    bool connect(const std::string &socket_path);
+
+    // Send one request line without waiting for the reply
+    bool send(const std::string &command, const std::string &argument = "");
+
+    // Next reply or pushed status line; false once the player hangs up
+    bool readLine(std::string &line);
+
+    // Send a request and wait for its reply
+    std::optional<nlohmann::json> request(const std::string &command, const std::string &argument = "");
+
+private:
+    int fd_ = -1;
+    std::string buffer_;
+};
+
+#endif // CONTROL_CLIENT_H
@@ -0,0 +1,79 @@
+/*
+ * vibe-player
+ * control_server.h
+ */
+
+#ifndef CONTROL_SERVER_H
+#define CONTROL_SERVER_H
+
+#include "event_loop.h"
+
+#include <functional>
+#include <map>
+#include <string>
+#include <nlohmann/json.hpp>
+
+// One line of the control protocol: "<command> [argument]"
+struct ControlRequest
+{
+    std::string command;
+    std::string argument;
+
+    static ControlRequest parse(const std::string &line);
+};
+
+// Unix domain socket server for remote control of a player.
+// Clients send newline-terminated requests and get one JSON object per line
+// back. "subscribe" switches a client to receiving every status change.
+class ControlServer
+{
+public:
+    // Returns the JSON reply for one request; runs on the event loop thread
+    using Handler = std::function<nlohmann::json(const ControlRequest &)>;
+
+    explicit ControlServer(EventLoop &loop);
+    ~ControlServer();
+
+    ControlServer(const ControlServer &) = delete;
+    ControlServer &operator=(const ControlServer &) = delete;
+
+    // Bind socket_path and start accepting clients. Fails if another player
+    // is already listening there. A stale socket file is replaced.
+    bool listen(const std::string &socket_path, Handler handler);
+
+    // Push status to subscribers if it differs from the last push
+    void publishStatus(const nlohmann::json &status);
+
+    // $XDG_RUNTIME_DIR/vibe-player.sock, or /tmp/vibe-player-<uid>.sock
+    static std::string defaultSocketPath();
+
+    // Longest request line accepted before the client is dropped; long
+    // enough for a playlist in one enqueue-list
+    static constexpr size_t MAX_LINE = 1024 * 1024;
+
+private:
+    struct Client
+    {
+        std::string input;
+        std::string output;
+        bool subscribed = false;
+    };
+
+    // Unsent replies allowed to pile up for a client that stopped reading
+    static constexpr size_t MAX_PENDING_OUTPUT = 4 * 1024 * 1024;
+
+    void acceptClients();
+    void readClient(int fd);
+    bool sendLine(int fd, const std::string &line);
+    bool flushClient(int fd);
+    void closeClient(int fd);
+
+    EventLoop &loop_;
+    int listen_fd_ = -1;
+    std::string socket_path_;
+    Handler handler_;
+    std::map<int, Client> clients_;
+    std::string last_status_;
+};
+
+#endif // CONTROL_SERVER_H
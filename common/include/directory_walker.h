@@ -0,0 +1,25 @@
+/*
+ * vibe-player
+ * directory_walker.h
+ */
+
+#ifndef DIRECTORY_WALKER_H
+#define DIRECTORY_WALKER_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Whether a file name ends in one of the audio extensions the library
+// scanner picks up (.wav, .mp3, .flac, .ogg; any case)
+bool HasAudioExtension(std::string_view filename);
+
+// Paths of the audio files in a directory and, if recursive, its
+// subdirectories. Directories are read with getdents64 and the entry
+// types it reports, so only symlinks and entries on filesystems that do
+// not report types are stat'ed. Subdirectories are read in parallel.
+// Symlinked directories are not followed; unreadable directories are
+// skipped with a warning. The order of the result is unspecified.
+std::vector<std::string> FindAudioFiles(const std::string& directory, bool recursive = true);
+
+#endif // DIRECTORY_WALKER_H
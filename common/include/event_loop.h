@@ -0,0 +1,72 @@
+/*
+ * vibe-player
+ * event_loop.h
+ */
+
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+#include <chrono>
+#include <functional>
+#include <vector>
+
+// Single-threaded poll(2) based event loop.
+// Sleeps until a watched fd is readable, the tick timer fires, or notify()
+// is called from another thread or a signal handler.
+class EventLoop
+{
+public:
+    using Callback = std::function<void()>;
+
+    EventLoop();
+    ~EventLoop();
+
+    EventLoop(const EventLoop &) = delete;
+    EventLoop &operator=(const EventLoop &) = delete;
+
+    // True if the wakeup and timer descriptors were created
+    bool isValid() const;
+
+    // Invoke callback on the loop thread whenever fd becomes readable.
+    // unwatchFd drops both the readable and the writable watch.
+    void watchFd(int fd, Callback callback);
+    void unwatchFd(int fd);
+
+    // Invoke callback while fd can take more output; used to flush
+    // buffered writes, so remove it once the buffer is empty
+    void watchFdWritable(int fd, Callback callback);
+    void unwatchFdWritable(int fd);
+
+    // Periodic tick; an interval of zero disarms the timer
+    void setTimerCallback(Callback callback);
+    void setTimerInterval(std::chrono::milliseconds interval);
+
+    // Callback run on the loop thread after one or more notify() calls
+    void setNotifyCallback(Callback callback);
+
+    // Wake the loop. Safe to call from any thread and from signal handlers.
+    void notify();
+
+    // Wait up to timeout_ms (-1 = forever) and dispatch ready events.
+    // Returns false if poll failed for a reason other than EINTR.
+    bool runOnce(int timeout_ms = -1);
+
+private:
+    struct Watch
+    {
+        int fd;
+        short events;
+        Callback callback;
+    };
+
+    void removeWatch(int fd, short events);
+
+    int wake_fd_ = -1;
+    int timer_fd_ = -1;
+    std::chrono::milliseconds timer_interval_{0};
+    Callback timer_callback_;
+    Callback notify_callback_;
+    std::vector<Watch> watches_;
+};
+
+#endif // EVENT_LOOP_H
@@ -0,0 +1,51 @@
+/*
+ * vibe-player
+ * file_identity.h
+ */
+
+#ifndef FILE_IDENTITY_H
+#define FILE_IDENTITY_H
+
+#include "metadata.h"
+
+#include <sys/stat.h>
+
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Hash of a file's size and its first and last 4 KiB. Cheap enough to
+// take while the tags are read, and enough to tell apart files that share
+// a size and mtime; used when a move across filesystems changed the inode.
+uint64_t PartialContentHash(int fd, uint64_t size);
+
+// Previously read tracks, found by path or, for files moved or renamed
+// since (a reorganized library), by identity: device, inode, size and
+// mtime, falling back to size, mtime and PartialContentHash. A file found
+// this way does not have to be opened and its tags read again.
+class FileIdentityIndex {
+public:
+    FileIdentityIndex() = default;
+    explicit FileIdentityIndex(std::vector<TrackMetadata> tracks);
+
+    void add(TrackMetadata track);
+    void clear();
+    bool empty() const;
+
+    // Known metadata for the file at filepath, whose stat is st: the track
+    // at that path if the file is unchanged, else the track of the same
+    // file at another path, relocated to filepath
+    std::optional<TrackMetadata> find(const std::string& filepath, const struct stat& st) const;
+
+private:
+    std::vector<TrackMetadata> tracks_;
+    std::unordered_map<std::string, size_t> by_path_;
+    std::map<std::pair<uint64_t, uint64_t>, size_t> by_inode_;
+    std::multimap<std::pair<uint64_t, int64_t>, size_t> by_size_;
+};
+
+#endif // FILE_IDENTITY_H
@@ -0,0 +1,32 @@
+/*
+ * vibe-player
+ * fnv_hash.h
+ */
+
+#ifndef FNV_HASH_H
+#define FNV_HASH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+// 64-bit FNV-1a. Unlike std::hash it is stable across builds and
+// platforms, so it is safe to persist in cache files and names.
+constexpr uint64_t FNV_OFFSET_BASIS = 0xcbf29ce484222325ull;
+
+inline uint64_t Fnv1aHash(const char *data, size_t size, uint64_t hash = FNV_OFFSET_BASIS)
+{
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash ^= static_cast<unsigned char>(data[i]);
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+inline uint64_t Fnv1aHash(std::string_view data, uint64_t hash = FNV_OFFSET_BASIS)
+{
+    return Fnv1aHash(data.data(), data.size(), hash);
+}
+
+#endif // FNV_HASH_H
@@ -0,0 +1,74 @@
+/*
+ * vibe-player
+ * library_scanner.h
+ */
+
+#ifndef LIBRARY_SCANNER_H
+#define LIBRARY_SCANNER_H
+
+#include "metadata.h"
+#include "file_identity.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Extracts the metadata of a library on background threads and publishes
+// tracks as they are read, so a caller can start working with part of a
+// library that has never been scanned.
+//
+// Files are read round-robin across the top-level directories (usually
+// artists) rather than in path order, so the first tracks published
+// sample the whole library instead of the start of the alphabet.
+class LibraryScanner {
+public:
+    // Tracks in previous whose files are unchanged, even if moved or
+    // renamed since, are reused instead of extracted again
+    explicit LibraryScanner(const std::string& directory,
+                            std::vector<TrackMetadata> previous = {},
+                            bool verbose = false);
+    // Stops reading further files and waits for the threads
+    ~LibraryScanner();
+
+    LibraryScanner(const LibraryScanner&) = delete;
+    LibraryScanner& operator=(const LibraryScanner&) = delete;
+
+    // List the library and start extracting. Returns the number of audio
+    // files found.
+    size_t start();
+
+    // Wait until min_tracks tracks have been read, or max_wait has passed
+    // since start() and at least one has, or the scan is complete; zero
+    // disables either limit. Returns the tracks read so far.
+    std::vector<TrackMetadata> waitForTracks(size_t min_tracks, std::chrono::milliseconds max_wait);
+
+    // Wait for the whole library; returns every track, sorted by filepath
+    std::vector<TrackMetadata> finish();
+
+    // Whether every file has been read
+    bool complete() const;
+
+private:
+    void readFiles();
+
+    std::string directory_;
+    bool verbose_;
+    FileIdentityIndex previous_;
+
+    std::vector<std::string> paths_;
+    std::atomic<size_t> next_{0};
+    std::atomic<bool> stop_{false};
+    std::vector<std::thread> threads_;
+    std::chrono::steady_clock::time_point started_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable changed_;
+    std::vector<TrackMetadata> tracks_;
+    size_t done_ = 0;
+};
+
+#endif // LIBRARY_SCANNER_H
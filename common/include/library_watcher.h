@@ -0,0 +1,141 @@
+/*
+ * vibe-player
+ * library_watcher.h
+ */
+
+#ifndef LIBRARY_WATCHER_H
+#define LIBRARY_WATCHER_H
+
+#include "metadata.h"
+#include "metadata_cache.h"
+#include "file_identity.h"
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <set>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Keeps the metadata cache of one library (and the MetadataIndex saved
+// with it) current while the library changes, so vibe-playlist finds new
+// downloads in the cache instead of rescanning.
+//
+// Every directory of the library gets an inotify watch. Events only mark
+// files and directories as pending; once the library has been quiet for a
+// moment (or a burst has gone on for a while) the pending ones are
+// re-stat'ed, new or modified files extracted, and the changes journaled
+// (see MetadataCache::update); a large journal is compacted on a
+// background thread. Files that were moved or renamed keep their metadata
+// (FileIdentityIndex).
+// Directories that cannot be watched, because fs.inotify.max_user_watches
+// is used up, are polled instead.
+//
+// Either the owner drives it from one thread, waiting on fd() (e.g.
+// EventLoop::watchFd), calling handleEvents() and then update() after
+// timeoutMs() has passed, or startInBackground() runs all of that on a
+// thread of its own.
+class LibraryWatcher {
+public:
+    explicit LibraryWatcher(const std::string& library_path, const std::string& cache_dir = "");
+    ~LibraryWatcher();
+
+    LibraryWatcher(const LibraryWatcher&) = delete;
+    LibraryWatcher& operator=(const LibraryWatcher&) = delete;
+
+    // Load the cache, watch the library and bring the cache up to date.
+    // A cold cache means extracting the whole library here. Returns false
+    // if the library is not a directory or inotify is unavailable.
+    bool start();
+
+    // Like start(), but loads, scans and then watches the library on a
+    // background thread, so extracting a cold library or a burst of new
+    // files never holds up the owner's loop. on_index_changed is called
+    // from that thread (or a compaction's) whenever indexGeneration()
+    // changes. Returns false, without starting the thread, if the library
+    // is not a directory or inotify is unavailable. Only indexGeneration()
+    // may be called while it runs.
+    bool startInBackground(std::function<void()> on_index_changed);
+
+    // inotify descriptor; readable when handleEvents() has work
+    int fd() const;
+
+    // Read the queued inotify events without blocking
+    void handleEvents();
+
+    // Milliseconds until update() has something to do, or -1 if nothing
+    // is pending
+    int timeoutMs() const;
+
+    // Apply the pending changes that are due. Returns true if the cache
+    // changed.
+    bool update();
+
+    // Changes each time the path index (MetadataIndex) saved with the
+    // cache is rewritten: on a whole save or once a background compaction
+    // finishes, not for changes only journaled. Owners map the index again
+    // when it changes.
+    uint64_t indexGeneration() const;
+
+    // Number of tracks in the library
+    size_t size() const;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    bool open();
+    void scanLibrary();
+    void run();
+    void indexChanged();
+    void watchDirectory(const std::string& directory);
+    void scanDirectory(const std::string& directory);
+    void removeDirectory(const std::string& directory);
+    void checkFile(const std::string& filepath);
+    std::map<std::string, TrackMetadata>::iterator dropTrack(std::map<std::string, TrackMetadata>::iterator track);
+    void readChangedFiles();
+    void markPending();
+    void pollUnwatched();
+    bool save();
+    std::vector<TrackMetadata> snapshot() const;
+
+    std::string library_path_;
+    MetadataCache cache_;
+    int inotify_fd_ = -1;
+
+    // Tracks by path, and directories by path with their watch
+    // descriptors (-1 for directories being polled)
+    std::map<std::string, TrackMetadata> tracks_;
+    std::map<std::string, int> directories_;
+    std::unordered_map<int, std::string> watches_;
+
+    // Files found new or modified, read once the tracks that went away in
+    // the same update are known, so moves within a batch are recognized
+    std::vector<std::string> changed_files_;
+    FileIdentityIndex removed_;
+    std::set<std::string> unwatched_;
+
+    std::set<std::string> pending_files_;
+    std::set<std::string> pending_directories_;
+    bool dirty_ = false;
+    Clock::time_point first_pending_;
+    Clock::time_point last_event_;
+    Clock::time_point next_poll_;
+    bool watch_limit_warned_ = false;
+
+    // Paths changed since the last save, for the journal
+    std::set<std::string> journal_puts_;
+    std::set<std::string> journal_deletes_;
+    std::thread compaction_;
+    std::atomic<bool> compacting_{false};
+    std::atomic<uint64_t> index_generation_{0};
+    std::function<void()> on_index_changed_;
+
+    // Background watching; stop_fd_ is an eventfd that ends it
+    std::thread worker_;
+    int stop_fd_ = -1;
+};
+
+#endif // LIBRARY_WATCHER_H
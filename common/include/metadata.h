@@ -17,6 +17,13 @@ struct TrackMetadata {
     int64_t duration_ms;           // Duration in milliseconds
     int64_t file_mtime;            // Last modification time (for cache invalidation)
 
+    // Identity of the file apart from its path, to recognize it after a
+    // move or rename (see FileIdentityIndex); zero when unknown
+    uint64_t file_size = 0;
+    uint64_t device = 0;
+    uint64_t inode = 0;
+    uint64_t content_hash = 0;     // PartialContentHash of the file
+
     // Convert to JSON
     nlohmann::json toJson() const;
 
@@ -36,6 +43,10 @@ public:
         bool verbose = false
     );
 
+    // track, for the same file moved or renamed to filepath: the path and
+    // filename change, and so does the title if it came from the filename
+    static TrackMetadata relocate(TrackMetadata track, const std::string& filepath);
+
     // Get file modification time
     static int64_t getFileModificationTime(const std::string& filepath);
 };
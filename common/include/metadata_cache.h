@@ -2,20 +2,59 @@
 #define METADATA_CACHE_H
 
 #include "metadata.h"
+#include <cstdint>
+#include <mutex>
 #include <string>
 #include <vector>
 #include <optional>
 
+// Per-library metadata cache in cache_dir (default: ~/.cache/vibe-player),
+// named by a stable hash of the library path. Paths in it are relative to
+// the library, so a copy saved as .vibe-player-cache.json in the library
+// root serves every host that mounts the library, wherever it does.
+//
+// The cache file is a manifest of shards, one per top-level directory of
+// the library, kept in a .shards directory beside it together with each
+// shard's path index (MetadataIndex). Shards are parsed in parallel on
+// load, and a save only writes the shards, and indexes, whose tracks
+// changed. Each version of a shard is a new file, so a reader holding the
+// previous manifest still finds its shards; they are removed once the new
+// manifest is in place.
+//
+// Small changes are appended to a journal next to the cache file and
+// replayed by load(), instead of rewriting the whole cache; compact()
+// folds the journal back in. save(), update() and compact() may be
+// called from different threads.
 class MetadataCache {
 public:
     MetadataCache(const std::string& cache_dir = "");
 
-    // Load cached metadata for a library path
+    // Load cached metadata for a library path, with paths under it
     std::optional<std::vector<TrackMetadata>> load(const std::string& library_path);
 
-    // Save metadata to cache
+    // Save metadata to cache, along with the path index players use
+    // (see MetadataIndex)
     bool save(const std::string& library_path, const std::vector<TrackMetadata>& tracks);
 
+    // Journal tracks added or changed and files removed since the cache
+    // was saved. The path index is left alone until the next save or
+    // compaction; players read tags themselves for tracks not in it.
+    // Returns false if there is no saved cache to add to.
+    bool update(const std::string& library_path,
+                const std::vector<TrackMetadata>& changed,
+                const std::vector<std::string>& removed);
+
+    // Size of the journal in bytes, and whether it is large enough to be
+    // worth compacting
+    uint64_t journalSize(const std::string& library_path) const;
+    bool needsCompaction(const std::string& library_path) const;
+
+    // Save tracks, a snapshot taken when the journal was journal_offset
+    // bytes long, keeping the records journaled after it
+    bool compact(const std::string& library_path,
+                 const std::vector<TrackMetadata>& tracks,
+                 uint64_t journal_offset);
+
     // Check if cache is valid (files haven't changed)
     bool isValid(const std::string& library_path,
                  const std::vector<TrackMetadata>& cached_tracks);
@@ -26,6 +65,17 @@ public:
 private:
     std::string cache_dir_;
     std::string getCachePath(const std::string& library_path) const;
+    std::string getIndexPath(const std::string& library_path) const;
+    std::string getJournalPath(const std::string& library_path) const;
+    std::string getLegacyCachePath(const std::string& library_path) const;
+    std::optional<std::vector<TrackMetadata>> readCacheFile(const std::string& cache_path,
+                                                            const std::string& library_path) const;
+    void replayJournal(const std::string& library_path, std::vector<TrackMetadata>& tracks) const;
+    bool writeCache(const std::string& library_path,
+                    const std::vector<TrackMetadata>& tracks,
+                    const std::string& journal_tail);
+
+    std::mutex mutex_;
     void ensureCacheDirectoryExists();
     std::string hashLibraryPath(const std::string& library_path) const;
 };
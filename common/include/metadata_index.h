@@ -0,0 +1,57 @@
+/*
+ * vibe-player
+ * metadata_index.h
+ */
+
+#ifndef METADATA_INDEX_H
+#define METADATA_INDEX_H
+
+#include "metadata.h"
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Read-only, path-keyed view of every library scanned into the metadata
+// cache. Each shard of a library's cache has a binary index beside it:
+// fixed-size records sorted by path hash plus a string table, mapped with
+// mmap so a lookup is a binary search and a stat of the file. An index
+// records the directory all its paths are in, so a lookup only searches
+// the indexes of shards that can hold the path.
+class MetadataIndex {
+public:
+    // Maps the indexes found in cache_dir (default: ~/.cache/vibe-player)
+    explicit MetadataIndex(const std::string& cache_dir = "");
+    ~MetadataIndex();
+
+    MetadataIndex(const MetadataIndex&) = delete;
+    MetadataIndex& operator=(const MetadataIndex&) = delete;
+
+    // Cached metadata for filepath, or nullopt if no index has it or the
+    // file changed since it was scanned. Safe to call from any thread.
+    std::optional<TrackMetadata> lookup(const std::string& filepath) const;
+
+    // Number of tracks across all mapped indexes
+    size_t size() const;
+
+    // Write the index for one cache shard (atomically replacing an old one)
+    static bool write(const std::string& index_path, const std::vector<const TrackMetadata*>& tracks);
+
+    // Key used for filepath in the index: the canonical path if it exists
+    static std::string normalizePath(const std::string& filepath);
+
+private:
+    struct Mapping {
+        const unsigned char* data;
+        size_t size;
+        size_t count;
+        std::string_view prefix;  // Into data
+    };
+
+    void map(const std::string& index_path);
+    std::optional<TrackMetadata> lookupIn(const Mapping& mapping, const std::string& filepath, uint64_t hash) const;
+
+    std::vector<Mapping> mappings_;
+};
+
+#endif // METADATA_INDEX_H
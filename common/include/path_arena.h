@@ -0,0 +1,54 @@
+/*
+ * vibe-player
+ * path_arena.h
+ */
+
+#ifndef PATH_ARENA_H
+#define PATH_ARENA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Ordered list of paths stored in one character buffer plus a span per
+// entry, instead of one heap allocation per std::string. Edits move spans
+// only; bytes of removed entries are reclaimed once they make up half of
+// the buffer. Views returned by operator[] are invalidated by any edit.
+class PathArena {
+public:
+    void reserve(size_t count, size_t bytes);
+    void push_back(std::string_view path);
+    void insert(size_t position, std::string_view path);
+    void erase(size_t index);
+    void replace(size_t index, std::string_view path);
+    void move(size_t from, size_t to);  // Keeps the other entries in order
+    void keepOnly(size_t index);
+    // Entry begin + i becomes the former entry begin + order[i]
+    void reorder(size_t begin, const std::vector<size_t>& order);
+    void clear();
+
+    std::string_view operator[](size_t index) const
+    {
+        const Span& span = spans_[index];
+        return std::string_view(blob_.data() + span.offset, span.length);
+    }
+    size_t size() const { return spans_.size(); }
+    bool empty() const { return spans_.empty(); }
+
+private:
+    struct Span {
+        uint64_t offset;
+        uint32_t length;
+    };
+
+    Span store(std::string_view path);
+    void compactIfSparse();
+
+    std::string blob_;
+    std::vector<Span> spans_;
+    size_t dead_bytes_ = 0;
+};
+
+#endif // PATH_ARENA_H
@@ -1,6 +1,8 @@
 #ifndef PLAYER_H
 #define PLAYER_H
 
+#include <atomic>
+#include <functional>
 #include <string>
 
 #include "miniaudio.h"
@@ -17,6 +19,7 @@ public:
     void stop();
     bool isPlaying() const;
     bool isPaused() const;
+    bool isLoaded() const; // a track is open, even if stopped
     void setVolume(float volume); // 0.0 to 1.0
     float getVolume() const;
     void seek(int64_t position); // position in milliseconds
@@ -24,15 +27,20 @@ public:
     int64_t getDuration() const; // duration in milliseconds
     void cleanup();
 
+    // Called from the audio thread when the decoder runs out of frames.
+    // Must be cheap and thread-safe (e.g. EventLoop::notify).
+    void setTrackEndCallback(std::function<void()> callback);
+
 private:
     mutable ma_decoder decoder_;  // mutable to allow cursor queries in const methods
     ma_device device_;
     bool decoder_initialized_ = false;
     bool device_initialized_ = false;
-    bool playing_ = false;
-    bool paused_ = false;
+    std::atomic<bool> playing_{false};
+    std::atomic<bool> paused_{false};
     float volume_ = 0.25f; // volume level (0.0 to 1.0)
     int64_t duration_ms_ = 0; // duration in milliseconds
+    std::function<void()> track_end_callback_;
 
     static void DataCallback(ma_device* pDevice, void* pOutput, const void* pInput, ma_uint32 frameCount);
 };
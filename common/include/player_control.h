@@ -0,0 +1,34 @@
+/*
+ * vibe-player
+ * player_control.h
+ */
+
+#ifndef PLAYER_CONTROL_H
+#define PLAYER_CONTROL_H
+
+#include "control_server.h"
+#include "player.h"
+#include "playlist.h"
+
+#include <nlohmann/json.hpp>
+
+// Load the playlist's current track and start playing it
+bool PlayCurrentTrack(AudioPlayer &player, const Playlist &playlist);
+
+// Snapshot of playback state as sent to control clients.
+// Times are whole seconds so subscribers get at most one push per second.
+nlohmann::json PlayerStatusJson(const AudioPlayer &player, const Playlist &playlist);
+
+// Apply one control protocol request:
+//   status | play | pause | toggle | stop | next | prev | quit
+//   seek <seconds|+N|-N> | volume <percent|+N|-N>
+//   enqueue <path> | insert <path> | remove <n> | move <from> <to>
+//   enqueue-list <JSON array of paths> | insert-list <JSON array of paths>
+//   jump <n> | clear | queue
+// Track numbers are 1-based, as in the status "track" field. Returns the status with "ok": true, or {"ok": false, "error": ...}
+nlohmann::json HandleControlRequest(const ControlRequest &request,
+                                    AudioPlayer &player,
+                                    Playlist &playlist,
+                                    bool &running);
+
+#endif // PLAYER_CONTROL_H
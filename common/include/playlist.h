@@ -7,7 +7,11 @@
 #define PLAYLIST_H
 
 #include "metadata.h"
+#include "path_arena.h"
+#include "track_store.h"
+#include <memory>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <optional>
 
@@ -17,13 +21,29 @@ enum class PlaylistFormat {
     AUTO_DETECT
 };
 
+class MetadataIndex;
+class MetadataPrefetcher;
+class PlaylistStream;
+
 class Playlist {
 public:
+    // Tracks after the current one resolved in the background by default
+    static constexpr size_t DEFAULT_LOOK_AHEAD = 3;
+
     // Construction
     static std::optional<Playlist> fromFile(const std::string& filepath);
     static std::optional<Playlist> fromTextFile(const std::string& filepath);
+    // Detects M3U, PLS and XSPF content, otherwise one path per line
+    static std::optional<Playlist> fromString(std::string_view content, const std::string& base_path = "");
     static std::optional<Playlist> fromPaths(const std::vector<std::string>& paths, const std::string& base_path = "");
-    static Playlist fromTracks(const std::vector<TrackMetadata>& tracks);
+    static Playlist fromTracks(std::vector<TrackMetadata> tracks);
+
+    // Move-only: a playlist owns its background resolver
+    Playlist(Playlist&&);
+    Playlist& operator=(Playlist&&);
+    Playlist(const Playlist&) = delete;
+    Playlist& operator=(const Playlist&) = delete;
+    ~Playlist();
 
     // Serialization
     std::string toText() const;
@@ -32,7 +52,7 @@ public:
 
     // Navigation
     const TrackMetadata& current() const;
-    const std::string& currentPath() const;
+    std::string_view currentPath() const;
     bool advance();
     bool previous();
     bool hasPrevious() const;
@@ -43,26 +63,121 @@ public:
     void reset();  // Reset to beginning
 
     // Access
-    const std::vector<TrackMetadata>& tracks() const { return tracks_; }
-    const std::vector<std::string>& paths() const { return paths_; }
+    const TrackMetadata& track(size_t index) const;  // Resolves metadata if needed
+    bool isResolved(size_t index) const;
+    // File of a track: resolved if the track or resolvePaths() has been,
+    // as written in the playlist otherwise. Invalidated by any edit.
+    std::string_view path(size_t index) const;
 
-    // Metadata extraction
+    // Queue editing. The current index keeps following the current track;
+    // indices are 0-based.
+    void append(const TrackMetadata& track);
+    void insert(size_t position, const TrackMetadata& track);  // Clamped to size()
+    // Queue files unread: like the tracks of a path playlist, they are
+    // resolved on first access or by the look-ahead, from the metadata
+    // index when it has them
+    void insertPaths(size_t position, const std::vector<std::string>& paths);  // Clamped to size()
+    bool remove(size_t index);  // Removing the current track makes the next one current
+    bool move(size_t from, size_t to);
+    void clearExceptCurrent();  // Drops history and upcoming tracks
+
+    // Shuffle the tracks after the current one, or all of them (making the
+    // first of the new order current). Artists and albums are spread apart;
+    // see SpreadShuffle. The same seed gives the same order.
+    void shuffle(uint64_t seed, bool include_current = false);
+
+    // Metadata extraction. Path playlists resolve metadata on first access;
+    // with look-ahead enabled the next `window` tracks are resolved on a
+    // background thread whenever the current track changes.
+    void enableLookAhead(size_t window = DEFAULT_LOOK_AHEAD);
     void extractAllMetadata();
 
+    // Consult the library metadata cache before reading tags from a file
+    void setMetadataIndex(std::shared_ptr<const MetadataIndex> index);
+
+    // Path resolution. Resolved paths are memoized; resolvePaths() resolves
+    // every remaining one in a single (parallel) pass. Trusted absolute
+    // paths are only normalized, skipping the existence check and symlink
+    // resolution.
+    void resolvePaths() const;
+    void setTrustAbsolutePaths(bool trust);
+
     // Metadata
     std::string version() const { return "1.0"; }
-    bool empty() const { return tracks_.empty() && paths_.empty(); }
+    bool empty() const { return track_ids_.empty(); }
 
 private:
-    Playlist(const std::vector<TrackMetadata>& tracks);
-    Playlist(const std::vector<std::string>& paths, const std::string& base_path);
+    friend class PlaylistStream;
+
+    explicit Playlist(const std::string& base_path);
+
+    // Add a track at the end; entries described by the playlist file
+    // itself come with metadata and start out resolved
+    void addEntry(std::string_view path, std::optional<TrackMetadata> metadata = std::nullopt);
 
-    std::string resolvePath(const std::string& path) const;
+    // Format readers (playlist_formats.cpp)
+    static std::optional<Playlist> fromText(std::string_view content, const std::string& base_path);
+    static std::optional<Playlist> fromM3u(std::string_view content, const std::string& base_path);
+    static std::optional<Playlist> fromPls(std::string_view content, const std::string& base_path);
+    static std::optional<Playlist> fromXspf(std::string_view content, const std::string& base_path);
 
-    std::vector<TrackMetadata> tracks_;
-    std::vector<std::string> paths_;
+    std::string_view resolvedPath(size_t index) const;
+    void scheduleLookAhead() const;
+
+    // One entry per track, in playlist order. Unresolved tracks keep their
+    // path in paths_ (as written until resolved); resolved ones have an id
+    // in store_ and an empty path entry, so no file name is stored twice.
+    mutable std::vector<TrackStore::TrackId> track_ids_;
+    mutable PathArena paths_;
+    mutable std::vector<bool> path_resolved_;
+    std::unique_ptr<TrackStore> store_;
     std::string base_path_;
     size_t current_index_;
+
+    bool trust_absolute_paths_ = false;
+    size_t look_ahead_ = 0;
+    mutable std::unique_ptr<MetadataPrefetcher> prefetcher_;  // Started on demand
+    std::shared_ptr<const MetadataIndex> index_;
+};
+
+// Reads a playlist from a pipe as it arrives, so playback can start with
+// the first track while the rest is still being written. Plain text and
+// M3U are parsed line by line; PLS and XSPF once the input is complete.
+class PlaylistStream {
+public:
+    // Takes ownership of fd
+    explicit PlaylistStream(int fd, const std::string& base_path = "");
+    ~PlaylistStream();
+
+    PlaylistStream(const PlaylistStream&) = delete;
+    PlaylistStream& operator=(const PlaylistStream&) = delete;
+
+    // Blocks until the first track has arrived (or all of the input for
+    // PLS/XSPF); nullopt if the input ends without any. The descriptor is
+    // non-blocking afterwards.
+    std::optional<Playlist> start();
+
+    // Append the tracks that have arrived since; returns how many
+    size_t readAvailable(Playlist& playlist);
+
+    // Watch this for readability while !finished()
+    int fd() const { return fd_; }
+    bool finished() const { return fd_ < 0; }
+
+private:
+    enum class Mode { DETECT, TEXT, M3U, BUFFERED };
+    enum class ReadResult { DATA, AGAIN, END };  // END covers read errors
+
+    ReadResult readChunk();
+    size_t consumeLines(Playlist& playlist, bool at_end);
+    size_t consumeLine(Playlist& playlist, std::string_view line);
+    void finish();
+
+    int fd_;
+    std::string base_path_;
+    std::string buffer_;
+    Mode mode_ = Mode::DETECT;
+    std::optional<TrackMetadata> m3u_pending_;  // Tags awaiting their path line
 };
 
 #endif // PLAYLIST_H
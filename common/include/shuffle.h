@@ -0,0 +1,37 @@
+/*
+ * vibe-player
+ * shuffle.h
+ */
+
+#ifndef SHUFFLE_H
+#define SHUFFLE_H
+
+#include "metadata.h"
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+// What a shuffled track should not be played next to: hashes of its
+// artist and album (or of the directories standing in for them)
+struct ShuffleKey {
+    uint64_t artist;
+    uint64_t album;
+};
+
+// Key from tags, falling back to the file's directories
+ShuffleKey ShuffleKeyFor(const TrackMetadata& track);
+
+// Key from the path alone, for tracks whose tags have not been read:
+// the parent directory stands in for the album, its parent for the artist
+ShuffleKey ShuffleKeyForPath(std::string_view path);
+
+// Play order for keys.size() tracks that spreads each artist evenly over
+// the whole order, and each album evenly over its artist's slots, with
+// random offsets and jitter so the result does not look regular.
+// O(n log n); the same keys and seed always give the same order.
+std::vector<size_t> SpreadShuffle(const std::vector<ShuffleKey>& keys, uint64_t seed);
+
+// Seed for callers that were not given one
+uint64_t RandomShuffleSeed();
+
+#endif // SHUFFLE_H
@@ -0,0 +1,32 @@
+/*
+ * vibe-player
+ * tag_reader.h
+ */
+
+#ifndef TAG_READER_H
+#define TAG_READER_H
+
+#include <cstdint>
+#include <optional>
+#include <string>
+
+// Tags and duration of an audio file, as read (not yet UTF-8 sanitized)
+struct AudioTags {
+    std::optional<std::string> title;
+    std::optional<std::string> artist;
+    std::optional<std::string> album;
+    std::optional<std::string> genre;
+    std::optional<int> year;
+    int64_t duration_ms = 0;
+};
+
+// Read the tags and duration of an MP3 (ID3v2.3/2.4), FLAC, Ogg Vorbis,
+// Ogg Opus or WAV file without TagLib. Only metadata blocks, the first
+// MPEG frame and, for Ogg, the last page are read, so the cost does not
+// grow with the length of the audio. Returns nullopt for anything not
+// read the way TagLib would read it (other formats, unsynchronised or
+// compressed ID3v2 frames, numeric ID3 genres, ...); callers fall back to
+// TagLib then.
+std::optional<AudioTags> ReadTagsFast(int fd, uint64_t file_size);
+
+#endif // TAG_READER_H
@@ -0,0 +1,45 @@
+/*
+ * vibe-player
+ * track_store.h
+ */
+
+#ifndef TRACK_STORE_H
+#define TRACK_STORE_H
+
+#include "metadata.h"
+#include <cstdint>
+#include <deque>
+#include <string_view>
+#include <unordered_map>
+
+// Metadata of resolved tracks, stored once per file. Playlists refer to
+// tracks by id, so a file queued several times is described once.
+// References returned by get() stay valid for the lifetime of the store.
+//
+// Each Playlist owns its store. The library-wide store is MetadataIndex:
+// the cache's mapped index, shared by every player without being read
+// into memory. Tracks resolved from it land here, so a store holds only
+// what its queue has reached, and needs no locking, as only the
+// playlist's thread touches it.
+class TrackStore {
+public:
+    using TrackId = uint32_t;
+    static constexpr TrackId NO_TRACK = 0xffffffffu;
+
+    TrackStore() = default;
+    TrackStore(const TrackStore&) = delete;
+    TrackStore& operator=(const TrackStore&) = delete;
+
+    // Id of the track with this filepath. Metadata is stored once per
+    // file version: a track whose file_mtime differs from the stored one
+    // (and is known) gets a new id, and later adds of the path find that.
+    TrackId add(TrackMetadata track);
+    const TrackMetadata& get(TrackId id) const { return tracks_[id]; }
+    size_t size() const { return tracks_.size(); }
+
+private:
+    std::deque<TrackMetadata> tracks_;
+    std::unordered_map<std::string_view, TrackId> ids_;  // Keys view into tracks_
+};
+
+#endif // TRACK_STORE_H
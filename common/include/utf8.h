@@ -0,0 +1,22 @@
+/*
+ * vibe-player
+ * utf8.h
+ */
+
+#ifndef UTF8_H
+#define UTF8_H
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+// Length of the longest prefix of text that is valid UTF-8: no stray
+// continuation bytes, truncated or overlong sequences, surrogates or
+// values past U+10FFFF
+size_t ValidUtf8Prefix(std::string_view text);
+
+// text with its invalid UTF-8 sequences removed. Valid text, which is
+// nearly all of it, is returned without being copied.
+std::string SanitizeUtf8(std::string text);
+
+#endif // UTF8_H
@@ -0,0 +1,127 @@
+/*
+ * vibe-player
+ * control_client.cpp
+ */
+
+#include "control_client.h"
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+
+ControlClient::~ControlClient()
+{
+    if (fd_ >= 0)
+    {
+        close(fd_);
+    }
+}
+
+bool ControlClient::connect(const std::string &socket_path)
+{
+    struct sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    if (socket_path.size() >= sizeof(addr.sun_path))
+    {
+        std::cerr << "Error: Control socket path too long: " << socket_path << std::endl;
+        return false;
+    }
+    strncpy(addr.sun_path, socket_path.c_str(), sizeof(addr.sun_path) - 1);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        std::cerr << "Error: Could not create socket: " << strerror(errno) << std::endl;
+        return false;
+    }
+    if (::connect(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) < 0)
+    {
+        std::cerr << "Error: No player listening on " << socket_path << ": " << strerror(errno) << std::endl;
+        close(fd);
+        return false;
+    }
+
+    if (fd_ >= 0)
+    {
+        close(fd_);
+    }
+    fd_ = fd;
+    buffer_.clear();
+    return true;
+}
+
+bool ControlClient::send(const std::string &command, const std::string &argument)
+{
+    if (fd_ < 0 || command.find('\n') != std::string::npos || argument.find('\n') != std::string::npos)
+    {
+        return false;
+    }
+
+    std::string data = argument.empty() ? command + "\n" : command + " " + argument + "\n";
+    size_t offset = 0;
+    while (offset < data.size())
+    {
+        ssize_t n = ::send(fd_, data.data() + offset, data.size() - offset, MSG_NOSIGNAL);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return false;
+        }
+        offset += n;
+    }
+    return true;
+}
+
+bool ControlClient::readLine(std::string &line)
+{
+    if (fd_ < 0)
+    {
+        return false;
+    }
+
+    while (true)
+    {
+        size_t newline = buffer_.find('\n');
+        if (newline != std::string::npos)
+        {
+            line = buffer_.substr(0, newline);
+            buffer_.erase(0, newline + 1);
+            return true;
+        }
+
+        char buf[4096];
+        ssize_t n = recv(fd_, buf, sizeof(buf), 0);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            return false;
+        }
+        buffer_.append(buf, n);
+    }
+}
+
+std::optional<nlohmann::json> ControlClient::request(const std::string &command, const std::string &argument)
+{
+    std::string line;
+    if (!send(command, argument) || !readLine(line))
+    {
+        return std::nullopt;
+    }
+
+    auto reply = nlohmann::json::parse(line, nullptr, false);
+    if (reply.is_discarded())
+    {
+        return std::nullopt;
+    }
+    return reply;
+}
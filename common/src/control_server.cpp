@@ -0,0 +1,334 @@
+/*
+ * vibe-player
+ * control_server.cpp
+ */
+
+#include "control_server.h"
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <vector>
+
+#include <spdlog/spdlog.h>
+
+using json = nlohmann::json;
+
+namespace
+{
+    // Replies echo requests and carry file paths, neither of which has to
+    // be valid UTF-8; replace bad bytes rather than let dump() throw
+    std::string DumpLine(const json &message)
+    {
+        return message.dump(-1, ' ', false, json::error_handler_t::replace);
+    }
+}
+
+ControlRequest ControlRequest::parse(const std::string &line)
+{
+    ControlRequest request;
+
+    size_t start = line.find_first_not_of(" \t\r");
+    if (start == std::string::npos)
+    {
+        return request;
+    }
+    size_t end = line.find_first_of(" \t\r", start);
+    request.command = line.substr(start, end == std::string::npos ? std::string::npos : end - start);
+
+    if (end != std::string::npos)
+    {
+        size_t arg_start = line.find_first_not_of(" \t", end);
+        size_t arg_end = line.find_last_not_of(" \t\r");
+        if (arg_start != std::string::npos && arg_end >= arg_start)
+        {
+            request.argument = line.substr(arg_start, arg_end - arg_start + 1);
+        }
+    }
+    return request;
+}
+
+ControlServer::ControlServer(EventLoop &loop)
+    : loop_(loop)
+{
+}
+
+ControlServer::~ControlServer()
+{
+    while (!clients_.empty())
+    {
+        closeClient(clients_.begin()->first);
+    }
+
+    if (listen_fd_ >= 0)
+    {
+        loop_.unwatchFd(listen_fd_);
+        close(listen_fd_);
+        unlink(socket_path_.c_str());
+    }
+}
+
+std::string ControlServer::defaultSocketPath()
+{
+    const char *runtime_dir = std::getenv("XDG_RUNTIME_DIR");
+    if (runtime_dir && *runtime_dir)
+    {
+        return std::string(runtime_dir) + "/vibe-player.sock";
+    }
+    return "/tmp/vibe-player-" + std::to_string(getuid()) + ".sock";
+}
+
+bool ControlServer::listen(const std::string &socket_path, Handler handler)
+{
+    struct sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    if (socket_path.size() >= sizeof(addr.sun_path))
+    {
+        spdlog::error("Control socket path too long: {}", socket_path);
+        return false;
+    }
+    strncpy(addr.sun_path, socket_path.c_str(), sizeof(addr.sun_path) - 1);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        spdlog::error("Could not create control socket: {}", strerror(errno));
+        return false;
+    }
+
+    int rc = bind(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr));
+    if (rc < 0 && errno == EADDRINUSE)
+    {
+        // Only take over the path if nobody answers on it
+        int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        bool in_use = probe >= 0 && connect(probe, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) == 0;
+        if (probe >= 0)
+        {
+            close(probe);
+        }
+        if (in_use)
+        {
+            spdlog::warn("Control socket {} is in use by another player", socket_path);
+            close(fd);
+            return false;
+        }
+
+        unlink(socket_path.c_str());
+        rc = bind(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr));
+    }
+    if (rc < 0)
+    {
+        spdlog::error("Could not bind control socket {}: {}", socket_path, strerror(errno));
+        close(fd);
+        return false;
+    }
+
+    // Playback control is per user
+    chmod(socket_path.c_str(), S_IRUSR | S_IWUSR);
+
+    if (::listen(fd, 8) < 0)
+    {
+        spdlog::error("Could not listen on control socket {}: {}", socket_path, strerror(errno));
+        close(fd);
+        unlink(socket_path.c_str());
+        return false;
+    }
+
+    listen_fd_ = fd;
+    socket_path_ = socket_path;
+    handler_ = std::move(handler);
+    loop_.watchFd(listen_fd_, [this]()
+                  { acceptClients(); });
+
+    spdlog::info("Listening for control clients on {}", socket_path_);
+    return true;
+}
+
+void ControlServer::acceptClients()
+{
+    while (true)
+    {
+        int fd = accept4(listen_fd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0)
+        {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+            {
+                spdlog::warn("Control socket accept failed: {}", strerror(errno));
+            }
+            return;
+        }
+
+        clients_[fd] = Client();
+        loop_.watchFd(fd, [this, fd]()
+                      { readClient(fd); });
+        spdlog::debug("Control client connected (fd {})", fd);
+    }
+}
+
+void ControlServer::readClient(int fd)
+{
+    // Requests sent just before the client hung up are still answered
+    bool hangup = false;
+    char buf[4096];
+    while (true)
+    {
+        ssize_t n = recv(fd, buf, sizeof(buf), 0);
+        if (n > 0)
+        {
+            clients_[fd].input.append(buf, n);
+            continue;
+        }
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        hangup = n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK);
+        break;
+    }
+
+    // Handle every complete line; sending a reply may close this client
+    while (clients_.count(fd))
+    {
+        std::string &input = clients_[fd].input;
+        size_t newline = input.find('\n');
+        if (newline == std::string::npos)
+        {
+            if (hangup)
+            {
+                closeClient(fd);
+            }
+            else if (input.size() > MAX_LINE)
+            {
+                spdlog::warn("Control client sent an oversized request, disconnecting");
+                closeClient(fd);
+            }
+            return;
+        }
+
+        ControlRequest request = ControlRequest::parse(input.substr(0, newline));
+        input.erase(0, newline + 1);
+        if (request.command.empty())
+        {
+            continue;
+        }
+
+        json reply;
+        try
+        {
+            if (request.command == "subscribe")
+            {
+                // The first push is the current status
+                clients_[fd].subscribed = true;
+                reply = handler_(ControlRequest{"status", ""});
+            }
+            else
+            {
+                reply = handler_(request);
+            }
+        }
+        catch (const std::exception &e)
+        {
+            // A bad request must not take the player down with it
+            spdlog::error("Control command '{}' failed: {}", request.command, e.what());
+            reply = json{{"ok", false}, {"error", std::string("internal error: ") + e.what()}};
+        }
+
+        if (!sendLine(fd, DumpLine(reply)))
+        {
+            return;
+        }
+    }
+}
+
+bool ControlServer::sendLine(int fd, const std::string &line)
+{
+    Client &client = clients_[fd];
+    client.output += line;
+    client.output += '\n';
+    if (client.output.size() > MAX_PENDING_OUTPUT)
+    {
+        spdlog::debug("Dropping control client (fd {}) that is not reading", fd);
+        closeClient(fd);
+        return false;
+    }
+    return flushClient(fd);
+}
+
+bool ControlServer::flushClient(int fd)
+{
+    std::string &output = clients_[fd].output;
+    size_t offset = 0;
+    while (offset < output.size())
+    {
+        ssize_t sent = send(fd, output.data() + offset, output.size() - offset, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (sent > 0)
+        {
+            offset += sent;
+            continue;
+        }
+        if (sent < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            break;
+        }
+        closeClient(fd);
+        return false;
+    }
+    output.erase(0, offset);
+
+    // Keep the rest until the socket drains
+    if (output.empty())
+    {
+        loop_.unwatchFdWritable(fd);
+    }
+    else
+    {
+        loop_.watchFdWritable(fd, [this, fd]()
+                              { flushClient(fd); });
+    }
+    return true;
+}
+
+void ControlServer::closeClient(int fd)
+{
+    loop_.unwatchFd(fd);
+    close(fd);
+    clients_.erase(fd);
+    spdlog::debug("Control client disconnected (fd {})", fd);
+}
+
+void ControlServer::publishStatus(const json &status)
+{
+    if (listen_fd_ < 0)
+    {
+        return;
+    }
+
+    std::string line = DumpLine(status);
+    if (line == last_status_)
+    {
+        return;
+    }
+    last_status_ = line;
+
+    std::vector<int> subscribers;
+    for (const auto &[fd, client] : clients_)
+    {
+        if (client.subscribed)
+        {
+            subscribers.push_back(fd);
+        }
+    }
+    for (int fd : subscribers)
+    {
+        sendLine(fd, line);
+    }
+}
@@ -0,0 +1,279 @@
+/*
+ * vibe-player
+ * directory_walker.cpp
+ */
+
+#include "directory_walker.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <mutex>
+#include <thread>
+
+#include <spdlog/spdlog.h>
+
+namespace
+{
+    constexpr std::array<std::string_view, 4> AUDIO_EXTENSIONS = {"wav", "mp3", "flac", "ogg"};
+    constexpr size_t DIRENT_BUFFER_SIZE = 64 * 1024;
+    // Reading directories is I/O bound; past this more threads only contend
+    constexpr unsigned MAX_WALK_THREADS = 8;
+
+    // Layout of the records getdents64 fills the buffer with
+    struct LinuxDirent64 {
+        uint64_t d_ino;
+        int64_t d_off;
+        unsigned short d_reclen;
+        unsigned char d_type;
+        char d_name[];
+    };
+
+    bool EqualsIgnoreCase(std::string_view a, std::string_view lower)
+    {
+        if (a.size() != lower.size())
+        {
+            return false;
+        }
+        for (size_t i = 0; i < a.size(); ++i)
+        {
+            char c = a[i];
+            if (c >= 'A' && c <= 'Z')
+            {
+                c = static_cast<char>(c - 'A' + 'a');
+            }
+            if (c != lower[i])
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    std::string JoinPath(const std::string &directory, std::string_view name)
+    {
+        std::string path;
+        path.reserve(directory.size() + 1 + name.size());
+        path.append(directory);
+        if (path.empty() || path.back() != '/')
+        {
+            path += '/';
+        }
+        path.append(name);
+        return path;
+    }
+
+    // Directories waiting to be read, shared by the walker threads. The
+    // walk is over when nothing is queued and no thread is reading a
+    // directory that could queue more.
+    class DirectoryQueue {
+    public:
+        explicit DirectoryQueue(std::string root) { pending_.push_back(std::move(root)); }
+
+        bool pop(std::string &directory)
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cv_.wait(lock, [this]()
+                     { return !pending_.empty() || active_ == 0; });
+            if (pending_.empty())
+            {
+                return false;
+            }
+            directory = std::move(pending_.back());
+            pending_.pop_back();
+            ++active_;
+            return true;
+        }
+
+        // Called once per popped directory, with its subdirectories
+        void done(std::vector<std::string> &subdirectories)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                std::move(subdirectories.begin(), subdirectories.end(), std::back_inserter(pending_));
+                --active_;
+            }
+            subdirectories.clear();
+            cv_.notify_all();
+        }
+
+    private:
+        std::mutex mutex_;
+        std::condition_variable cv_;
+        std::vector<std::string> pending_;
+        size_t active_ = 0;
+    };
+
+    // Read one directory, appending its audio files to files and, if
+    // wanted, its subdirectories to subdirectories
+    void ReadDirectory(const std::string &directory,
+                       std::vector<char> &buffer,
+                       std::vector<std::string> &files,
+                       std::vector<std::string> *subdirectories)
+    {
+        int fd = open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (fd < 0)
+        {
+            spdlog::warn("Cannot read directory {}: {}", directory, std::strerror(errno));
+            return;
+        }
+
+        for (;;)
+        {
+            long bytes = syscall(SYS_getdents64, fd, buffer.data(), buffer.size());
+            if (bytes < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                spdlog::warn("Error reading directory {}: {}", directory, std::strerror(errno));
+                break;
+            }
+            if (bytes == 0)
+            {
+                break;
+            }
+
+            for (long offset = 0; offset < bytes;)
+            {
+                const auto *entry = reinterpret_cast<const LinuxDirent64 *>(buffer.data() + offset);
+                offset += entry->d_reclen;
+
+                std::string_view name(entry->d_name);
+                if (name == "." || name == "..")
+                {
+                    continue;
+                }
+
+                unsigned char type = entry->d_type;
+                bool audio = HasAudioExtension(name);
+                if (type == DT_REG)
+                {
+                    if (audio)
+                    {
+                        files.push_back(JoinPath(directory, name));
+                    }
+                    continue;
+                }
+                if (type == DT_DIR)
+                {
+                    if (subdirectories)
+                    {
+                        subdirectories->push_back(JoinPath(directory, name));
+                    }
+                    continue;
+                }
+
+                // A symlink only matters if it points to an audio file;
+                // other types need a stat to tell files from directories
+                if ((type == DT_LNK && !audio) || (type != DT_LNK && type != DT_UNKNOWN))
+                {
+                    continue;
+                }
+                struct stat st;
+                if (fstatat(fd, entry->d_name, &st, AT_SYMLINK_NOFOLLOW) != 0)
+                {
+                    continue;
+                }
+                if (S_ISLNK(st.st_mode) && (!audio || fstatat(fd, entry->d_name, &st, 0) != 0))
+                {
+                    continue;
+                }
+                if (S_ISREG(st.st_mode) && audio)
+                {
+                    files.push_back(JoinPath(directory, name));
+                }
+                else if (type == DT_UNKNOWN && S_ISDIR(st.st_mode) && subdirectories)
+                {
+                    subdirectories->push_back(JoinPath(directory, name));
+                }
+            }
+        }
+        close(fd);
+    }
+}
+
+bool HasAudioExtension(std::string_view filename)
+{
+    // A leading dot starts a hidden name, not an extension
+    size_t dot = filename.rfind('.');
+    if (dot == std::string_view::npos || dot == 0)
+    {
+        return false;
+    }
+    std::string_view extension = filename.substr(dot + 1);
+    return std::any_of(AUDIO_EXTENSIONS.begin(), AUDIO_EXTENSIONS.end(),
+                       [extension](std::string_view candidate)
+                       { return EqualsIgnoreCase(extension, candidate); });
+}
+
+std::vector<std::string> FindAudioFiles(const std::string &directory, bool recursive)
+{
+    std::string root = directory;
+    while (root.size() > 1 && root.back() == '/')
+    {
+        root.pop_back();
+    }
+
+    std::vector<std::string> files;
+    std::vector<char> buffer(DIRENT_BUFFER_SIZE);
+    if (!recursive)
+    {
+        ReadDirectory(root, buffer, files, nullptr);
+        return files;
+    }
+
+    DirectoryQueue queue(std::move(root));
+    std::mutex files_mutex;
+
+    // Each thread collects into its own list and merges once at the end
+    auto walk = [&queue, &files, &files_mutex](std::vector<char> &walk_buffer)
+    {
+        std::vector<std::string> found;
+        std::vector<std::string> subdirectories;
+        std::string current;
+        while (queue.pop(current))
+        {
+            ReadDirectory(current, walk_buffer, found, &subdirectories);
+            queue.done(subdirectories);
+        }
+
+        std::lock_guard<std::mutex> lock(files_mutex);
+        if (files.empty())
+        {
+            files = std::move(found);
+        }
+        else
+        {
+            std::move(found.begin(), found.end(), std::back_inserter(files));
+        }
+    };
+
+    unsigned thread_count = std::min(MAX_WALK_THREADS, std::max(1u, std::thread::hardware_concurrency()));
+    std::vector<std::thread> threads;
+    threads.reserve(thread_count - 1);
+    for (unsigned i = 1; i < thread_count; ++i)
+    {
+        threads.emplace_back([&walk]()
+                             {
+            std::vector<char> thread_buffer(DIRENT_BUFFER_SIZE);
+            walk(thread_buffer); });
+    }
+    walk(buffer);
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+    return files;
+}
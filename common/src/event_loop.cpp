@@ -0,0 +1,178 @@
+/*
+ * vibe-player
+ * event_loop.cpp
+ */
+
+#include "event_loop.h"
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <iostream>
+
+EventLoop::EventLoop()
+{
+    wake_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wake_fd_ < 0)
+    {
+        std::cerr << "Error: Could not create event loop wakeup descriptor" << std::endl;
+    }
+
+    timer_fd_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (timer_fd_ < 0)
+    {
+        std::cerr << "Error: Could not create event loop timer" << std::endl;
+    }
+}
+
+EventLoop::~EventLoop()
+{
+    if (wake_fd_ >= 0)
+    {
+        close(wake_fd_);
+    }
+    if (timer_fd_ >= 0)
+    {
+        close(timer_fd_);
+    }
+}
+
+bool EventLoop::isValid() const
+{
+    return wake_fd_ >= 0 && timer_fd_ >= 0;
+}
+
+void EventLoop::watchFd(int fd, Callback callback)
+{
+    removeWatch(fd, POLLIN);
+    watches_.push_back({fd, POLLIN, std::move(callback)});
+}
+
+void EventLoop::unwatchFd(int fd)
+{
+    watches_.erase(std::remove_if(watches_.begin(), watches_.end(),
+                                  [fd](const Watch &w)
+                                  { return w.fd == fd; }),
+                   watches_.end());
+}
+
+void EventLoop::watchFdWritable(int fd, Callback callback)
+{
+    removeWatch(fd, POLLOUT);
+    watches_.push_back({fd, POLLOUT, std::move(callback)});
+}
+
+void EventLoop::unwatchFdWritable(int fd)
+{
+    removeWatch(fd, POLLOUT);
+}
+
+void EventLoop::removeWatch(int fd, short events)
+{
+    watches_.erase(std::remove_if(watches_.begin(), watches_.end(),
+                                  [fd, events](const Watch &w)
+                                  { return w.fd == fd && w.events == events; }),
+                   watches_.end());
+}
+
+void EventLoop::setTimerCallback(Callback callback)
+{
+    timer_callback_ = std::move(callback);
+}
+
+void EventLoop::setTimerInterval(std::chrono::milliseconds interval)
+{
+    if (timer_fd_ < 0 || interval == timer_interval_)
+    {
+        return;
+    }
+    timer_interval_ = interval;
+
+    // A zero it_value disarms the timer
+    struct itimerspec spec = {};
+    spec.it_interval.tv_sec = interval.count() / 1000;
+    spec.it_interval.tv_nsec = (interval.count() % 1000) * 1000000;
+    spec.it_value = spec.it_interval;
+    timerfd_settime(timer_fd_, 0, &spec, nullptr);
+}
+
+void EventLoop::setNotifyCallback(Callback callback)
+{
+    notify_callback_ = std::move(callback);
+}
+
+void EventLoop::notify()
+{
+    // write(2) on an eventfd is async-signal-safe; EAGAIN only means the
+    // counter is saturated, in which case the loop is already awake
+    if (wake_fd_ >= 0)
+    {
+        uint64_t one = 1;
+        ssize_t ignored = write(wake_fd_, &one, sizeof(one));
+        (void)ignored;
+    }
+}
+
+bool EventLoop::runOnce(int timeout_ms)
+{
+    std::vector<struct pollfd> fds;
+    fds.reserve(watches_.size() + 2);
+    fds.push_back({wake_fd_, POLLIN, 0});
+    fds.push_back({timer_fd_, POLLIN, 0});
+    for (const auto &watch : watches_)
+    {
+        fds.push_back({watch.fd, watch.events, 0});
+    }
+
+    int ready = poll(fds.data(), fds.size(), timeout_ms);
+    if (ready < 0)
+    {
+        return errno == EINTR;
+    }
+
+    uint64_t counter = 0;
+    if (fds[0].revents & POLLIN)
+    {
+        ssize_t ignored = read(wake_fd_, &counter, sizeof(counter));
+        (void)ignored;
+        if (notify_callback_)
+        {
+            notify_callback_();
+        }
+    }
+
+    if (fds[1].revents & POLLIN)
+    {
+        ssize_t ignored = read(timer_fd_, &counter, sizeof(counter));
+        (void)ignored;
+        if (timer_callback_ && timer_interval_.count() > 0)
+        {
+            timer_callback_();
+        }
+    }
+
+    // Callbacks may add or remove watches, so look each one up again
+    for (size_t i = 2; i < fds.size(); ++i)
+    {
+        if (!(fds[i].revents & (fds[i].events | POLLHUP | POLLERR)))
+        {
+            continue;
+        }
+
+        auto it = std::find_if(watches_.begin(), watches_.end(),
+                               [&pfd = fds[i]](const Watch &w)
+                               { return w.fd == pfd.fd && w.events == pfd.events; });
+        if (it != watches_.end())
+        {
+            Callback callback = it->callback;
+            callback();
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,146 @@
+/*
+ * vibe-player
+ * file_identity.cpp
+ */
+
+#include "file_identity.h"
+#include "fnv_hash.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+
+namespace
+{
+    constexpr size_t HASHED_BLOCK_SIZE = 4096;
+
+    // Identity fields of a stat, as kept in TrackMetadata
+    uint64_t FileSize(const struct stat &st)
+    {
+        return static_cast<uint64_t>(st.st_size);
+    }
+
+    int64_t FileMtime(const struct stat &st)
+    {
+        return static_cast<int64_t>(st.st_mtime);
+    }
+}
+
+uint64_t PartialContentHash(int fd, uint64_t size)
+{
+    std::array<char, HASHED_BLOCK_SIZE> block;
+    uint64_t hash = Fnv1aHash(reinterpret_cast<const char *>(&size), sizeof(size));
+
+    ssize_t length = pread(fd, block.data(), block.size(), 0);
+    if (length < 0)
+    {
+        return 0;
+    }
+    hash = Fnv1aHash(block.data(), static_cast<size_t>(length), hash);
+
+    if (size > HASHED_BLOCK_SIZE)
+    {
+        // The last block, or what follows the first in a short file
+        off_t tail = static_cast<off_t>(std::max<uint64_t>(size - HASHED_BLOCK_SIZE, HASHED_BLOCK_SIZE));
+        length = pread(fd, block.data(), block.size(), tail);
+        if (length < 0)
+        {
+            return 0;
+        }
+        hash = Fnv1aHash(block.data(), static_cast<size_t>(length), hash);
+    }
+    // Zero means "not hashed"
+    return hash != 0 ? hash : 1;
+}
+
+FileIdentityIndex::FileIdentityIndex(std::vector<TrackMetadata> tracks)
+{
+    tracks_.reserve(tracks.size());
+    for (auto &track : tracks)
+    {
+        add(std::move(track));
+    }
+}
+
+void FileIdentityIndex::add(TrackMetadata track)
+{
+    size_t index = tracks_.size();
+    by_path_[track.filepath] = index;
+    if (track.inode != 0)
+    {
+        by_inode_[{track.device, track.inode}] = index;
+    }
+    if (track.content_hash != 0)
+    {
+        by_size_.emplace(std::make_pair(track.file_size, track.file_mtime), index);
+    }
+    tracks_.push_back(std::move(track));
+}
+
+void FileIdentityIndex::clear()
+{
+    tracks_.clear();
+    by_path_.clear();
+    by_inode_.clear();
+    by_size_.clear();
+}
+
+bool FileIdentityIndex::empty() const
+{
+    return tracks_.empty();
+}
+
+std::optional<TrackMetadata> FileIdentityIndex::find(const std::string &filepath, const struct stat &st) const
+{
+    auto path = by_path_.find(filepath);
+    if (path != by_path_.end() && tracks_[path->second].file_mtime == FileMtime(st))
+    {
+        // Entries from older caches learn their identity here
+        TrackMetadata track = tracks_[path->second];
+        track.file_size = FileSize(st);
+        track.device = static_cast<uint64_t>(st.st_dev);
+        track.inode = static_cast<uint64_t>(st.st_ino);
+        return track;
+    }
+
+    // A rename keeps the inode; the size and mtime rule out a reused one
+    auto inode = by_inode_.find({static_cast<uint64_t>(st.st_dev), static_cast<uint64_t>(st.st_ino)});
+    if (inode != by_inode_.end())
+    {
+        const TrackMetadata &track = tracks_[inode->second];
+        if (track.file_size == FileSize(st) && track.file_mtime == FileMtime(st))
+        {
+            return MetadataExtractor::relocate(track, filepath);
+        }
+    }
+
+    // A move to another filesystem (or a copy keeping the mtime) does not;
+    // compare contents, hashing the new file only if a size and mtime match
+    auto [first, last] = by_size_.equal_range({FileSize(st), FileMtime(st)});
+    if (first == last)
+    {
+        return std::nullopt;
+    }
+    int fd = open(filepath.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return std::nullopt;
+    }
+    uint64_t hash = PartialContentHash(fd, FileSize(st));
+    close(fd);
+
+    for (auto it = first; it != last; ++it)
+    {
+        const TrackMetadata &track = tracks_[it->second];
+        if (track.content_hash == hash)
+        {
+            TrackMetadata moved = MetadataExtractor::relocate(track, filepath);
+            moved.device = static_cast<uint64_t>(st.st_dev);
+            moved.inode = static_cast<uint64_t>(st.st_ino);
+            return moved;
+        }
+    }
+    return std::nullopt;
+}
@@ -0,0 +1,159 @@
+/*
+ * vibe-player
+ * library_scanner.cpp
+ */
+
+#include "library_scanner.h"
+#include "directory_walker.h"
+
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <map>
+
+#include <spdlog/spdlog.h>
+
+namespace
+{
+    // Extraction is mostly waiting on the disk; past this more threads
+    // only contend
+    constexpr unsigned MAX_SCAN_THREADS = 8;
+
+    // paths (sorted) reordered to take one file from each top-level
+    // directory in turn; files directly in the library form one group
+    std::vector<std::string> InterleaveByDirectory(std::vector<std::string> paths, const std::string &directory)
+    {
+        size_t root = directory.size() + (directory.empty() || directory.back() != '/' ? 1 : 0);
+        std::map<std::string_view, std::vector<size_t>> groups;
+        for (size_t i = 0; i < paths.size(); ++i)
+        {
+            std::string_view path = paths[i];
+            size_t slash = path.find('/', root);
+            groups[slash == std::string_view::npos ? std::string_view() : path.substr(root, slash - root)].push_back(i);
+        }
+
+        std::vector<std::string> order;
+        order.reserve(paths.size());
+        for (size_t round = 0; order.size() < paths.size(); ++round)
+        {
+            for (const auto &[name, members] : groups)
+            {
+                if (round < members.size())
+                {
+                    order.push_back(std::move(paths[members[round]]));
+                }
+            }
+        }
+        return order;
+    }
+}
+
+LibraryScanner::LibraryScanner(const std::string &directory,
+                               std::vector<TrackMetadata> previous,
+                               bool verbose)
+    : directory_(directory), verbose_(verbose), previous_(std::move(previous))
+{
+}
+
+LibraryScanner::~LibraryScanner()
+{
+    stop_ = true;
+    for (auto &thread : threads_)
+    {
+        thread.join();
+    }
+}
+
+size_t LibraryScanner::start()
+{
+    std::vector<std::string> paths = FindAudioFiles(directory_);
+    std::sort(paths.begin(), paths.end());
+    paths_ = InterleaveByDirectory(std::move(paths), directory_);
+    spdlog::debug("Found {} audio files in {}", paths_.size(), directory_);
+
+    started_ = std::chrono::steady_clock::now();
+    unsigned thread_count = std::clamp(std::thread::hardware_concurrency(), 1u, MAX_SCAN_THREADS);
+    thread_count = static_cast<unsigned>(std::min<size_t>(thread_count, paths_.size()));
+    for (unsigned i = 0; i < thread_count; ++i)
+    {
+        threads_.emplace_back(&LibraryScanner::readFiles, this);
+    }
+    return paths_.size();
+}
+
+void LibraryScanner::readFiles()
+{
+    while (!stop_)
+    {
+        size_t i = next_++;
+        if (i >= paths_.size())
+        {
+            break;
+        }
+        const std::string &path = paths_[i];
+
+        std::optional<TrackMetadata> track;
+        struct stat st;
+        if (!previous_.empty() && stat(path.c_str(), &st) == 0)
+        {
+            track = previous_.find(path, st);
+        }
+        if (!track)
+        {
+            track = MetadataExtractor::extract(path, verbose_);
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (track)
+        {
+            tracks_.push_back(std::move(*track));
+        }
+        done_++;
+        changed_.notify_all();
+    }
+}
+
+std::vector<TrackMetadata> LibraryScanner::waitForTracks(size_t min_tracks, std::chrono::milliseconds max_wait)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    auto enough = [&]()
+    {
+        return done_ == paths_.size() || (min_tracks > 0 && tracks_.size() >= min_tracks);
+    };
+
+    if (max_wait.count() > 0)
+    {
+        if (!changed_.wait_until(lock, started_ + max_wait, enough))
+        {
+            // Out of time, but there has to be something to work with
+            changed_.wait(lock, [&]()
+                          { return done_ == paths_.size() || !tracks_.empty(); });
+        }
+    }
+    else
+    {
+        changed_.wait(lock, enough);
+    }
+    return tracks_;
+}
+
+std::vector<TrackMetadata> LibraryScanner::finish()
+{
+    for (auto &thread : threads_)
+    {
+        thread.join();
+    }
+    threads_.clear();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::sort(tracks_.begin(), tracks_.end(),
+              [](const TrackMetadata &a, const TrackMetadata &b)
+              { return a.filepath < b.filepath; });
+    return std::move(tracks_);
+}
+
+bool LibraryScanner::complete() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return done_ == paths_.size();
+}
@@ -0,0 +1,669 @@
+/*
+ * vibe-player
+ * library_watcher.cpp
+ */
+
+#include "library_watcher.h"
+#include "directory_walker.h"
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <vector>
+
+#include <spdlog/spdlog.h>
+
+namespace
+{
+    constexpr uint32_t WATCH_MASK = IN_CREATE | IN_CLOSE_WRITE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO |
+                                    IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR | IN_EXCL_UNLINK;
+
+    // A download or a tagger run touches many files in a row; wait for it
+    // to settle, but not forever when files keep arriving
+    constexpr auto QUIET_PERIOD = std::chrono::seconds(2);
+    constexpr auto MAX_DELAY = std::chrono::seconds(15);
+    // How often directories without a watch are re-read
+    constexpr auto POLL_INTERVAL = std::chrono::seconds(60);
+
+    std::string ChildPrefix(const std::string &directory)
+    {
+        return !directory.empty() && directory.back() == '/' ? directory : directory + '/';
+    }
+
+    // Calls f(iterator) for the entries of map directly inside directory,
+    // skipping over the keys of deeper subdirectories
+    template <typename Map, typename F>
+    void ForEachChild(Map &map, const std::string &directory, F f)
+    {
+        std::string prefix = ChildPrefix(directory);
+        auto it = map.lower_bound(prefix);
+        while (it != map.end() && it->first.compare(0, prefix.size(), prefix) == 0)
+        {
+            size_t slash = it->first.find('/', prefix.size());
+            if (slash != std::string::npos)
+            {
+                // Everything under "dir/sub/" sorts before "dir/sub0"
+                it = map.lower_bound(it->first.substr(0, slash) + char('/' + 1));
+                continue;
+            }
+            auto current = it++;
+            f(current);
+        }
+    }
+}
+
+LibraryWatcher::LibraryWatcher(const std::string &library_path, const std::string &cache_dir)
+    : library_path_(library_path), cache_(cache_dir)
+{
+    while (library_path_.size() > 1 && library_path_.back() == '/')
+    {
+        library_path_.pop_back();
+    }
+}
+
+LibraryWatcher::~LibraryWatcher()
+{
+    if (worker_.joinable())
+    {
+        uint64_t one = 1;
+        ssize_t ignored = write(stop_fd_, &one, sizeof(one));
+        (void)ignored;
+        worker_.join();
+    }
+    if (stop_fd_ >= 0)
+    {
+        close(stop_fd_);
+    }
+    if (compaction_.joinable())
+    {
+        compaction_.join();
+    }
+    if (inotify_fd_ >= 0)
+    {
+        close(inotify_fd_);
+    }
+}
+
+bool LibraryWatcher::start()
+{
+    if (!open())
+    {
+        return false;
+    }
+    scanLibrary();
+    return true;
+}
+
+bool LibraryWatcher::startInBackground(std::function<void()> on_index_changed)
+{
+    if (!open())
+    {
+        return false;
+    }
+    stop_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (stop_fd_ < 0)
+    {
+        spdlog::error("Could not create library watcher stop descriptor: {}", strerror(errno));
+        return false;
+    }
+    on_index_changed_ = std::move(on_index_changed);
+    worker_ = std::thread([this]()
+                          { run(); });
+    return true;
+}
+
+bool LibraryWatcher::open()
+{
+    namespace fs = std::filesystem;
+
+    std::error_code ec;
+    if (!fs::is_directory(library_path_, ec))
+    {
+        spdlog::error("Library is not a directory: {}", library_path_);
+        return false;
+    }
+
+    inotify_fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotify_fd_ < 0)
+    {
+        spdlog::error("Could not initialize inotify: {}", strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+void LibraryWatcher::scanLibrary()
+{
+
+    if (auto cached = cache_.load(library_path_))
+    {
+        for (auto &track : *cached)
+        {
+            std::string key = track.filepath;
+            tracks_.emplace(std::move(key), std::move(track));
+        }
+    }
+    size_t cached_count = tracks_.size();
+
+    // Compare the whole tree against the cache once; from here on only
+    // what inotify reports is looked at again
+    scanDirectory(library_path_);
+
+    // Tracks the scan cannot account for were cached under another spelling
+    // of the library path
+    std::string prefix = ChildPrefix(library_path_);
+    for (auto it = tracks_.begin(); it != tracks_.end();)
+    {
+        if (it->first.compare(0, prefix.size(), prefix) != 0)
+        {
+            it = dropTrack(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+
+    readChangedFiles();
+
+    spdlog::info("Watching {}: {} tracks ({} cached), {} directories, {} polled",
+                 library_path_, tracks_.size(), cached_count, directories_.size(), unwatched_.size());
+    next_poll_ = Clock::now() + POLL_INTERVAL;
+    if (dirty_)
+    {
+        save();
+    }
+}
+
+void LibraryWatcher::run()
+{
+    scanLibrary();
+
+    while (true)
+    {
+        pollfd fds[] = {{stop_fd_, POLLIN, 0}, {inotify_fd_, POLLIN, 0}};
+        if (poll(fds, 2, timeoutMs()) < 0 && errno != EINTR)
+        {
+            spdlog::error("Library watcher stopped: {}", strerror(errno));
+            return;
+        }
+        if (fds[0].revents)
+        {
+            return;
+        }
+        if (fds[1].revents)
+        {
+            handleEvents();
+        }
+        update();
+    }
+}
+
+void LibraryWatcher::indexChanged()
+{
+    index_generation_++;
+    if (on_index_changed_)
+    {
+        on_index_changed_();
+    }
+}
+
+int LibraryWatcher::fd() const
+{
+    return inotify_fd_;
+}
+
+void LibraryWatcher::markPending()
+{
+    auto now = Clock::now();
+    if (pending_files_.empty() && pending_directories_.empty())
+    {
+        first_pending_ = now;
+    }
+    last_event_ = now;
+}
+
+void LibraryWatcher::handleEvents()
+{
+    alignas(struct inotify_event) char buffer[64 * 1024];
+
+    while (true)
+    {
+        ssize_t length = read(inotify_fd_, buffer, sizeof(buffer));
+        if (length <= 0)
+        {
+            if (length < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            break;
+        }
+
+        for (char *p = buffer; p < buffer + length;)
+        {
+            const auto *event = reinterpret_cast<const struct inotify_event *>(p);
+            p += sizeof(struct inotify_event) + event->len;
+
+            if (event->mask & IN_Q_OVERFLOW)
+            {
+                spdlog::warn("inotify queue overflowed, rescanning {}", library_path_);
+                markPending();
+                for (const auto &[directory, wd] : directories_)
+                {
+                    pending_directories_.insert(directory);
+                }
+                continue;
+            }
+
+            auto watch = watches_.find(event->wd);
+            if (watch == watches_.end())
+            {
+                continue;
+            }
+            const std::string &directory = watch->second;
+
+            if (event->mask & IN_IGNORED)
+            {
+                // Deleted, moved away or unmounted; scanning it again tells
+                // which, and watches it again if it is still there
+                auto entry = directories_.find(directory);
+                if (entry != directories_.end() && entry->second == event->wd)
+                {
+                    entry->second = -1;
+                    markPending();
+                    pending_directories_.insert(directory);
+                }
+                watches_.erase(watch);
+                continue;
+            }
+
+            if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF))
+            {
+                markPending();
+                pending_directories_.insert(directory);
+                continue;
+            }
+
+            if (event->len == 0)
+            {
+                continue;
+            }
+            std::string_view name(event->name);
+            if (event->mask & IN_ISDIR)
+            {
+                // The parent's listing shows what became of the subdirectory
+                markPending();
+                pending_directories_.insert(directory);
+            }
+            else if (HasAudioExtension(name))
+            {
+                markPending();
+                pending_files_.insert(ChildPrefix(directory).append(name));
+            }
+        }
+    }
+}
+
+int LibraryWatcher::timeoutMs() const
+{
+    bool pending = !pending_files_.empty() || !pending_directories_.empty();
+    if (!pending && unwatched_.empty())
+    {
+        return -1;
+    }
+
+    auto deadline = Clock::time_point::max();
+    if (pending)
+    {
+        deadline = std::min(last_event_ + QUIET_PERIOD, first_pending_ + MAX_DELAY);
+    }
+    if (!unwatched_.empty())
+    {
+        deadline = std::min(deadline, next_poll_);
+    }
+
+    auto remaining = std::chrono::ceil<std::chrono::milliseconds>(deadline - Clock::now());
+    return static_cast<int>(std::max<int64_t>(remaining.count(), 0));
+}
+
+bool LibraryWatcher::update()
+{
+    auto now = Clock::now();
+    bool pending = !pending_files_.empty() || !pending_directories_.empty();
+
+    if (pending && (now >= last_event_ + QUIET_PERIOD || now >= first_pending_ + MAX_DELAY))
+    {
+        auto directories = std::move(pending_directories_);
+        auto files = std::move(pending_files_);
+        pending_directories_.clear();
+        pending_files_.clear();
+
+        for (const auto &directory : directories)
+        {
+            if (directories_.count(directory))
+            {
+                scanDirectory(directory);
+            }
+        }
+        for (const auto &filepath : files)
+        {
+            // Files of directories removed meanwhile went with them
+            std::string directory = filepath.substr(0, filepath.rfind('/'));
+            if (directories_.count(directory.empty() ? "/" : directory))
+            {
+                checkFile(filepath);
+            }
+        }
+    }
+
+    if (!unwatched_.empty() && now >= next_poll_)
+    {
+        pollUnwatched();
+        next_poll_ = now + POLL_INTERVAL;
+    }
+
+    readChangedFiles();
+    return dirty_ && save();
+}
+
+uint64_t LibraryWatcher::indexGeneration() const
+{
+    return index_generation_;
+}
+
+size_t LibraryWatcher::size() const
+{
+    return tracks_.size();
+}
+
+void LibraryWatcher::watchDirectory(const std::string &directory)
+{
+    int wd = inotify_add_watch(inotify_fd_, directory.c_str(), WATCH_MASK);
+    if (wd < 0)
+    {
+        if ((errno == ENOSPC || errno == ENOMEM) && !watch_limit_warned_)
+        {
+            spdlog::warn("inotify watch limit reached at {}; directories past it are re-read every {}s "
+                         "(raise fs.inotify.max_user_watches to watch them all)",
+                         directory, POLL_INTERVAL.count());
+            watch_limit_warned_ = true;
+        }
+        directories_[directory] = -1;
+        unwatched_.insert(directory);
+        return;
+    }
+
+    // A directory moved within the library keeps its watch descriptor
+    directories_[directory] = wd;
+    watches_[wd] = directory;
+    unwatched_.erase(directory);
+}
+
+void LibraryWatcher::scanDirectory(const std::string &directory)
+{
+    namespace fs = std::filesystem;
+
+    std::vector<std::string> stack = {directory};
+    while (!stack.empty())
+    {
+        std::string current = std::move(stack.back());
+        stack.pop_back();
+
+        // Watch before listing, so nothing created in between is missed
+        auto known = directories_.find(current);
+        if (known == directories_.end() || known->second < 0)
+        {
+            watchDirectory(current);
+        }
+
+        std::error_code ec;
+        fs::directory_iterator it(current, ec);
+        if (ec)
+        {
+            if (current == library_path_)
+            {
+                // An unmounted library keeps its cache; the root is polled
+                // until it comes back
+                spdlog::warn("Cannot read library {}: {}", library_path_, ec.message());
+                unwatched_.insert(current);
+            }
+            else
+            {
+                removeDirectory(current);
+            }
+            continue;
+        }
+
+        std::set<std::string> subdirectories;
+        std::set<std::string> files;
+        std::string prefix = ChildPrefix(current);
+        for (const auto &entry : it)
+        {
+            std::string path = prefix + entry.path().filename().string();
+            // Symlinked directories are not followed, as in FindAudioFiles
+            if (entry.is_directory(ec) && !entry.is_symlink(ec))
+            {
+                if (!directories_.count(path))
+                {
+                    stack.push_back(path);
+                }
+                subdirectories.insert(std::move(path));
+            }
+            else if (HasAudioExtension(path))
+            {
+                checkFile(path);
+                files.insert(std::move(path));
+            }
+        }
+
+        ForEachChild(tracks_, current, [&](auto track)
+                     {
+            if (!files.count(track->first))
+            {
+                dropTrack(track);
+            } });
+        std::vector<std::string> removed;
+        ForEachChild(directories_, current, [&](auto child)
+                     {
+            if (!subdirectories.count(child->first))
+            {
+                removed.push_back(child->first);
+            } });
+        for (const auto &child : removed)
+        {
+            removeDirectory(child);
+        }
+    }
+}
+
+void LibraryWatcher::removeDirectory(const std::string &directory)
+{
+    std::string prefix = ChildPrefix(directory);
+    auto in_subtree = [&](const std::string &path)
+    {
+        return path.compare(0, prefix.size(), prefix) == 0;
+    };
+
+    auto track = tracks_.lower_bound(prefix);
+    while (track != tracks_.end() && in_subtree(track->first))
+    {
+        track = dropTrack(track);
+    }
+
+    auto forget = [&](std::map<std::string, int>::iterator entry)
+    {
+        // The descriptor may already belong to where the directory moved
+        auto watch = watches_.find(entry->second);
+        if (watch != watches_.end() && watch->second == entry->first)
+        {
+            inotify_rm_watch(inotify_fd_, entry->second);
+            watches_.erase(watch);
+        }
+        unwatched_.erase(entry->first);
+        return directories_.erase(entry);
+    };
+
+    // Siblings such as "Album (Deluxe)" sort between "Album" and
+    // "Album/CD1", so the directory itself is dropped on its own
+    auto entry = directories_.find(directory);
+    if (entry != directories_.end())
+    {
+        forget(entry);
+    }
+    entry = directories_.lower_bound(prefix);
+    while (entry != directories_.end() && in_subtree(entry->first))
+    {
+        entry = forget(entry);
+    }
+}
+
+void LibraryWatcher::checkFile(const std::string &filepath)
+{
+    auto it = tracks_.find(filepath);
+    struct stat st;
+    if (stat(filepath.c_str(), &st) != 0 || !S_ISREG(st.st_mode))
+    {
+        if (it != tracks_.end())
+        {
+            dropTrack(it);
+        }
+        return;
+    }
+
+    if (it == tracks_.end() || it->second.file_mtime != static_cast<int64_t>(st.st_mtime))
+    {
+        changed_files_.push_back(filepath);
+    }
+}
+
+std::map<std::string, TrackMetadata>::iterator LibraryWatcher::dropTrack(std::map<std::string, TrackMetadata>::iterator track)
+{
+    journal_puts_.erase(track->first);
+    journal_deletes_.insert(track->first);
+
+    // Kept until the end of the update in case the file turns up elsewhere
+    removed_.add(std::move(track->second));
+    dirty_ = true;
+    return tracks_.erase(track);
+}
+
+void LibraryWatcher::readChangedFiles()
+{
+    for (const auto &filepath : changed_files_)
+    {
+        struct stat st;
+        if (stat(filepath.c_str(), &st) != 0)
+        {
+            continue;
+        }
+
+        std::optional<TrackMetadata> track = removed_.find(filepath, st);
+        if (track)
+        {
+            spdlog::debug("Moved {}", filepath);
+        }
+        else
+        {
+            track = MetadataExtractor::extract(filepath);
+            spdlog::debug("Read {}", filepath);
+        }
+
+        if (track)
+        {
+            tracks_.insert_or_assign(filepath, std::move(*track));
+            journal_deletes_.erase(filepath);
+            journal_puts_.insert(filepath);
+            dirty_ = true;
+        }
+        else if (auto it = tracks_.find(filepath); it != tracks_.end())
+        {
+            dropTrack(it);
+        }
+    }
+    changed_files_.clear();
+    removed_.clear();
+}
+
+void LibraryWatcher::pollUnwatched()
+{
+    // Watches may have been freed since, or the limit raised
+    std::vector<std::string> directories(unwatched_.begin(), unwatched_.end());
+    for (const auto &directory : directories)
+    {
+        if (directories_.count(directory))
+        {
+            scanDirectory(directory);
+        }
+    }
+}
+
+std::vector<TrackMetadata> LibraryWatcher::snapshot() const
+{
+    std::vector<TrackMetadata> tracks;
+    tracks.reserve(tracks_.size());
+    for (const auto &[filepath, track] : tracks_)
+    {
+        tracks.push_back(track);
+    }
+    return tracks;
+}
+
+bool LibraryWatcher::save()
+{
+    std::vector<TrackMetadata> changed;
+    for (const auto &filepath : journal_puts_)
+    {
+        auto track = tracks_.find(filepath);
+        if (track != tracks_.end())
+        {
+            changed.push_back(track->second);
+        }
+    }
+    std::vector<std::string> removed(journal_deletes_.begin(), journal_deletes_.end());
+    journal_puts_.clear();
+    journal_deletes_.clear();
+    dirty_ = false;
+
+    // Changes go to the journal; only a library without a saved cache
+    // gets one written whole here
+    if (!cache_.update(library_path_, changed, removed))
+    {
+        if (!cache_.save(library_path_, snapshot()))
+        {
+            spdlog::warn("Failed to save metadata cache for {}", library_path_);
+            return false;
+        }
+        indexChanged();
+    }
+    spdlog::info("Library {} updated: {} tracks ({} changed, {} removed)",
+                 library_path_, tracks_.size(), changed.size(), removed.size());
+
+    // Fold a grown journal back into the cache without holding up the
+    // owner's loop; changes journaled meanwhile are carried over
+    if (!compacting_ && cache_.needsCompaction(library_path_))
+    {
+        if (compaction_.joinable())
+        {
+            compaction_.join();
+        }
+        compacting_ = true;
+        uint64_t journal_offset = cache_.journalSize(library_path_);
+        compaction_ = std::thread([this, journal_offset, tracks = snapshot()]()
+                                  {
+            if (cache_.compact(library_path_, tracks, journal_offset))
+            {
+                spdlog::info("Compacted metadata cache for {}", library_path_);
+                indexChanged();
+            }
+            compacting_ = false; });
+    }
+    return true;
+}
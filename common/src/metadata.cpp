@@ -1,6 +1,11 @@
 #include "metadata.h"
+#include "directory_walker.h"
+#include "file_identity.h"
+#include "tag_reader.h"
+#include "utf8.h"
 
 #include <fileref.h>
+#include <tfilestream.h>
 #include <tag.h>
 #include <tpropertymap.h>
 #include <spdlog/spdlog.h>
@@ -8,119 +13,12 @@
 #include <algorithm>
 #include <filesystem>
 #include <iostream>
+#include <fcntl.h>
 #include <sys/stat.h>
+#include <unistd.h>
 
 using json = nlohmann::json;
 
-// Sanitize string to ensure valid UTF-8
-// Removes invalid UTF-8 sequences and overlong encodings
-static std::string sanitizeUtf8(const std::string &input)
-{
-    std::string result;
-    const unsigned char *bytes = reinterpret_cast<const unsigned char *>(input.data());
-    size_t len = input.size();
-
-    for (size_t i = 0; i < len;)
-    {
-        unsigned char c = bytes[i];
-
-        // ASCII (single byte: 0x00-0x7F)
-        if (c <= 0x7F)
-        {
-            result += static_cast<char>(c);
-            i++;
-        }
-        // 2-byte sequence (0xC2-0xDF)
-        // Note: 0xC0 and 0xC1 are invalid (overlong encodings)
-        else if (c >= 0xC2 && c <= 0xDF)
-        {
-            if (i + 1 < len && (bytes[i + 1] & 0xC0) == 0x80)
-            {
-                result += static_cast<char>(bytes[i]);
-                result += static_cast<char>(bytes[i + 1]);
-                i += 2;
-            }
-            else
-            {
-                // Invalid sequence, skip
-                i++;
-            }
-        }
-        // 3-byte sequence (0xE0-0xEF)
-        else if (c >= 0xE0 && c <= 0xEF)
-        {
-            if (i + 2 < len &&
-                (bytes[i + 1] & 0xC0) == 0x80 &&
-                (bytes[i + 2] & 0xC0) == 0x80)
-            {
-
-                // Check for overlong encodings
-                if (c == 0xE0 && bytes[i + 1] < 0xA0)
-                {
-                    // Overlong encoding, skip
-                    i++;
-                }
-                else
-                {
-                    result += static_cast<char>(bytes[i]);
-                    result += static_cast<char>(bytes[i + 1]);
-                    result += static_cast<char>(bytes[i + 2]);
-                    i += 3;
-                }
-            }
-            else
-            {
-                // Invalid sequence, skip
-                i++;
-            }
-        }
-        // 4-byte sequence (0xF0-0xF4)
-        // Note: 0xF5-0xFF are invalid
-        else if (c >= 0xF0 && c <= 0xF4)
-        {
-            if (i + 3 < len &&
-                (bytes[i + 1] & 0xC0) == 0x80 &&
-                (bytes[i + 2] & 0xC0) == 0x80 &&
-                (bytes[i + 3] & 0xC0) == 0x80)
-            {
-
-                // Check for overlong encodings and out-of-range values
-                if (c == 0xF0 && bytes[i + 1] < 0x90)
-                {
-                    // Overlong encoding, skip
-                    i++;
-                }
-                else if (c == 0xF4 && bytes[i + 1] > 0x8F)
-                {
-                    // Out of valid Unicode range, skip
-                    i++;
-                }
-                else
-                {
-                    result += static_cast<char>(bytes[i]);
-                    result += static_cast<char>(bytes[i + 1]);
-                    result += static_cast<char>(bytes[i + 2]);
-                    result += static_cast<char>(bytes[i + 3]);
-                    i += 4;
-                }
-            }
-            else
-            {
-                // Invalid sequence, skip
-                i++;
-            }
-        }
-        // Invalid UTF-8 start byte (0x80-0xBF, 0xC0-0xC1, 0xF5-0xFF)
-        else
-        {
-            // Skip invalid byte
-            i++;
-        }
-    }
-
-    return result;
-}
-
 nlohmann::json TrackMetadata::toJson() const
 {
     json j;
@@ -174,6 +72,13 @@ nlohmann::json TrackMetadata::toJson() const
 
     j["duration_ms"] = duration_ms;
     j["file_mtime"] = file_mtime;
+    if (inode != 0)
+    {
+        j["file_size"] = file_size;
+        j["device"] = device;
+        j["inode"] = inode;
+        j["content_hash"] = content_hash;
+    }
     return j;
 }
 
@@ -209,6 +114,12 @@ std::optional<TrackMetadata> TrackMetadata::fromJson(const nlohmann::json &j)
         metadata.duration_ms = j.at("duration_ms").get<int64_t>();
         metadata.file_mtime = j.at("file_mtime").get<int64_t>();
 
+        // Caches written before file identities were kept lack these
+        metadata.file_size = j.value("file_size", uint64_t(0));
+        metadata.device = j.value("device", uint64_t(0));
+        metadata.inode = j.value("inode", uint64_t(0));
+        metadata.content_hash = j.value("content_hash", uint64_t(0));
+
         return metadata;
     }
     catch (const std::exception &e)
@@ -218,90 +129,146 @@ std::optional<TrackMetadata> TrackMetadata::fromJson(const nlohmann::json &j)
     }
 }
 
-std::optional<TrackMetadata> MetadataExtractor::extract(const std::string &filepath, bool verbose)
+// Title used for files without one: the filename without its extension
+static std::string titleFromFilename(const std::string &filename)
 {
-    namespace fs = std::filesystem;
+    size_t dot = filename.rfind('.');
+    return dot == std::string::npos || dot == 0 ? filename : filename.substr(0, dot);
+}
 
-    // Check if file exists
-    if (!fs::exists(filepath))
+// Parses the file with TagLib, through a copy of the descriptor since
+// the stream closes what it is given
+static std::optional<AudioTags> readTagLibTags(int fd)
+{
+    int stream_fd = dup(fd);
+    if (stream_fd < 0)
     {
         return std::nullopt;
     }
-
-    // Sanitize filepath early to ensure all derived strings are clean
-    std::string clean_filepath = sanitizeUtf8(filepath);
-
-    TagLib::FileRef file(filepath.c_str());
-
-    TrackMetadata metadata;
-    metadata.filepath = clean_filepath;
-    metadata.filename = sanitizeUtf8(fs::path(clean_filepath).filename().string());
-    metadata.file_mtime = getFileModificationTime(filepath);
-
+    TagLib::FileStream stream(stream_fd, true);
+    TagLib::FileRef file(&stream);
     if (file.isNull())
     {
-        // File couldn't be opened, but use filename as fallback
-        metadata.title = sanitizeUtf8(fs::path(clean_filepath).stem().string());
-        metadata.duration_ms = 0;
         return std::nullopt;
     }
 
-    // Extract tags
+    AudioTags tags;
     if (file.tag())
     {
         TagLib::Tag *tag = file.tag();
 
-        spdlog::info("Extracting metadata for file: {}", clean_filepath);
-
-        auto titleStr = tag->title().to8Bit();
+        auto titleStr = tag->title().to8Bit(true);
         if (!titleStr.empty())
         {
-            spdlog::info("Title: {}", titleStr);
-            metadata.title = sanitizeUtf8(titleStr);
+            tags.title = std::move(titleStr);
         }
 
-        auto artistStr = tag->artist().to8Bit();
+        auto artistStr = tag->artist().to8Bit(true);
         if (!artistStr.empty())
         {
-            spdlog::info("Artist: {}", artistStr);
-            metadata.artist = sanitizeUtf8(artistStr);
+            tags.artist = std::move(artistStr);
         }
 
-        auto albumStr = tag->album().to8Bit();
+        auto albumStr = tag->album().to8Bit(true);
         if (!albumStr.empty())
         {
-            spdlog::info("Album: {}", albumStr);
-            metadata.album = sanitizeUtf8(albumStr);
+            tags.album = std::move(albumStr);
         }
 
-        auto genreStr = tag->genre().to8Bit();
+        auto genreStr = tag->genre().to8Bit(true);
         if (!genreStr.empty())
         {
-            metadata.genre = sanitizeUtf8(genreStr);
+            tags.genre = std::move(genreStr);
         }
 
         if (tag->year() > 0)
         {
-            metadata.year = tag->year();
+            tags.year = tag->year();
         }
     }
 
-    // Fallback: if no title found, use filename
-    if (!metadata.title)
+    // Get duration from audio properties
+    if (file.audioProperties())
     {
-        metadata.title = sanitizeUtf8(fs::path(clean_filepath).stem().string());
+        tags.duration_ms = file.audioProperties()->lengthInMilliseconds();
     }
 
-    // Get duration from audio properties
-    if (file.audioProperties())
+    return tags;
+}
+
+std::optional<TrackMetadata> MetadataExtractor::extract(const std::string &filepath, bool verbose)
+{
+    // One open and fstat serve the existence check, the mtime and both
+    // tag readers
+    int fd = open(filepath.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return std::nullopt;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode))
     {
-        metadata.duration_ms = file.audioProperties()->lengthInMilliseconds();
+        close(fd);
+        return std::nullopt;
     }
-    else
+
+    // Most files are read from their metadata blocks alone; TagLib parses
+    // the rest
+    std::optional<AudioTags> tags = ReadTagsFast(fd, static_cast<uint64_t>(st.st_size));
+    if (!tags)
     {
-        metadata.duration_ms = 0;
+        tags = readTagLibTags(fd);
+    }
+    uint64_t content_hash = tags ? PartialContentHash(fd, static_cast<uint64_t>(st.st_size)) : 0;
+    close(fd);
+    if (!tags)
+    {
+        return std::nullopt;
     }
 
+    // Sanitize filepath early to ensure all derived strings are clean.
+    // Splitting valid UTF-8 at '/' and '.' keeps it valid.
+    TrackMetadata metadata;
+    metadata.filepath = SanitizeUtf8(filepath);
+    size_t slash = metadata.filepath.rfind('/');
+    metadata.filename = slash == std::string::npos ? metadata.filepath : metadata.filepath.substr(slash + 1);
+    metadata.file_mtime = static_cast<int64_t>(st.st_mtime);
+    metadata.file_size = static_cast<uint64_t>(st.st_size);
+    metadata.device = static_cast<uint64_t>(st.st_dev);
+    metadata.inode = static_cast<uint64_t>(st.st_ino);
+    metadata.content_hash = content_hash;
+
+    spdlog::trace("Extracting metadata for file: {}", metadata.filepath);
+
+    if (tags->title)
+    {
+        spdlog::trace("Title: {}", *tags->title);
+        metadata.title = SanitizeUtf8(std::move(*tags->title));
+    }
+    if (tags->artist)
+    {
+        spdlog::trace("Artist: {}", *tags->artist);
+        metadata.artist = SanitizeUtf8(std::move(*tags->artist));
+    }
+    if (tags->album)
+    {
+        spdlog::trace("Album: {}", *tags->album);
+        metadata.album = SanitizeUtf8(std::move(*tags->album));
+    }
+    if (tags->genre)
+    {
+        metadata.genre = SanitizeUtf8(std::move(*tags->genre));
+    }
+    metadata.year = tags->year;
+
+    // Fallback: if no title found, use filename without its extension
+    if (!metadata.title)
+    {
+        metadata.title = titleFromFilename(metadata.filename);
+    }
+
+    metadata.duration_ms = tags->duration_ms;
+
     return metadata;
 }
 
@@ -312,76 +279,48 @@ std::vector<TrackMetadata> MetadataExtractor::extractFromDirectory(
 {
 
     std::vector<TrackMetadata> results;
-    const std::vector<std::string> valid_extensions = {".wav", ".mp3", ".flac", ".ogg"};
 
     namespace fs = std::filesystem;
 
-    try
+    std::error_code ec;
+    if (!fs::is_directory(directory_path, ec))
     {
-        if (!fs::exists(directory_path) || !fs::is_directory(directory_path))
-        {
-            std::cerr << "Error: Directory does not exist: " << directory_path << std::endl;
-            return results;
-        }
+        std::cerr << "Error: Directory does not exist: " << directory_path << std::endl;
+        return results;
+    }
 
-        if (recursive)
-        {
-            for (const auto &entry : fs::recursive_directory_iterator(directory_path))
-            {
-                if (entry.is_regular_file())
-                {
-                    std::string ext = entry.path().extension().string();
-                    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
-
-                    if (std::find(valid_extensions.begin(), valid_extensions.end(), ext) != valid_extensions.end())
-                    {
-
-                        auto metadata = extract(entry.path().string(), verbose);
-                        if (metadata)
-                        {
-                            results.push_back(*metadata);
-                        }
-                    }
-                }
-            }
-        }
-        else
-        {
-            for (const auto &entry : fs::directory_iterator(directory_path))
-            {
-                if (entry.is_regular_file())
-                {
-                    std::string ext = entry.path().extension().string();
-                    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
-
-                    if (std::find(valid_extensions.begin(), valid_extensions.end(), ext) != valid_extensions.end())
-                    {
-
-                        auto metadata = extract(entry.path().string());
-                        if (metadata)
-                        {
-                            results.push_back(*metadata);
-                        }
-                    }
-                }
-            }
-        }
+    // Sorting the paths first leaves the results sorted by filepath
+    std::vector<std::string> paths = FindAudioFiles(directory_path, recursive);
+    std::sort(paths.begin(), paths.end());
+    spdlog::debug("Found {} audio files in {}", paths.size(), directory_path);
 
-        // Sort by filepath
-        std::sort(results.begin(), results.end(),
-                  [](const TrackMetadata &a, const TrackMetadata &b)
-                  {
-                      return a.filepath < b.filepath;
-                  });
-    }
-    catch (const fs::filesystem_error &e)
+    results.reserve(paths.size());
+    for (const auto &path : paths)
     {
-        std::cerr << "Error scanning directory: " << e.what() << std::endl;
+        auto metadata = extract(path, verbose);
+        if (metadata)
+        {
+            results.push_back(std::move(*metadata));
+        }
     }
 
     return results;
 }
 
+TrackMetadata MetadataExtractor::relocate(TrackMetadata track, const std::string &filepath)
+{
+    bool title_from_filename = track.title && *track.title == titleFromFilename(track.filename);
+
+    track.filepath = SanitizeUtf8(filepath);
+    size_t slash = track.filepath.rfind('/');
+    track.filename = slash == std::string::npos ? track.filepath : track.filepath.substr(slash + 1);
+    if (title_from_filename)
+    {
+        track.title = titleFromFilename(track.filename);
+    }
+    return track;
+}
+
 int64_t MetadataExtractor::getFileModificationTime(const std::string &filepath)
 {
     struct stat st;
@@ -1,10 +1,21 @@
 #include "metadata_cache.h"
+#include "metadata_index.h"
+#include "fnv_hash.h"
 
+#include <algorithm>
+#include <atomic>
 #include <fstream>
 #include <iostream>
 #include <filesystem>
 #include <sstream>
 #include <iomanip>
+#include <iterator>
+#include <map>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <nlohmann/json.hpp>
 
 using json = nlohmann::json;
@@ -15,14 +26,322 @@ MetadataCache::MetadataCache(const std::string &cache_dir)
     ensureCacheDirectoryExists();
 }
 
+namespace
+{
+    // Version 3 caches are a manifest of shards, one per top-level
+    // directory; versions 1 and 2 held every track in the one file
+    constexpr int CACHE_VERSION = 3;
+    // A cache shipped with the library itself, for hosts without their own
+    constexpr const char *LIBRARY_CACHE_NAME = ".vibe-player-cache.json";
+    // The journal is folded into the cache once it is this large, or a
+    // quarter of the cache's size if that is more
+    constexpr uint64_t MIN_COMPACTION_SIZE = 256 * 1024;
+    // Shards are parsed and written this many at a time at most
+    constexpr unsigned MAX_SHARD_THREADS = 8;
+
+    std::string HexKey(uint64_t hash)
+    {
+        std::ostringstream oss;
+        oss << std::hex << std::setw(16) << std::setfill('0') << hash;
+        return oss.str();
+    }
+
+    // Prefix of the paths of the files in a library, as the scanner
+    // builds them from library_path
+    std::string LibraryPrefix(const std::string &library_path)
+    {
+        std::string prefix = library_path;
+        while (prefix.size() > 1 && prefix.back() == '/')
+        {
+            prefix.pop_back();
+        }
+        if (prefix.empty() || prefix.back() != '/')
+        {
+            prefix += '/';
+        }
+        return prefix;
+    }
+
+    void RebasePath(TrackMetadata &track, const std::string &prefix)
+    {
+        if (!track.filepath.starts_with('/'))
+        {
+            track.filepath.insert(0, prefix);
+        }
+    }
+
+    std::string RelativePath(const std::string &filepath, const std::string &prefix)
+    {
+        return filepath.starts_with(prefix) ? filepath.substr(prefix.size()) : filepath;
+    }
+
+    // Shard of a track: the top-level directory (usually the artist) of its
+    // path relative to the library. Files directly in the library, and
+    // any outside it, go in the shard named "".
+    std::string ShardName(const std::string &relative_path)
+    {
+        size_t slash = relative_path.find('/');
+        return slash == std::string::npos ? std::string() : relative_path.substr(0, slash);
+    }
+
+    // Shards of a cache file live in a directory beside it, named after it:
+    // metadata_<hash>.shards/ or .vibe-player-cache.shards/
+    std::filesystem::path ShardDirectory(const std::string &cache_path)
+    {
+        return std::filesystem::path(cache_path).replace_extension(".shards");
+    }
+
+    // A shard file is never written over: each version of a shard gets a
+    // name of its own, from its fingerprint, so a reader holding an older
+    // manifest still finds the shards that manifest names
+    std::string ShardFileName(const std::string &shard, uint64_t fingerprint)
+    {
+        return HexKey(Fnv1aHash(shard)) + "-" + HexKey(fingerprint) + ".json";
+    }
+
+    // A shard's MetadataIndex, kept beside it in the cache's own .shards
+    // directory and named the same way
+    std::string ShardIndexName(const std::string &shard, uint64_t fingerprint)
+    {
+        return HexKey(Fnv1aHash(shard)) + "-" + HexKey(fingerprint) + ".idx";
+    }
+
+    // Tracks by shard, with paths relative to the library at prefix
+    std::map<std::string, std::vector<const TrackMetadata *>> GroupShards(const std::vector<TrackMetadata> &tracks,
+                                                                          const std::string &prefix)
+    {
+        std::map<std::string, std::vector<const TrackMetadata *>> shards;
+        for (const auto &track : tracks)
+        {
+            shards[ShardName(RelativePath(track.filepath, prefix))].push_back(&track);
+        }
+        return shards;
+    }
+
+    // Hash of everything a cache entry holds, so a save can tell which
+    // shards would come out the same without serializing them
+    uint64_t TrackFingerprint(const TrackMetadata &track, uint64_t hash)
+    {
+        auto add_string = [&](const std::optional<std::string> &value)
+        {
+            // The length keeps "ab","c" apart from "a","bc", and the
+            // marker a missing value from an empty one
+            uint64_t length = value ? value->size() : UINT64_MAX;
+            hash = Fnv1aHash(reinterpret_cast<const char *>(&length), sizeof(length), hash);
+            if (value)
+            {
+                hash = Fnv1aHash(*value, hash);
+            }
+        };
+        auto add_number = [&](auto value)
+        {
+            hash = Fnv1aHash(reinterpret_cast<const char *>(&value), sizeof(value), hash);
+        };
+
+        add_string(track.filepath);
+        add_string(track.filename);
+        add_string(track.title);
+        add_string(track.artist);
+        add_string(track.album);
+        add_string(track.genre);
+        add_number(track.year ? static_cast<int64_t>(*track.year) : INT64_MIN);
+        add_number(track.duration_ms);
+        add_number(track.file_mtime);
+        add_number(track.file_size);
+        add_number(track.device);
+        add_number(track.inode);
+        add_number(track.content_hash);
+        return hash;
+    }
+
+    uint64_t ShardFingerprint(const std::vector<const TrackMetadata *> &tracks)
+    {
+        uint64_t fingerprint = FNV_OFFSET_BASIS;
+        for (const TrackMetadata *track : tracks)
+        {
+            fingerprint = TrackFingerprint(*track, fingerprint);
+        }
+        return fingerprint;
+    }
+
+    // Call function(i) for i in [0, count) on up to MAX_SHARD_THREADS
+    // threads, this one included. function must not throw.
+    template <typename Function>
+    void ParallelFor(size_t count, Function function)
+    {
+        unsigned thread_count = std::clamp(std::thread::hardware_concurrency(), 1u, MAX_SHARD_THREADS);
+        thread_count = static_cast<unsigned>(std::min<size_t>(thread_count, count));
+
+        std::atomic<size_t> next{0};
+        auto work = [&]()
+        {
+            for (size_t i = next++; i < count; i = next++)
+            {
+                function(i);
+            }
+        };
+        std::vector<std::thread> threads;
+        for (unsigned i = 1; i < thread_count; ++i)
+        {
+            threads.emplace_back(work);
+        }
+        work();
+        for (auto &thread : threads)
+        {
+            thread.join();
+        }
+    }
+
+    std::optional<std::vector<TrackMetadata>> ReadShard(const std::filesystem::path &path, const std::string &prefix)
+    {
+        try
+        {
+            std::ifstream file(path);
+            if (!file.is_open())
+            {
+                return std::nullopt;
+            }
+            json shard_json = json::parse(file);
+
+            std::vector<TrackMetadata> tracks;
+            const json &tracks_json = shard_json.at("tracks");
+            tracks.reserve(tracks_json.size());
+            for (const auto &track_json : tracks_json)
+            {
+                auto track = TrackMetadata::fromJson(track_json);
+                if (track)
+                {
+                    RebasePath(*track, prefix);
+                    tracks.push_back(std::move(*track));
+                }
+            }
+            return tracks;
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << "Warning: Could not read cache shard " << path.string() << ": " << e.what() << std::endl;
+            return std::nullopt;
+        }
+    }
+
+    bool WriteShard(const std::filesystem::path &path,
+                    const std::string &shard,
+                    const std::vector<const TrackMetadata *> &tracks,
+                    const std::string &prefix)
+    {
+        try
+        {
+            json tracks_json = json::array();
+            for (const TrackMetadata *track : tracks)
+            {
+                json track_json = track->toJson();
+                track_json["filepath"] = RelativePath(track->filepath, prefix);
+                tracks_json.push_back(std::move(track_json));
+            }
+            json shard_json = {{"version", CACHE_VERSION}, {"directory", shard}, {"tracks", std::move(tracks_json)}};
+
+            std::string temp_path = path.string() + ".tmp" + std::to_string(getpid());
+            {
+                std::ofstream file(temp_path);
+                file << shard_json.dump(2);
+                if (!file)
+                {
+                    std::cerr << "Error: Could not write cache shard: " << path.string() << std::endl;
+                    return false;
+                }
+            }
+            std::filesystem::rename(temp_path, path);
+            return true;
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << "Error writing cache shard " << path.string() << ": " << e.what() << std::endl;
+            return false;
+        }
+    }
+
+    // Identifies one version of a cache file. A journal applies only to
+    // the version it was started on; replacing the file changes the inode.
+    std::optional<json> FileVersion(const std::string &path)
+    {
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0)
+        {
+            return std::nullopt;
+        }
+        int64_t mtime_ns = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+        return json{{"inode", static_cast<uint64_t>(st.st_ino)},
+                    {"size", static_cast<uint64_t>(st.st_size)},
+                    {"mtime_ns", mtime_ns}};
+    }
+
+    // Version of the cache a journal was started on, from its first line
+    std::optional<json> JournalBase(std::istream &journal)
+    {
+        std::string line;
+        if (!std::getline(journal, line))
+        {
+            return std::nullopt;
+        }
+        json header = json::parse(line, nullptr, false);
+        if (header.is_discarded() || !header.contains("cache"))
+        {
+            return std::nullopt;
+        }
+        return header["cache"];
+    }
+
+    // Files a cache file names: its shards and their indexes. Empty for a
+    // cache without shards.
+    std::unordered_set<std::string> ShardFiles(const std::string &cache_path)
+    {
+        std::unordered_set<std::string> files;
+        std::ifstream file(cache_path);
+        json cache_json = json::parse(file, nullptr, false);
+        if (cache_json.is_discarded() || cache_json.value("version", 0) != CACHE_VERSION ||
+            !cache_json.contains("shards"))
+        {
+            return files;
+        }
+        for (const auto &shard_json : cache_json["shards"])
+        {
+            for (const char *key : {"file", "index"})
+            {
+                std::string name = shard_json.value(key, "");
+                if (!name.empty() && name.find('/') == std::string::npos)
+                {
+                    files.insert(std::move(name));
+                }
+            }
+        }
+        return files;
+    }
+
+    std::string JournalHeader(const json &cache_version)
+    {
+        return json{{"journal", 1}, {"cache", cache_version}}.dump() + "\n";
+    }
+}
+
 std::string MetadataCache::hashLibraryPath(const std::string &library_path) const
 {
-    // Simple hash function for library path (for cache filename)
+    // FNV-1a rather than std::hash, which differs between standard
+    // libraries and builds; "/music/" and "/music" are the same library
+    std::string path = std::filesystem::absolute(library_path).lexically_normal().string();
+    while (path.size() > 1 && path.back() == '/')
+    {
+        path.pop_back();
+    }
+    return HexKey(Fnv1aHash(path));
+}
+
+std::string MetadataCache::getLegacyCachePath(const std::string &library_path) const
+{
     std::hash<std::string> hasher;
     size_t hash = hasher(std::filesystem::absolute(library_path).string());
     std::ostringstream oss;
     oss << std::hex << hash;
-    return oss.str();
+    return cache_dir_ + "/metadata_" + oss.str() + ".json";
 }
 
 std::string MetadataCache::getCachePath(const std::string &library_path) const
@@ -30,6 +349,16 @@ std::string MetadataCache::getCachePath(const std::string &library_path) const
     return cache_dir_ + "/metadata_" + hashLibraryPath(library_path) + ".json";
 }
 
+std::string MetadataCache::getIndexPath(const std::string &library_path) const
+{
+    return cache_dir_ + "/metadata_" + hashLibraryPath(library_path) + ".idx";
+}
+
+std::string MetadataCache::getJournalPath(const std::string &library_path) const
+{
+    return cache_dir_ + "/metadata_" + hashLibraryPath(library_path) + ".journal";
+}
+
 void MetadataCache::ensureCacheDirectoryExists()
 {
     namespace fs = std::filesystem;
@@ -50,12 +379,93 @@ std::optional<std::vector<TrackMetadata>> MetadataCache::load(const std::string
 {
     namespace fs = std::filesystem;
 
+    // Our own cache, else one named the way caches were before the hash
+    // was stable, else one that came with the library
     std::string cache_path = getCachePath(library_path);
-
+    bool migrate = false;
     if (!fs::exists(cache_path))
+    {
+        std::string legacy_path = getLegacyCachePath(library_path);
+        std::string library_cache_path = LibraryPrefix(library_path) + LIBRARY_CACHE_NAME;
+        if (fs::exists(legacy_path))
+        {
+            cache_path = legacy_path;
+            migrate = true;
+        }
+        else if (fs::exists(library_cache_path))
+        {
+            cache_path = library_cache_path;
+        }
+        else
+        {
+            return std::nullopt;
+        }
+    }
+
+    // A shard missing because a save replaced the manifest meanwhile is
+    // named by the new manifest; read that one instead
+    auto version = FileVersion(cache_path);
+    auto tracks = readCacheFile(cache_path, library_path);
+    for (auto current = FileVersion(cache_path); !tracks && current != version; current = FileVersion(cache_path))
+    {
+        version = current;
+        tracks = readCacheFile(cache_path, library_path);
+    }
+    if (!tracks)
     {
         return std::nullopt;
     }
+    if (cache_path == getCachePath(library_path))
+    {
+        replayJournal(library_path, *tracks);
+    }
+
+    if (migrate)
+    {
+        std::error_code ec;
+        if (save(library_path, *tracks))
+        {
+            fs::remove(cache_path, ec);
+            fs::remove(fs::path(cache_path).replace_extension(".idx"), ec);
+        }
+    }
+    // A cache shipped with the library gets indexes in our own .shards
+    // directory on first use, replacing those of an older version of it
+    else if (cache_path != getCachePath(library_path))
+    {
+        fs::path shard_directory = ShardDirectory(getCachePath(library_path));
+        std::error_code ec;
+        fs::create_directories(shard_directory, ec);
+        std::unordered_set<std::string> indexes;
+        for (const auto &[name, shard_tracks] : GroupShards(*tracks, LibraryPrefix(library_path)))
+        {
+            std::string index_name = ShardIndexName(name, ShardFingerprint(shard_tracks));
+            if (!fs::exists(shard_directory / index_name))
+            {
+                MetadataIndex::write((shard_directory / index_name).string(), shard_tracks);
+            }
+            indexes.insert(std::move(index_name));
+        }
+        for (fs::directory_iterator it(shard_directory, ec), end; !ec && it != end; it.increment(ec))
+        {
+            if (it->path().extension() == ".idx" && !indexes.contains(it->path().filename().string()))
+            {
+                std::error_code remove_ec;
+                fs::remove(it->path(), remove_ec);
+            }
+        }
+    }
+    // The whole-library index of caches before shards
+    std::error_code ec;
+    fs::remove(getIndexPath(library_path), ec);
+
+    return tracks;
+}
+
+std::optional<std::vector<TrackMetadata>> MetadataCache::readCacheFile(const std::string &cache_path,
+                                                                       const std::string &library_path) const
+{
+    namespace fs = std::filesystem;
 
     try
     {
@@ -69,33 +479,75 @@ std::optional<std::vector<TrackMetadata>> MetadataCache::load(const std::string
         file >> cache_json;
 
         // Validate version
-        if (!cache_json.contains("version") || cache_json["version"] != 1)
+        int version = cache_json.value("version", 0);
+        if (version < 1 || version > CACHE_VERSION)
         {
             std::cerr << "Warning: Cache version mismatch, ignoring cache" << std::endl;
             return std::nullopt;
         }
 
-        // Validate library path matches
-        if (!cache_json.contains("library_path") ||
-            cache_json["library_path"] != fs::absolute(library_path).string())
+        // Version 1 caches hold absolute paths, so only fit the library
+        // where they were made. Later ones hold paths relative to the
+        // library and fit wherever it is mounted.
+        if (version == 1 && (!cache_json.contains("library_path") ||
+                             cache_json["library_path"] != fs::absolute(library_path).string()))
         {
             return std::nullopt;
         }
+        std::string prefix = LibraryPrefix(library_path);
+
+        if (version == CACHE_VERSION)
+        {
+            // Parse the shards side by side; a library of a million
+            // tracks is hundreds of megabytes of JSON
+            const json &shards_json = cache_json.at("shards");
+            std::vector<fs::path> shard_paths;
+            for (const auto &shard_json : shards_json)
+            {
+                shard_paths.push_back(ShardDirectory(cache_path) / shard_json.at("file").get<std::string>());
+            }
+            std::vector<std::optional<std::vector<TrackMetadata>>> shards(shard_paths.size());
+            ParallelFor(shards.size(), [&](size_t i)
+                        { shards[i] = ReadShard(shard_paths[i], prefix); });
+
+            // A shard gone missing leaves no telling what is in the
+            // library; rescan rather than lose part of it
+            size_t total = 0;
+            for (const auto &shard : shards)
+            {
+                if (!shard)
+                {
+                    return std::nullopt;
+                }
+                total += shard->size();
+            }
+            std::vector<TrackMetadata> tracks;
+            tracks.reserve(total);
+            for (auto &shard : shards)
+            {
+                std::move(shard->begin(), shard->end(), std::back_inserter(tracks));
+            }
+            return tracks;
+        }
 
         // Extract tracks
         std::vector<TrackMetadata> tracks;
         if (cache_json.contains("tracks"))
         {
+            tracks.reserve(cache_json["tracks"].size());
             for (const auto &track_json : cache_json["tracks"])
             {
                 auto track = TrackMetadata::fromJson(track_json);
                 if (track)
                 {
-                    tracks.push_back(*track);
+                    if (version != 1)
+                    {
+                        RebasePath(*track, prefix);
+                    }
+                    tracks.push_back(std::move(*track));
                 }
             }
         }
-
         return tracks;
     }
     catch (const std::exception &e)
@@ -105,34 +557,309 @@ std::optional<std::vector<TrackMetadata>> MetadataCache::load(const std::string
     }
 }
 
+void MetadataCache::replayJournal(const std::string &library_path, std::vector<TrackMetadata> &tracks) const
+{
+    std::ifstream journal(getJournalPath(library_path));
+    if (!journal.is_open())
+    {
+        return;
+    }
+    auto base = JournalBase(journal);
+    if (!base || base != FileVersion(getCachePath(library_path)))
+    {
+        return;
+    }
+
+    std::string prefix = LibraryPrefix(library_path);
+    std::unordered_map<std::string, size_t> positions;
+    positions.reserve(tracks.size());
+    for (size_t i = 0; i < tracks.size(); ++i)
+    {
+        positions.emplace(tracks[i].filepath, i);
+    }
+
+    // Deleted tracks are marked by an empty path and dropped at the end
+    std::string line;
+    bool deleted = false;
+    while (std::getline(journal, line))
+    {
+        json record = json::parse(line, nullptr, false);
+        if (record.is_discarded())
+        {
+            // Cut short by a writer that did not finish
+            continue;
+        }
+
+        if (record.contains("put"))
+        {
+            auto track = TrackMetadata::fromJson(record["put"]);
+            if (!track)
+            {
+                continue;
+            }
+            RebasePath(*track, prefix);
+            auto [position, added] = positions.try_emplace(track->filepath, tracks.size());
+            if (added)
+            {
+                tracks.push_back(std::move(*track));
+            }
+            else
+            {
+                tracks[position->second] = std::move(*track);
+            }
+        }
+        else if (record.contains("delete") && record["delete"].is_string())
+        {
+            TrackMetadata removed;
+            removed.filepath = record["delete"].get<std::string>();
+            RebasePath(removed, prefix);
+            auto position = positions.find(removed.filepath);
+            if (position != positions.end())
+            {
+                tracks[position->second].filepath.clear();
+                positions.erase(position);
+                deleted = true;
+            }
+        }
+    }
+
+    if (deleted)
+    {
+        std::erase_if(tracks, [](const TrackMetadata &track)
+                      { return track.filepath.empty(); });
+    }
+}
+
 bool MetadataCache::save(const std::string &library_path, const std::vector<TrackMetadata> &tracks)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return writeCache(library_path, tracks, "");
+}
+
+bool MetadataCache::update(const std::string &library_path,
+                           const std::vector<TrackMetadata> &changed,
+                           const std::vector<std::string> &removed)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto cache_version = FileVersion(getCachePath(library_path));
+    if (!cache_version)
+    {
+        return false;
+    }
+
+    // A journal started on an older version of the cache, replaced since,
+    // no longer applies; start a new one
+    std::string journal_path = getJournalPath(library_path);
+    bool restart;
+    std::string records;
+    {
+        std::ifstream journal(journal_path, std::ios::binary);
+        restart = !journal.is_open() || JournalBase(journal) != cache_version;
+        if (restart)
+        {
+            records = JournalHeader(*cache_version);
+        }
+        // Keep a record cut short from running into the next one
+        else if (journal.seekg(-1, std::ios::end) && journal.get() != '\n')
+        {
+            records = "\n";
+        }
+    }
+
+    std::string prefix = LibraryPrefix(library_path);
+    for (const auto &track : changed)
+    {
+        json track_json = track.toJson();
+        track_json["filepath"] = RelativePath(track.filepath, prefix);
+        records += json{{"put", std::move(track_json)}}.dump() + "\n";
+    }
+    for (const auto &filepath : removed)
+    {
+        records += json{{"delete", RelativePath(filepath, prefix)}}.dump() + "\n";
+    }
+
+    std::ofstream journal(journal_path, std::ios::binary | (restart ? std::ios::trunc : std::ios::app));
+    journal << records;
+    journal.flush();
+    if (!journal)
+    {
+        std::cerr << "Error: Could not write cache journal: " << journal_path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+uint64_t MetadataCache::journalSize(const std::string &library_path) const
+{
+    std::error_code ec;
+    uint64_t size = std::filesystem::file_size(getJournalPath(library_path), ec);
+    return ec ? 0 : size;
+}
+
+bool MetadataCache::needsCompaction(const std::string &library_path) const
+{
+    namespace fs = std::filesystem;
+
+    uint64_t journal_size = journalSize(library_path);
+    if (journal_size <= MIN_COMPACTION_SIZE)
+    {
+        return false;
+    }
+    // The cache is its manifest and shards
+    std::error_code ec;
+    std::string cache_path = getCachePath(library_path);
+    uint64_t cache_size = fs::file_size(cache_path, ec);
+    cache_size = ec ? 0 : cache_size;
+    for (fs::directory_iterator it(ShardDirectory(cache_path), ec), end; !ec && it != end; it.increment(ec))
+    {
+        std::error_code size_ec;
+        uint64_t size = it->file_size(size_ec);
+        cache_size += size_ec ? 0 : size;
+    }
+    return journal_size > cache_size / 4;
+}
+
+bool MetadataCache::compact(const std::string &library_path,
+                            const std::vector<TrackMetadata> &tracks,
+                            uint64_t journal_offset)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    // Records written after the snapshot of tracks was taken carry over
+    std::string tail;
+    std::ifstream journal(getJournalPath(library_path), std::ios::binary);
+    if (journal.is_open() && journal.seekg(static_cast<std::streamoff>(journal_offset)))
+    {
+        std::ostringstream rest;
+        rest << journal.rdbuf();
+        tail = rest.str();
+    }
+    return writeCache(library_path, tracks, tail);
+}
+
+bool MetadataCache::writeCache(const std::string &library_path,
+                               const std::vector<TrackMetadata> &tracks,
+                               const std::string &journal_tail)
 {
     namespace fs = std::filesystem;
 
     std::string cache_path = getCachePath(library_path);
+    std::string journal_path = getJournalPath(library_path);
 
     try
     {
+        // Group the tracks into shards, and find the ones that came out
+        // differently from what the current manifest says is on disk
+        std::string prefix = LibraryPrefix(library_path);
+        auto shards = GroupShards(tracks, prefix);
+        std::map<std::string, uint64_t> fingerprints;
+        for (const auto &[name, shard_tracks] : shards)
+        {
+            fingerprints[name] = ShardFingerprint(shard_tracks);
+        }
+
+        // Shards whose version is not on disk yet; those that are were
+        // written whole, since a shard only gets its name once complete
+        fs::path shard_directory = ShardDirectory(cache_path);
+        fs::create_directories(shard_directory);
+        std::vector<const std::string *> changed;
+        for (const auto &[name, shard_tracks] : shards)
+        {
+            if (!fs::exists(shard_directory / ShardFileName(name, fingerprints[name])) ||
+                !fs::exists(shard_directory / ShardIndexName(name, fingerprints[name])))
+            {
+                changed.push_back(&name);
+            }
+        }
+
+        // A shard and its index are written together, and only when its
+        // tracks changed
+        std::atomic<bool> failed{false};
+        ParallelFor(changed.size(), [&](size_t i)
+                    {
+                        const std::string &name = *changed[i];
+                        const auto &shard_tracks = shards.at(name);
+                        uint64_t fingerprint = fingerprints.at(name);
+                        if (!WriteShard(shard_directory / ShardFileName(name, fingerprint), name, shard_tracks, prefix) ||
+                            !MetadataIndex::write((shard_directory / ShardIndexName(name, fingerprint)).string(),
+                                                  shard_tracks))
+                        {
+                            failed = true;
+                        } });
+        if (failed)
+        {
+            return false;
+        }
+
         json cache_json;
-        cache_json["version"] = 1;
+        cache_json["version"] = CACHE_VERSION;
+        // Where the cache was made; informational, paths are relative to it
         cache_json["library_path"] = fs::absolute(library_path).string();
         cache_json["last_scan"] = std::time(nullptr);
+        json shards_json = json::array();
+        for (const auto &[name, shard_tracks] : shards)
+        {
+            shards_json.push_back({{"directory", name},
+                                   {"file", ShardFileName(name, fingerprints[name])},
+                                   {"index", ShardIndexName(name, fingerprints[name])},
+                                   {"tracks", shard_tracks.size()},
+                                   {"fingerprint", fingerprints[name]}});
+        }
+        cache_json["shards"] = std::move(shards_json);
 
-        json tracks_json = json::array();
-        for (const auto &track : tracks)
+        // A library watcher may rewrite the cache while vibe-playlist reads
+        // it, so replace the file rather than writing over it; the shards
+        // the old manifest names stay until it has been replaced
+        std::unordered_set<std::string> previous_files = ShardFiles(cache_path);
+        std::string temp_path = cache_path + ".tmp" + std::to_string(getpid());
         {
-            tracks_json.push_back(track.toJson());
+            std::ofstream file(temp_path);
+            if (!file.is_open())
+            {
+                std::cerr << "Error: Could not write cache file: " << cache_path << std::endl;
+                return false;
+            }
+            file << cache_json.dump(2);
         }
-        cache_json["tracks"] = tracks_json;
 
-        std::ofstream file(cache_path);
-        if (!file.is_open())
+        // Everything journaled so far is in the new cache, apart from a
+        // tail to start the new journal with. Renaming keeps the temporary
+        // file's version, so the header can name it already.
+        std::string journal_temp_path = journal_path + ".tmp" + std::to_string(getpid());
+        auto cache_version = FileVersion(temp_path);
+        bool keep_journal = !journal_tail.empty() && cache_version;
+        if (keep_journal)
         {
-            std::cerr << "Error: Could not write cache file: " << cache_path << std::endl;
-            return false;
+            std::ofstream journal(journal_temp_path, std::ios::binary | std::ios::trunc);
+            journal << JournalHeader(*cache_version) << journal_tail;
+            keep_journal = static_cast<bool>(journal);
         }
 
-        file << cache_json.dump(2);
+        fs::rename(temp_path, cache_path);
+        std::error_code ec;
+        if (keep_journal)
+        {
+            fs::rename(journal_temp_path, journal_path, ec);
+        }
+        else
+        {
+            fs::remove(journal_path, ec);
+        }
+
+        // Older versions of shards, and shards of directories that are
+        // gone, now that the manifest no longer names them
+        for (const auto &[name, fingerprint] : fingerprints)
+        {
+            previous_files.erase(ShardFileName(name, fingerprint));
+            previous_files.erase(ShardIndexName(name, fingerprint));
+        }
+        for (const auto &file : previous_files)
+        {
+            fs::remove(shard_directory / file, ec);
+        }
+        // The whole-library index of caches before shards
+        fs::remove(getIndexPath(library_path), ec);
         return true;
     }
     catch (const std::exception &e)
@@ -185,6 +912,9 @@ void MetadataCache::clear(const std::string &library_path)
         {
             fs::remove(cache_path);
         }
+        fs::remove(getIndexPath(library_path));
+        fs::remove(getJournalPath(library_path));
+        fs::remove_all(ShardDirectory(cache_path));
     }
     catch (const fs::filesystem_error &e)
     {
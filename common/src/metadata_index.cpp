@@ -0,0 +1,361 @@
+/*
+ * vibe-player
+ * metadata_index.cpp
+ */
+
+#include "metadata_index.h"
+#include "fnv_hash.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+
+#include <spdlog/spdlog.h>
+
+namespace
+{
+    constexpr char INDEX_MAGIC[4] = {'V', 'P', 'M', 'I'};
+    // Version 2 adds the prefix every path in the index starts with
+    constexpr uint32_t INDEX_VERSION = 2;
+    constexpr uint32_t NO_STRING = 0xffffffffu;
+
+    // Index file layout: header, records sorted by path_hash, string table
+    struct IndexHeader
+    {
+        char magic[4];
+        uint32_t version;
+        uint64_t count;
+        uint64_t strings_offset;
+        uint64_t strings_size;
+        uint32_t prefix_length; // The prefix starts the string table
+        uint32_t reserved;
+    };
+
+    struct StringRef
+    {
+        uint32_t offset;
+        uint32_t length; // NO_STRING for an absent optional
+    };
+
+    struct IndexRecord
+    {
+        uint64_t path_hash;
+        int64_t mtime;
+        int64_t duration_ms;
+        int32_t year;
+        uint32_t has_year;
+        StringRef filepath;
+        StringRef filename;
+        StringRef title;
+        StringRef artist;
+        StringRef album;
+        StringRef genre;
+    };
+
+    const IndexHeader &HeaderOf(const unsigned char *data)
+    {
+        return *reinterpret_cast<const IndexHeader *>(data);
+    }
+
+    const IndexRecord *RecordsOf(const unsigned char *data)
+    {
+        return reinterpret_cast<const IndexRecord *>(data + sizeof(IndexHeader));
+    }
+
+    StringRef AddString(std::string &strings, const std::string &value)
+    {
+        StringRef ref{static_cast<uint32_t>(strings.size()), static_cast<uint32_t>(value.size())};
+        strings += value;
+        return ref;
+    }
+
+    StringRef AddString(std::string &strings, const std::optional<std::string> &value)
+    {
+        return value ? AddString(strings, *value) : StringRef{0, NO_STRING};
+    }
+}
+
+MetadataIndex::MetadataIndex(const std::string &cache_dir)
+{
+    namespace fs = std::filesystem;
+
+    std::string dir = cache_dir.empty() ? std::string(getenv("HOME") ? getenv("HOME") : ".") + "/.cache/vibe-player" : cache_dir;
+
+    // One index per cache shard, in the cache's .shards directory. Each
+    // version of a shard has its own "<shard>-<fingerprint>.idx"; until a
+    // save has removed the old ones, the newest is the current one.
+    std::error_code ec;
+    for (const auto &library : fs::directory_iterator(dir, ec))
+    {
+        if (library.path().extension() != ".shards")
+        {
+            continue;
+        }
+        std::map<std::string, std::pair<fs::file_time_type, fs::path>> newest;
+        std::error_code shard_ec;
+        for (const auto &entry : fs::directory_iterator(library.path(), shard_ec))
+        {
+            if (entry.path().extension() != ".idx")
+            {
+                continue;
+            }
+            std::error_code time_ec;
+            auto time = entry.last_write_time(time_ec);
+            std::string stem = entry.path().stem().string();
+            auto [shard, added] = newest.try_emplace(stem.substr(0, stem.find('-')), time, entry.path());
+            if (!added && !time_ec && time > shard->second.first)
+            {
+                shard->second = {time, entry.path()};
+            }
+        }
+        for (const auto &[shard, version] : newest)
+        {
+            map(version.second.string());
+        }
+    }
+
+    // Longest prefixes first, so lookups try the shard of a subdirectory
+    // before the one of the library root
+    std::sort(mappings_.begin(), mappings_.end(),
+              [](const Mapping &a, const Mapping &b)
+              { return a.prefix.size() > b.prefix.size(); });
+}
+
+void MetadataIndex::map(const std::string &index_path)
+{
+    int fd = open(index_path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(IndexHeader))
+    {
+        close(fd);
+        return;
+    }
+
+    size_t size = static_cast<size_t>(st.st_size);
+    void *data = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        return;
+    }
+
+    // Reject anything whose tables do not fit in the file
+    const auto *bytes = static_cast<const unsigned char *>(data);
+    const IndexHeader &header = HeaderOf(bytes);
+    bool valid = memcmp(header.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC)) == 0 &&
+                 header.version == INDEX_VERSION &&
+                 header.count <= (size - sizeof(IndexHeader)) / sizeof(IndexRecord) &&
+                 header.strings_offset >= sizeof(IndexHeader) + header.count * sizeof(IndexRecord) &&
+                 header.strings_offset <= size &&
+                 header.strings_size <= size - header.strings_offset &&
+                 header.prefix_length <= header.strings_size;
+    if (!valid)
+    {
+        spdlog::warn("Ignoring invalid metadata index: {}", index_path);
+        munmap(data, size);
+        return;
+    }
+
+    madvise(data, size, MADV_RANDOM);
+    std::string_view prefix(reinterpret_cast<const char *>(bytes + header.strings_offset), header.prefix_length);
+    mappings_.push_back({bytes, size, static_cast<size_t>(header.count), prefix});
+    spdlog::debug("Mapped metadata index {} ({} tracks)", index_path, header.count);
+}
+
+MetadataIndex::~MetadataIndex()
+{
+    for (const auto &mapping : mappings_)
+    {
+        munmap(const_cast<unsigned char *>(mapping.data), mapping.size);
+    }
+}
+
+size_t MetadataIndex::size() const
+{
+    size_t total = 0;
+    for (const auto &mapping : mappings_)
+    {
+        total += mapping.count;
+    }
+    return total;
+}
+
+std::string MetadataIndex::normalizePath(const std::string &filepath)
+{
+    namespace fs = std::filesystem;
+
+    std::error_code ec;
+    fs::path canonical = fs::weakly_canonical(fs::absolute(filepath, ec), ec);
+    return ec ? filepath : canonical.string();
+}
+
+std::optional<TrackMetadata> MetadataIndex::lookup(const std::string &filepath) const
+{
+    uint64_t hash = Fnv1aHash(filepath);
+    for (const auto &mapping : mappings_)
+    {
+        if (!std::string_view(filepath).starts_with(mapping.prefix))
+        {
+            continue;
+        }
+        if (auto track = lookupIn(mapping, filepath, hash))
+        {
+            return track;
+        }
+    }
+    return std::nullopt;
+}
+
+std::optional<TrackMetadata> MetadataIndex::lookupIn(const Mapping &mapping, const std::string &filepath, uint64_t hash) const
+{
+    const IndexHeader &header = HeaderOf(mapping.data);
+    const IndexRecord *begin = RecordsOf(mapping.data);
+    const IndexRecord *end = begin + mapping.count;
+    const char *strings = reinterpret_cast<const char *>(mapping.data + header.strings_offset);
+
+    auto readString = [&](const StringRef &ref) -> std::optional<std::string>
+    {
+        if (ref.length == NO_STRING || ref.offset > header.strings_size ||
+            ref.length > header.strings_size - ref.offset)
+        {
+            return std::nullopt;
+        }
+        return std::string(strings + ref.offset, ref.length);
+    };
+
+    auto it = std::lower_bound(begin, end, hash,
+                               [](const IndexRecord &record, uint64_t value)
+                               { return record.path_hash < value; });
+    for (; it != end && it->path_hash == hash; ++it)
+    {
+        auto path = readString(it->filepath);
+        if (!path || *path != filepath)
+        {
+            continue;
+        }
+
+        // A changed file has to be read again
+        if (MetadataExtractor::getFileModificationTime(filepath) != it->mtime)
+        {
+            return std::nullopt;
+        }
+
+        TrackMetadata track;
+        track.filepath = std::move(*path);
+        track.filename = readString(it->filename).value_or("");
+        track.title = readString(it->title);
+        track.artist = readString(it->artist);
+        track.album = readString(it->album);
+        track.genre = readString(it->genre);
+        if (it->has_year)
+        {
+            track.year = it->year;
+        }
+        track.duration_ms = it->duration_ms;
+        track.file_mtime = it->mtime;
+        return track;
+    }
+    return std::nullopt;
+}
+
+bool MetadataIndex::write(const std::string &index_path, const std::vector<const TrackMetadata *> &tracks)
+{
+    namespace fs = std::filesystem;
+
+    // Players look tracks up by their resolved path
+    std::vector<std::string> keys;
+    keys.reserve(tracks.size());
+    for (const TrackMetadata *track : tracks)
+    {
+        keys.push_back(normalizePath(track->filepath));
+    }
+
+    // The directory every key is in, so lookups of other paths skip this
+    // index without searching it
+    std::string_view prefix = keys.empty() ? std::string_view() : std::string_view(keys.front());
+    for (const auto &key : keys)
+    {
+        auto [mismatch, unused] = std::mismatch(prefix.begin(), prefix.end(), key.begin(), key.end());
+        prefix = prefix.substr(0, mismatch - prefix.begin());
+    }
+    prefix = prefix.substr(0, prefix.rfind('/') + 1);
+
+    std::vector<IndexRecord> records;
+    records.reserve(tracks.size());
+    std::string strings(prefix);
+    for (size_t i = 0; i < tracks.size(); ++i)
+    {
+        const TrackMetadata &track = *tracks[i];
+        const std::string &key = keys[i];
+
+        IndexRecord record = {};
+        record.path_hash = Fnv1aHash(key);
+        record.mtime = track.file_mtime;
+        record.duration_ms = track.duration_ms;
+        record.year = track.year.value_or(0);
+        record.has_year = track.year.has_value();
+        record.filepath = AddString(strings, key);
+        record.filename = AddString(strings, track.filename);
+        record.title = AddString(strings, track.title);
+        record.artist = AddString(strings, track.artist);
+        record.album = AddString(strings, track.album);
+        record.genre = AddString(strings, track.genre);
+        records.push_back(record);
+    }
+
+    std::sort(records.begin(), records.end(),
+              [](const IndexRecord &a, const IndexRecord &b)
+              { return a.path_hash < b.path_hash; });
+
+    IndexHeader header = {};
+    memcpy(header.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC));
+    header.version = INDEX_VERSION;
+    header.count = records.size();
+    header.strings_offset = sizeof(IndexHeader) + records.size() * sizeof(IndexRecord);
+    header.strings_size = strings.size();
+    header.prefix_length = static_cast<uint32_t>(prefix.size());
+
+    // Players may have the old index mapped; rename leaves that mapping intact
+    std::string temp_path = index_path + ".tmp" + std::to_string(getpid());
+    {
+        std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+        if (!file.is_open())
+        {
+            std::cerr << "Error: Could not write metadata index: " << temp_path << std::endl;
+            return false;
+        }
+        file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char *>(records.data()), records.size() * sizeof(IndexRecord));
+        file.write(strings.data(), strings.size());
+        if (!file)
+        {
+            file.close();
+            std::error_code ec;
+            fs::remove(temp_path, ec);
+            return false;
+        }
+    }
+
+    std::error_code ec;
+    fs::rename(temp_path, index_path, ec);
+    if (ec)
+    {
+        std::cerr << "Error: Could not store metadata index " << index_path << ": " << ec.message() << std::endl;
+        fs::remove(temp_path, ec);
+        return false;
+    }
+    return true;
+}
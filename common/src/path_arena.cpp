@@ -0,0 +1,101 @@
+/*
+ * vibe-player
+ * path_arena.cpp
+ */
+
+#include "path_arena.h"
+#include <algorithm>
+
+void PathArena::reserve(size_t count, size_t bytes)
+{
+    spans_.reserve(count);
+    blob_.reserve(bytes);
+}
+
+PathArena::Span PathArena::store(std::string_view path)
+{
+    Span span{blob_.size(), static_cast<uint32_t>(path.size())};
+    blob_.append(path);
+    return span;
+}
+
+void PathArena::push_back(std::string_view path)
+{
+    spans_.push_back(store(path));
+}
+
+void PathArena::insert(size_t position, std::string_view path)
+{
+    position = std::min(position, spans_.size());
+    spans_.insert(spans_.begin() + position, store(path));
+}
+
+void PathArena::erase(size_t index)
+{
+    dead_bytes_ += spans_[index].length;
+    spans_.erase(spans_.begin() + index);
+    compactIfSparse();
+}
+
+void PathArena::replace(size_t index, std::string_view path)
+{
+    dead_bytes_ += spans_[index].length;
+    spans_[index] = store(path);
+    compactIfSparse();
+}
+
+void PathArena::move(size_t from, size_t to)
+{
+    if (from < to)
+    {
+        std::rotate(spans_.begin() + from, spans_.begin() + from + 1, spans_.begin() + to + 1);
+    }
+    else if (to < from)
+    {
+        std::rotate(spans_.begin() + to, spans_.begin() + from, spans_.begin() + from + 1);
+    }
+}
+
+void PathArena::reorder(size_t begin, const std::vector<size_t> &order)
+{
+    std::vector<Span> reordered;
+    reordered.reserve(order.size());
+    for (size_t index : order)
+    {
+        reordered.push_back(spans_[begin + index]);
+    }
+    std::copy(reordered.begin(), reordered.end(), spans_.begin() + begin);
+}
+
+void PathArena::keepOnly(size_t index)
+{
+    std::string path(operator[](index));
+    clear();
+    push_back(path);
+}
+
+void PathArena::clear()
+{
+    blob_.clear();
+    spans_.clear();
+    dead_bytes_ = 0;
+}
+
+void PathArena::compactIfSparse()
+{
+    if (dead_bytes_ == 0 || dead_bytes_ * 2 < blob_.size())
+    {
+        return;
+    }
+
+    std::string compacted;
+    compacted.reserve(blob_.size() - dead_bytes_);
+    for (auto &span : spans_)
+    {
+        uint64_t offset = compacted.size();
+        compacted.append(blob_, span.offset, span.length);
+        span.offset = offset;
+    }
+    blob_ = std::move(compacted);
+    dead_bytes_ = 0;
+}
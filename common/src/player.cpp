@@ -41,10 +41,15 @@ void AudioPlayer::DataCallback(ma_device *pDevice, void *pOutput, const void *pI
         }
     }
 
-    // If we read fewer frames than requested, we've reached the end
+    // If we read fewer frames than requested, we've reached the end.
+    // Only notify on the transition; the device keeps calling back with
+    // zero frames until the main thread stops it.
     if (framesRead < frameCount)
     {
-        pPlayer->playing_ = false;
+        if (pPlayer->playing_.exchange(false) && pPlayer->track_end_callback_)
+        {
+            pPlayer->track_end_callback_();
+        }
     }
 
     (void)pInput; // Unused
@@ -178,6 +183,11 @@ bool AudioPlayer::isPaused() const
     return paused_;
 }
 
+bool AudioPlayer::isLoaded() const
+{
+    return decoder_initialized_;
+}
+
 void AudioPlayer::setVolume(float vol)
 {
     volume_ = std::clamp(vol, 0.0f, 1.0f);
@@ -229,6 +239,11 @@ void AudioPlayer::seek(int64_t position)
     }
 }
 
+void AudioPlayer::setTrackEndCallback(std::function<void()> callback)
+{
+    track_end_callback_ = std::move(callback);
+}
+
 void AudioPlayer::cleanup()
 {
     stop();
@@ -0,0 +1,386 @@
+/*
+ * vibe-player
+ * player_control.cpp
+ */
+
+#include "player_control.h"
+#include "shuffle.h"
+
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <optional>
+#include <stdexcept>
+
+#include <spdlog/spdlog.h>
+
+using json = nlohmann::json;
+
+namespace
+{
+    json ErrorReply(const std::string &message)
+    {
+        return json{{"ok", false}, {"error", message}};
+    }
+
+    // Parse "<value>", "+<delta>" or "-<delta>" relative to current
+    bool ParseAdjustment(const std::string &argument, double current, double &result)
+    {
+        if (argument.empty())
+        {
+            return false;
+        }
+        try
+        {
+            size_t consumed = 0;
+            double value = std::stod(argument, &consumed);
+            if (consumed != argument.size() || !std::isfinite(value))
+            {
+                return false;
+            }
+            bool relative = argument[0] == '+' || argument[0] == '-';
+            result = relative ? current + value : value;
+            return std::isfinite(result);
+        }
+        catch (const std::exception &)
+        {
+            return false;
+        }
+    }
+
+    // Parse a 1-based track number from the protocol into a playlist index
+    std::optional<size_t> ParseTrackNumber(const std::string &argument, size_t size)
+    {
+        try
+        {
+            size_t consumed = 0;
+            long number = std::stol(argument, &consumed);
+            if (consumed != argument.size() || number < 1 || static_cast<size_t>(number) > size)
+            {
+                return std::nullopt;
+            }
+            return static_cast<size_t>(number - 1);
+        }
+        catch (const std::exception &)
+        {
+            return std::nullopt;
+        }
+    }
+
+    json TrackJson(const TrackMetadata &track)
+    {
+        json entry;
+        entry["filepath"] = track.filepath;
+        entry["title"] = track.title ? json(*track.title) : json(nullptr);
+        entry["artist"] = track.artist ? json(*track.artist) : json(nullptr);
+        entry["album"] = track.album ? json(*track.album) : json(nullptr);
+        entry["duration"] = track.duration_ms / 1000;
+        return entry;
+    }
+
+    json PathJson(std::string_view path)
+    {
+        json entry;
+        entry["filepath"] = std::string(path);
+        entry["title"] = nullptr;
+        entry["artist"] = nullptr;
+        entry["album"] = nullptr;
+        entry["duration"] = 0;
+        return entry;
+    }
+}
+
+bool PlayCurrentTrack(AudioPlayer &player, const Playlist &playlist)
+{
+    player.cleanup();
+    if (!player.loadFile(playlist.current().filepath))
+    {
+        return false;
+    }
+    player.play();
+    return true;
+}
+
+json PlayerStatusJson(const AudioPlayer &player, const Playlist &playlist)
+{
+    json status;
+    if (player.isPlaying())
+    {
+        status["state"] = "playing";
+    }
+    else if (player.isPaused())
+    {
+        status["state"] = "paused";
+    }
+    else
+    {
+        status["state"] = "stopped";
+    }
+
+    status["position"] = player.getPosition() / 1000;
+    status["duration"] = player.getDuration() / 1000;
+    status["volume"] = static_cast<int>(player.getVolume() * 100 + 0.5f);
+    status["tracks"] = playlist.size();
+
+    // A daemon may be running with an empty queue
+    if (playlist.empty())
+    {
+        status["track"] = 0;
+        status["filepath"] = nullptr;
+        status["title"] = nullptr;
+        status["artist"] = nullptr;
+        status["album"] = nullptr;
+        return status;
+    }
+
+    const TrackMetadata &track = playlist.current();
+    status["track"] = playlist.currentIndex() + 1;
+    status["filepath"] = track.filepath;
+    status["title"] = track.title ? json(*track.title) : json(nullptr);
+    status["artist"] = track.artist ? json(*track.artist) : json(nullptr);
+    status["album"] = track.album ? json(*track.album) : json(nullptr);
+    return status;
+}
+
+json HandleControlRequest(const ControlRequest &request,
+                          AudioPlayer &player,
+                          Playlist &playlist,
+                          bool &running)
+{
+    const std::string &cmd = request.command;
+    spdlog::debug("Control request: {} {}", cmd, request.argument);
+
+    if (cmd == "status")
+    {
+        // Nothing to change
+    }
+    else if (cmd == "play")
+    {
+        player.play();
+    }
+    else if (cmd == "pause")
+    {
+        player.pause();
+    }
+    else if (cmd == "toggle")
+    {
+        if (player.isPlaying())
+        {
+            player.pause();
+        }
+        else
+        {
+            player.play();
+        }
+    }
+    else if (cmd == "stop")
+    {
+        player.stop();
+    }
+    else if (cmd == "next")
+    {
+        if (!playlist.hasNext())
+        {
+            return ErrorReply("already at the last track");
+        }
+        playlist.advance();
+        PlayCurrentTrack(player, playlist);
+    }
+    else if (cmd == "prev")
+    {
+        if (!playlist.hasPrevious())
+        {
+            return ErrorReply("already at the first track");
+        }
+        playlist.previous();
+        PlayCurrentTrack(player, playlist);
+    }
+    else if (cmd == "seek")
+    {
+        double seconds;
+        if (!ParseAdjustment(request.argument, player.getPosition() / 1000.0, seconds))
+        {
+            return ErrorReply("seek needs <seconds>, +<seconds> or -<seconds>");
+        }
+        // Within the track, so the conversion to milliseconds cannot overflow
+        double duration = player.getDuration() / 1000.0;
+        player.seek(static_cast<int64_t>(std::clamp(seconds, 0.0, std::max(duration, 0.0)) * 1000));
+    }
+    else if (cmd == "volume")
+    {
+        double percent;
+        if (!ParseAdjustment(request.argument, player.getVolume() * 100.0, percent))
+        {
+            return ErrorReply("volume needs <percent>, +<percent> or -<percent>");
+        }
+        player.setVolume(static_cast<float>(std::clamp(percent, 0.0, 100.0) / 100.0));
+    }
+    else if (cmd == "enqueue" || cmd == "insert" || cmd == "enqueue-list" || cmd == "insert-list")
+    {
+        // The list forms queue a whole playlist in one request
+        bool list = cmd.ends_with("-list");
+        std::vector<std::string> paths;
+        if (list)
+        {
+            json paths_json = json::parse(request.argument, nullptr, false);
+            if (!paths_json.is_array() || paths_json.empty() ||
+                !std::all_of(paths_json.begin(), paths_json.end(), [](const json &path)
+                             { return path.is_string() && !path.get_ref<const std::string &>().empty(); }))
+            {
+                return ErrorReply(cmd + " needs a JSON array of file paths");
+            }
+            for (auto &path : paths_json)
+            {
+                paths.push_back(std::move(path.get_ref<std::string &>()));
+            }
+        }
+        else if (request.argument.empty())
+        {
+            return ErrorReply(cmd + " needs a file path");
+        }
+        else
+        {
+            paths.push_back(request.argument);
+        }
+
+        // Tags are read later, by the look-ahead or from the library
+        // index, so a long playlist does not hold up the loop; only check
+        // that the files are there
+        std::vector<std::string> queued;
+        json rejected = json::array();
+        for (auto &path : paths)
+        {
+            struct stat st;
+            if (stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode))
+            {
+                queued.push_back(std::move(path));
+            }
+            else
+            {
+                rejected.push_back(std::move(path));
+            }
+        }
+        if (!list && queued.empty())
+        {
+            return ErrorReply("cannot read audio file: " + request.argument);
+        }
+
+        // insert queues the tracks to play next
+        bool next = cmd.starts_with("insert") && !playlist.empty();
+        playlist.insertPaths(next ? playlist.currentIndex() + 1 : playlist.size(), queued);
+        if (queued.size() == 1)
+        {
+            spdlog::info("Queued: {}", queued.front());
+        }
+        else
+        {
+            spdlog::info("Queued {} tracks", queued.size());
+        }
+
+        json reply = PlayerStatusJson(player, playlist);
+        reply["ok"] = true;
+        reply["queued"] = queued.size();
+        reply["rejected"] = std::move(rejected);
+        return reply;
+    }
+    else if (cmd == "remove")
+    {
+        auto index = ParseTrackNumber(request.argument, playlist.size());
+        if (!index)
+        {
+            return ErrorReply("remove needs a track number between 1 and " + std::to_string(playlist.size()));
+        }
+        if (playlist.size() == 1)
+        {
+            return ErrorReply("cannot remove the only track");
+        }
+
+        bool removing_current = *index == playlist.currentIndex();
+        bool was_active = player.isPlaying() || player.isPaused();
+        playlist.remove(*index);
+
+        // The next track takes over, in the same play state
+        if (removing_current)
+        {
+            if (was_active)
+            {
+                PlayCurrentTrack(player, playlist);
+            }
+            else
+            {
+                player.loadFile(playlist.current().filepath);
+            }
+        }
+    }
+    else if (cmd == "move")
+    {
+        size_t space = request.argument.find(' ');
+        std::optional<size_t> from;
+        std::optional<size_t> to;
+        if (space != std::string::npos)
+        {
+            from = ParseTrackNumber(request.argument.substr(0, space), playlist.size());
+            to = ParseTrackNumber(request.argument.substr(request.argument.find_first_not_of(' ', space)), playlist.size());
+        }
+        if (!from || !to)
+        {
+            return ErrorReply("move needs two track numbers between 1 and " + std::to_string(playlist.size()));
+        }
+        playlist.move(*from, *to);
+    }
+    else if (cmd == "jump")
+    {
+        auto index = ParseTrackNumber(request.argument, playlist.size());
+        if (!index)
+        {
+            return ErrorReply("jump needs a track number between 1 and " + std::to_string(playlist.size()));
+        }
+        playlist.setIndex(*index);
+        PlayCurrentTrack(player, playlist);
+    }
+    else if (cmd == "shuffle")
+    {
+        uint64_t seed = RandomShuffleSeed();
+        if (!request.argument.empty())
+        {
+            auto [end, ec] = std::from_chars(request.argument.data(), request.argument.data() + request.argument.size(), seed);
+            if (ec != std::errc() || end != request.argument.data() + request.argument.size())
+            {
+                return ErrorReply("shuffle takes an optional numeric seed");
+            }
+        }
+        playlist.shuffle(seed);
+        spdlog::info("Upcoming tracks shuffled (seed {})", seed);
+    }
+    else if (cmd == "clear")
+    {
+        playlist.clearExceptCurrent();
+    }
+    else if (cmd == "queue")
+    {
+        json reply = PlayerStatusJson(player, playlist);
+        json queue = json::array();
+        for (size_t i = 0; i < playlist.size(); ++i)
+        {
+            // Listing the queue should not read the tags of every file
+            queue.push_back(playlist.isResolved(i) ? TrackJson(playlist.track(i)) : PathJson(playlist.path(i)));
+        }
+        reply["queue"] = std::move(queue);
+        reply["ok"] = true;
+        return reply;
+    }
+    else if (cmd == "quit")
+    {
+        running = false;
+    }
+    else
+    {
+        return ErrorReply("unknown command: " + cmd);
+    }
+
+    json reply = PlayerStatusJson(player, playlist);
+    reply["ok"] = true;
+    return reply;
+}
@@ -4,72 +4,364 @@
  */
 
 #include "playlist.h"
+#include "metadata_index.h"
+#include "shuffle.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <condition_variable>
+#include <deque>
 #include <fstream>
+#include <map>
+#include <mutex>
 #include <sstream>
 #include <iostream>
 #include <filesystem>
+#include <thread>
 
-Playlist::Playlist(const std::vector<TrackMetadata> &tracks)
-    : tracks_(tracks), current_index_(0)
+namespace
 {
+    // Below this many paths per thread a batch is resolved serially
+    constexpr size_t PATHS_PER_RESOLVE_THREAD = 256;
+
+    std::string ResolvePath(const std::string &path, const std::string &base_path, bool trust_absolute)
+    {
+        namespace fs = std::filesystem;
+
+        // Handle home directory expansion
+        std::string resolved = path;
+        if (path.starts_with("~/"))
+        {
+            const char *home = std::getenv("HOME");
+            if (home)
+            {
+                resolved = std::string(home) + path.substr(1);
+            }
+        }
+
+        // canonical() fails for missing files, so it doubles as the existence check
+        std::error_code ec;
+        fs::path p(resolved);
+        if (p.is_absolute())
+        {
+            // Trusted paths are only cleaned up, without touching the filesystem
+            if (trust_absolute)
+            {
+                return p.lexically_normal().string();
+            }
+
+            // Return canonical path if file exists, otherwise return as-is
+            fs::path canonical = fs::canonical(p, ec);
+            return ec ? resolved : canonical.string();
+        }
+
+        // Relative path - resolve against base_path
+        if (!base_path.empty())
+        {
+            fs::path canonical = fs::canonical(fs::path(base_path) / p, ec);
+            if (!ec)
+            {
+                return canonical.string();
+            }
+        }
+
+        // Try current working directory as fallback
+        fs::path canonical = fs::canonical(p, ec);
+        if (!ec)
+        {
+            return canonical.string();
+        }
+
+        // Return as-is if file doesn't exist (will fail later)
+        return resolved;
+    }
+
+    // Path and file name only, for files whose tags cannot be read
+    TrackMetadata PlaceholderTrack(std::string_view path)
+    {
+        namespace fs = std::filesystem;
+
+        TrackMetadata placeholder;
+        placeholder.filepath = path;
+        placeholder.filename = fs::path(path).filename().string();
+        placeholder.duration_ms = 0;
+        placeholder.file_mtime = 0;
+        return placeholder;
+    }
+
+    TrackMetadata ResolveTrack(const std::string &resolved_path, const MetadataIndex *index)
+    {
+        namespace fs = std::filesystem;
+
+        if (index)
+        {
+            if (auto cached = index->lookup(resolved_path))
+            {
+                return *cached;
+            }
+        }
+
+        auto metadata = MetadataExtractor::extract(resolved_path, false);
+        if (metadata)
+        {
+            return *metadata;
+        }
+
+        // Create minimal metadata with just filepath
+        TrackMetadata minimal = PlaceholderTrack(resolved_path);
+        minimal.title = fs::path(resolved_path).stem().string();
+        return minimal;
+    }
+
+    // Shift one element to a new position, keeping the others in order
+    template <typename T>
+    void MoveElement(std::vector<T> &items, size_t from, size_t to)
+    {
+        if (from < to)
+        {
+            std::rotate(items.begin() + from, items.begin() + from + 1, items.begin() + to + 1);
+        }
+        else if (to < from)
+        {
+            std::rotate(items.begin() + to, items.begin() + from, items.begin() + from + 1);
+        }
+    }
+
+    // Element begin + i becomes the former element begin + order[i]
+    template <typename T>
+    void ReorderRange(std::vector<T> &items, size_t begin, const std::vector<size_t> &order)
+    {
+        std::vector<T> reordered;
+        reordered.reserve(order.size());
+        for (size_t index : order)
+        {
+            reordered.push_back(items[begin + index]);
+        }
+        std::copy(reordered.begin(), reordered.end(), items.begin() + begin);
+    }
+}
+
+// Resolves upcoming tracks on a worker thread. Results are keyed by the
+// playlist path and adopted by the playlist when the track is accessed.
+class MetadataPrefetcher
+{
+public:
+    MetadataPrefetcher(const std::string &base_path, bool trust_absolute, std::shared_ptr<const MetadataIndex> index)
+        : base_path_(base_path), trust_absolute_(trust_absolute), index_(std::move(index)),
+          thread_(&MetadataPrefetcher::run, this)
+    {
+    }
+
+    ~MetadataPrefetcher()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        cv_.notify_one();
+        thread_.join();
+    }
+
+    // Replace the pending work; results for paths no longer wanted are dropped
+    void request(const std::vector<std::string> &paths)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            queue_.assign(paths.begin(), paths.end());
+            for (auto it = ready_.begin(); it != ready_.end();)
+            {
+                if (std::find(paths.begin(), paths.end(), it->first) == paths.end())
+                {
+                    it = ready_.erase(it);
+                }
+                else
+                {
+                    ++it;
+                }
+            }
+        }
+        cv_.notify_one();
+    }
+
+    std::optional<TrackMetadata> take(const std::string &path)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = ready_.find(path);
+        if (it == ready_.end())
+        {
+            return std::nullopt;
+        }
+        TrackMetadata track = std::move(it->second);
+        ready_.erase(it);
+        return track;
+    }
+
+private:
+    void run()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (true)
+        {
+            cv_.wait(lock, [this]()
+                     { return stop_ || !queue_.empty(); });
+            if (stop_)
+            {
+                return;
+            }
+
+            std::string path = std::move(queue_.front());
+            queue_.pop_front();
+            if (ready_.count(path))
+            {
+                continue;
+            }
+
+            lock.unlock();
+            TrackMetadata track = ResolveTrack(ResolvePath(path, base_path_, trust_absolute_), index_.get());
+            lock.lock();
+            ready_[path] = std::move(track);
+        }
+    }
+
+    std::string base_path_;
+    bool trust_absolute_;
+    std::shared_ptr<const MetadataIndex> index_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<std::string> queue_;
+    std::map<std::string, TrackMetadata> ready_;
+    bool stop_ = false;
+    std::thread thread_;
+};
+
+Playlist::Playlist(const std::string &base_path)
+    : store_(std::make_unique<TrackStore>()), base_path_(base_path), current_index_(0)
+{
+}
+
+// Out of line so the prefetcher is a complete type where it is destroyed
+Playlist::Playlist(Playlist &&) = default;
+Playlist &Playlist::operator=(Playlist &&) = default;
+Playlist::~Playlist() = default;
+
+void Playlist::addEntry(std::string_view path, std::optional<TrackMetadata> metadata)
+{
+    if (metadata)
+    {
+        track_ids_.push_back(store_->add(std::move(*metadata)));
+        paths_.push_back({});
+    }
+    else
+    {
+        track_ids_.push_back(TrackStore::NO_TRACK);
+        paths_.push_back(path);
+    }
+    path_resolved_.push_back(false);
+
+    // Tracks streamed in right behind the current one
+    if (look_ahead_ > 0 && track_ids_.size() <= current_index_ + 1 + look_ahead_)
+    {
+        scheduleLookAhead();
+    }
 }
 
-Playlist::Playlist(const std::vector<std::string> &paths, const std::string &base_path)
-    : paths_(paths), base_path_(base_path), current_index_(0)
+Playlist Playlist::fromTracks(std::vector<TrackMetadata> tracks)
 {
+    Playlist playlist("");
+    playlist.track_ids_.reserve(tracks.size());
+    playlist.paths_.reserve(tracks.size(), 0);
+    for (auto &track : tracks)
+    {
+        playlist.addEntry({}, std::move(track));
+    }
+    return playlist;
 }
 
-Playlist Playlist::fromTracks(const std::vector<TrackMetadata> &tracks)
+std::string_view Playlist::path(size_t index) const
 {
-    return Playlist(tracks);
+    if (track_ids_[index] != TrackStore::NO_TRACK)
+    {
+        return store_->get(track_ids_[index]).filepath;
+    }
+    return paths_[index];
 }
 
-std::string Playlist::resolvePath(const std::string &path) const
+std::string_view Playlist::resolvedPath(size_t index) const
 {
-    namespace fs = std::filesystem;
+    // Memoized in place of the path as written
+    if (track_ids_[index] == TrackStore::NO_TRACK && !path_resolved_[index])
+    {
+        paths_.replace(index, ResolvePath(std::string(paths_[index]), base_path_, trust_absolute_paths_));
+        path_resolved_[index] = true;
+    }
+    return path(index);
+}
 
-    // Handle home directory expansion
-    std::string resolved = path;
-    if (path.starts_with("~/"))
+void Playlist::resolvePaths() const
+{
+    std::vector<size_t> pending;
+    for (size_t i = 0; i < track_ids_.size(); ++i)
     {
-        const char *home = std::getenv("HOME");
-        if (home)
+        if (track_ids_[i] == TrackStore::NO_TRACK && !path_resolved_[i])
         {
-            resolved = std::string(home) + path.substr(1);
+            pending.push_back(i);
         }
     }
 
-    // Check if absolute path
-    fs::path p(resolved);
-    if (p.is_absolute())
+    // Each path is a few stat/readlink round trips; on a network mount they
+    // dominate, so large batches are split across threads. Threads only
+    // read the arena; results are stored once they have all finished.
+    std::vector<std::string> resolved(pending.size());
+    size_t thread_count = std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()),
+                                           pending.size() / PATHS_PER_RESOLVE_THREAD + 1);
+    auto resolveRange = [this, &pending, &resolved](size_t begin, size_t end)
     {
-        // Return canonical path if file exists, otherwise return as-is
-        if (fs::exists(p))
+        for (size_t i = begin; i < end; ++i)
         {
-            return fs::canonical(p).string();
+            resolved[i] = ResolvePath(std::string(paths_[pending[i]]), base_path_, trust_absolute_paths_);
         }
-        return resolved;
-    }
+    };
 
-    // Relative path - resolve against base_path_
-    if (!base_path_.empty())
+    if (thread_count <= 1)
     {
-        fs::path base(base_path_);
-        fs::path full = base / p;
-        if (fs::exists(full))
+        resolveRange(0, pending.size());
+    }
+    else
+    {
+        std::vector<std::thread> threads;
+        size_t chunk = (pending.size() + thread_count - 1) / thread_count;
+        for (size_t begin = 0; begin < pending.size(); begin += chunk)
         {
-            return fs::canonical(full).string();
+            threads.emplace_back(resolveRange, begin, std::min(pending.size(), begin + chunk));
+        }
+        for (auto &thread : threads)
+        {
+            thread.join();
         }
     }
 
-    // Try current working directory as fallback
-    if (fs::exists(p))
+    for (size_t i = 0; i < pending.size(); ++i)
+    {
+        paths_.replace(pending[i], resolved[i]);
+        path_resolved_[pending[i]] = true;
+    }
+}
+
+void Playlist::setTrustAbsolutePaths(bool trust)
+{
+    if (trust == trust_absolute_paths_)
     {
-        return fs::canonical(p).string();
+        return;
     }
+    trust_absolute_paths_ = trust;
 
-    // Return as-is if file doesn't exist (will fail later)
-    return resolved;
+    // The worker resolves paths on its own, so start a fresh one
+    prefetcher_.reset();
+    scheduleLookAhead();
 }
 
 std::optional<Playlist> Playlist::fromPaths(const std::vector<std::string> &paths, const std::string &base_path)
@@ -80,83 +372,147 @@ std::optional<Playlist> Playlist::fromPaths(const std::vector<std::string> &path
         return std::nullopt;
     }
 
-    return Playlist(paths, base_path);
+    size_t bytes = 0;
+    for (const auto &path : paths)
+    {
+        bytes += path.size();
+    }
+
+    Playlist playlist(base_path);
+    playlist.paths_.reserve(paths.size(), bytes);
+    playlist.track_ids_.reserve(paths.size());
+    for (const auto &path : paths)
+    {
+        playlist.addEntry(path);
+    }
+    return playlist;
 }
 
-std::optional<Playlist> Playlist::fromTextFile(const std::string &filepath)
+namespace
 {
-    std::ifstream file(filepath);
-    if (!file.is_open())
+    // Contents of a playlist file. Regular files are mapped rather than
+    // copied into memory; pipes and other special files are read.
+    class PlaylistFileContent
     {
-        std::cerr << "Error: Could not open playlist file: " << filepath << std::endl;
-        return std::nullopt;
-    }
+    public:
+        explicit PlaylistFileContent(const std::string &filepath)
+        {
+            int fd = open(filepath.c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd < 0)
+            {
+                std::cerr << "Error: Could not open playlist file: " << filepath << std::endl;
+                return;
+            }
+            open_ = true;
 
-    std::vector<std::string> paths;
-    std::string line;
+            struct stat st;
+            if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode))
+            {
+                size_ = static_cast<size_t>(st.st_size);
+                if (size_ > 0)
+                {
+                    void *data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+                    if (data != MAP_FAILED)
+                    {
+                        madvise(data, size_, MADV_SEQUENTIAL);
+                        mapping_ = data;
+                        close(fd);
+                        return;
+                    }
+                }
+            }
+            size_ = 0;
 
-    // Store base directory for relative path resolution
-    namespace fs = std::filesystem;
-    std::string base_dir = fs::path(filepath).parent_path().string();
+            char chunk[64 * 1024];
+            ssize_t count;
+            while ((count = read(fd, chunk, sizeof(chunk))) > 0 || (count < 0 && errno == EINTR))
+            {
+                buffer_.append(chunk, std::max<ssize_t>(count, 0));
+            }
+            close(fd);
+        }
 
-    while (std::getline(file, line))
-    {
-        // Trim whitespace
-        line.erase(0, line.find_first_not_of(" \t\r\n"));
-        line.erase(line.find_last_not_of(" \t\r\n") + 1);
+        ~PlaylistFileContent()
+        {
+            if (mapping_)
+            {
+                munmap(mapping_, size_);
+            }
+        }
+
+        PlaylistFileContent(const PlaylistFileContent &) = delete;
+        PlaylistFileContent &operator=(const PlaylistFileContent &) = delete;
 
-        // Skip empty lines and comments
-        if (line.empty() || line[0] == '#')
+        bool isOpen() const { return open_; }
+
+        std::string_view view() const
         {
-            continue;
+            return mapping_ ? std::string_view(static_cast<const char *>(mapping_), size_) : std::string_view(buffer_);
         }
 
-        paths.push_back(line);
-    }
+    private:
+        bool open_ = false;
+        void *mapping_ = nullptr;
+        size_t size_ = 0;
+        std::string buffer_;
+    };
+}
 
-    if (paths.empty())
+std::optional<Playlist> Playlist::fromTextFile(const std::string &filepath)
+{
+    PlaylistFileContent content(filepath);
+    if (!content.isOpen())
     {
-        std::cerr << "Error: Playlist contains no valid paths" << std::endl;
         return std::nullopt;
     }
 
-    return fromPaths(paths, base_dir);
+    // Store base directory for relative path resolution
+    namespace fs = std::filesystem;
+    return fromText(content.view(), fs::path(filepath).parent_path().string());
 }
 
 std::optional<Playlist> Playlist::fromFile(const std::string &filepath)
 {
-    std::ifstream file(filepath);
-    if (!file.is_open())
+    namespace fs = std::filesystem;
+
+    PlaylistFileContent content(filepath);
+    if (!content.isOpen())
     {
-        std::cerr << "Error: Could not open playlist file: " << filepath << std::endl;
         return std::nullopt;
     }
 
-    // Text format (only format supported)
-    file.close();
-    return fromTextFile(filepath);
+    std::string base_dir = fs::path(filepath).parent_path().string();
+    std::string extension = fs::path(filepath).extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(),
+                   [](unsigned char c)
+                   { return std::tolower(c); });
+
+    if (extension == ".m3u" || extension == ".m3u8")
+    {
+        return fromM3u(content.view(), base_dir);
+    }
+    if (extension == ".pls")
+    {
+        return fromPls(content.view(), base_dir);
+    }
+    if (extension == ".xspf")
+    {
+        return fromXspf(content.view(), base_dir);
+    }
+
+    // Anything else is sniffed, falling back to one path per line
+    return fromString(content.view(), base_dir);
 }
 
 std::string Playlist::toText() const
 {
     std::ostringstream output;
 
-    // If we have paths, use those (new format)
-    if (!paths_.empty())
-    {
-        for (const auto &path : paths_)
-        {
-            // Resolve to absolute path
-            output << resolvePath(path) << "\n";
-        }
-    }
-    else if (!tracks_.empty())
+    // Resolve to absolute paths, once per playlist
+    resolvePaths();
+    for (size_t i = 0; i < size(); ++i)
     {
-        // If we have tracks, extract paths (for backward compatibility)
-        for (const auto &track : tracks_)
-        {
-            output << track.filepath << "\n";
-        }
+        output << path(i) << "\n";
     }
 
     return output.str();
@@ -169,46 +525,65 @@ std::string Playlist::toM3u() const
     // M3U header
     output << "#EXTM3U\n";
 
-    // If we have tracks with metadata, use extended M3U format
-    if (!tracks_.empty())
+    resolvePaths();
+
+    for (size_t i = 0; i < size(); ++i)
     {
-        for (const auto &track : tracks_)
+        // Tracks without metadata yet get -1 (unknown duration) rather than
+        // opening every file here
+        if (!isResolved(i))
         {
-            // Calculate duration in seconds
-            int duration_seconds = static_cast<int>(track.duration_ms / 1000);
+            output << "#EXTINF:-1,\n";
+            output << path(i) << "\n";
+            continue;
+        }
 
-            // Build display name: "Artist - Title" or just title or filename
-            std::string display_name;
-            if (track.artist.has_value() && track.title.has_value())
-            {
-                display_name = track.artist.value() + " - " + track.title.value();
-            }
-            else if (track.title.has_value())
-            {
-                display_name = track.title.value();
-            }
-            else
-            {
-                display_name = track.filename;
-            }
+        const TrackMetadata &track = store_->get(track_ids_[i]);
 
-            // Write EXTINF line: #EXTINF:duration,display name
-            output << "#EXTINF:" << duration_seconds << "," << display_name << "\n";
+        // Calculate duration in seconds
+        int duration_seconds = static_cast<int>(track.duration_ms / 1000);
 
-            // Write file path
-            output << track.filepath << "\n";
+        // Build display name: "Artist - Title" or just title or filename
+        std::string display_name;
+        if (track.artist.has_value() && track.title.has_value())
+        {
+            display_name = track.artist.value() + " - " + track.title.value();
         }
-    }
-    else if (!paths_.empty())
-    {
-        // If we only have paths (no metadata), write simple M3U format
-        for (const auto &path : paths_)
+        else if (track.title.has_value())
         {
-            // Write EXTINF with -1 (unknown duration)
-            output << "#EXTINF:-1,\n";
-            // Write resolved path
-            output << resolvePath(path) << "\n";
+            display_name = track.title.value();
         }
+        else
+        {
+            display_name = track.filename;
+        }
+
+        // Write EXTINF line: #EXTINF:duration,display name
+        output << "#EXTINF:" << duration_seconds << "," << display_name << "\n";
+
+        // Extension tags let fromM3u() skip reading the file's own tags.
+        // #EXTART goes in even when empty, so the display name is never
+        // split to guess an artist.
+        output << "#EXTART:" << track.artist.value_or("") << "\n";
+        if (track.album.has_value())
+        {
+            output << "#EXTALB:" << track.album.value() << "\n";
+        }
+        if (track.genre.has_value())
+        {
+            output << "#EXTGENRE:" << track.genre.value() << "\n";
+        }
+        if (track.year.has_value())
+        {
+            output << "#VIBE-YEAR:" << track.year.value() << "\n";
+        }
+        if (track.file_mtime != 0)
+        {
+            output << "#VIBE-MTIME:" << track.file_mtime << "\n";
+        }
+
+        // Write file path
+        output << track.filepath << "\n";
     }
 
     return output.str();
@@ -236,30 +611,48 @@ bool Playlist::saveToFile(const std::string &filepath, PlaylistFormat format) co
 
 const TrackMetadata &Playlist::current() const
 {
-    return tracks_[current_index_];
+    return track(current_index_);
 }
 
-const std::string &Playlist::currentPath() const
+const TrackMetadata &Playlist::track(size_t index) const
 {
-    if (!paths_.empty())
+    if (track_ids_[index] == TrackStore::NO_TRACK)
     {
-        return paths_[current_index_];
+        std::optional<TrackMetadata> prefetched;
+        if (prefetcher_)
+        {
+            prefetched = prefetcher_->take(std::string(paths_[index]));
+        }
+        TrackMetadata resolved = prefetched ? std::move(*prefetched)
+                                            : ResolveTrack(std::string(resolvedPath(index)), index_.get());
+        track_ids_[index] = store_->add(std::move(resolved));
+
+        // The stored track carries the path from now on
+        paths_.replace(index, {});
     }
-    // Fallback to filepath from metadata
-    static std::string empty_path;
-    if (!tracks_.empty() && current_index_ < tracks_.size())
+    return store_->get(track_ids_[index]);
+}
+
+bool Playlist::isResolved(size_t index) const
+{
+    return index < track_ids_.size() && track_ids_[index] != TrackStore::NO_TRACK;
+}
+
+std::string_view Playlist::currentPath() const
+{
+    if (current_index_ < size())
     {
-        return tracks_[current_index_].filepath;
+        return path(current_index_);
     }
-    return empty_path;
+    return {};
 }
 
 bool Playlist::advance()
 {
-    size_t total_size = !paths_.empty() ? paths_.size() : tracks_.size();
-    if (current_index_ < total_size - 1)
+    if (current_index_ + 1 < size())
     {
         current_index_++;
+        scheduleLookAhead();
         return true;
     }
     return false;
@@ -270,6 +663,7 @@ bool Playlist::previous()
     if (current_index_ > 0)
     {
         current_index_--;
+        scheduleLookAhead();
         return true;
     }
     return false;
@@ -282,13 +676,12 @@ bool Playlist::hasPrevious() const
 
 bool Playlist::hasNext() const
 {
-    size_t total_size = !paths_.empty() ? paths_.size() : tracks_.size();
-    return current_index_ < total_size - 1;
+    return current_index_ + 1 < size();
 }
 
 size_t Playlist::size() const
 {
-    return !paths_.empty() ? paths_.size() : tracks_.size();
+    return track_ids_.size();
 }
 
 size_t Playlist::currentIndex() const
@@ -298,56 +691,203 @@ size_t Playlist::currentIndex() const
 
 void Playlist::setIndex(size_t index)
 {
-    size_t total_size = !paths_.empty() ? paths_.size() : tracks_.size();
-    if (index < total_size)
+    if (index < size())
     {
         current_index_ = index;
+        scheduleLookAhead();
     }
 }
 
 void Playlist::reset()
 {
     current_index_ = 0;
+    scheduleLookAhead();
 }
 
-void Playlist::extractAllMetadata()
+void Playlist::append(const TrackMetadata &track)
+{
+    insert(size(), track);
+}
+
+void Playlist::insert(size_t position, const TrackMetadata &track)
+{
+    size_t total_size = size();
+    position = std::min(position, total_size);
+
+    track_ids_.insert(track_ids_.begin() + position, store_->add(track));
+    paths_.insert(position, {});
+    path_resolved_.insert(path_resolved_.begin() + position, false);
+
+    if (total_size > 0 && position <= current_index_)
+    {
+        current_index_++;
+    }
+    scheduleLookAhead();
+}
+
+void Playlist::insertPaths(size_t position, const std::vector<std::string> &paths)
+{
+    size_t total_size = size();
+    position = std::min(position, total_size);
+
+    // Appended and rotated into place, rather than shifting every later
+    // entry once per path
+    for (const auto &path : paths)
+    {
+        paths_.push_back(path);
+    }
+    if (position < total_size)
+    {
+        std::vector<size_t> order(paths_.size() - position);
+        for (size_t i = 0; i < order.size(); ++i)
+        {
+            order[i] = (i + total_size - position) % order.size();
+        }
+        paths_.reorder(position, order);
+    }
+    track_ids_.insert(track_ids_.begin() + position, paths.size(), TrackStore::NO_TRACK);
+    path_resolved_.insert(path_resolved_.begin() + position, paths.size(), false);
+
+    if (total_size > 0 && position <= current_index_)
+    {
+        current_index_ += paths.size();
+    }
+    scheduleLookAhead();
+}
+
+bool Playlist::remove(size_t index)
+{
+    size_t total_size = size();
+    if (index >= total_size)
+    {
+        return false;
+    }
+
+    track_ids_.erase(track_ids_.begin() + index);
+    paths_.erase(index);
+    path_resolved_.erase(path_resolved_.begin() + index);
+
+    if (index < current_index_ || (index == current_index_ && current_index_ + 1 == total_size && current_index_ > 0))
+    {
+        current_index_--;
+    }
+    scheduleLookAhead();
+    return true;
+}
+
+bool Playlist::move(size_t from, size_t to)
+{
+    size_t total_size = size();
+    if (from >= total_size || to >= total_size)
+    {
+        return false;
+    }
+
+    MoveElement(track_ids_, from, to);
+    paths_.move(from, to);
+    MoveElement(path_resolved_, from, to);
+
+    if (from == current_index_)
+    {
+        current_index_ = to;
+    }
+    else if (from < current_index_ && to >= current_index_)
+    {
+        current_index_--;
+    }
+    else if (from > current_index_ && to <= current_index_)
+    {
+        current_index_++;
+    }
+    scheduleLookAhead();
+    return true;
+}
+
+void Playlist::clearExceptCurrent()
 {
-    // If we already have tracks, nothing to do
-    if (!tracks_.empty())
+    if (empty())
     {
         return;
     }
 
-    // Extract metadata from all paths
-    if (!paths_.empty())
+    track_ids_ = {track_ids_[current_index_]};
+    paths_.keepOnly(current_index_);
+    path_resolved_ = {static_cast<bool>(path_resolved_[current_index_])};
+    current_index_ = 0;
+}
+
+void Playlist::shuffle(uint64_t seed, bool include_current)
+{
+    size_t begin = include_current ? 0 : current_index_ + 1;
+    if (begin >= size())
+    {
+        return;
+    }
+
+    // Unresolved tracks are keyed by their directories, so shuffling a
+    // long queue reads no tags
+    std::vector<ShuffleKey> keys;
+    keys.reserve(size() - begin);
+    for (size_t i = begin; i < size(); ++i)
     {
-        tracks_.clear();
-        tracks_.reserve(paths_.size());
+        keys.push_back(isResolved(i) ? ShuffleKeyFor(store_->get(track_ids_[i])) : ShuffleKeyForPath(paths_[i]));
+    }
+
+    std::vector<size_t> order = SpreadShuffle(keys, seed);
+    ReorderRange(track_ids_, begin, order);
+    paths_.reorder(begin, order);
+    ReorderRange(path_resolved_, begin, order);
 
-        for (const auto &path : paths_)
+    if (include_current)
+    {
+        current_index_ = 0;
+    }
+    scheduleLookAhead();
+}
+
+void Playlist::enableLookAhead(size_t window)
+{
+    look_ahead_ = window;
+    scheduleLookAhead();
+}
+
+void Playlist::scheduleLookAhead() const
+{
+    std::vector<std::string> upcoming;
+    size_t end = std::min(size(), current_index_ + 1 + look_ahead_);
+    for (size_t i = current_index_ + 1; i < end; ++i)
+    {
+        if (track_ids_[i] == TrackStore::NO_TRACK)
         {
-            std::string resolved_path = resolvePath(path);
-            auto metadata = MetadataExtractor::extract(resolved_path, false);
+            upcoming.emplace_back(paths_[i]);
+        }
+    }
 
-            if (metadata)
-            {
-                tracks_.push_back(*metadata);
-            }
-            else
-            {
-                // Create minimal metadata with just filepath
-                TrackMetadata minimal;
-                minimal.filepath = resolved_path;
-
-                namespace fs = std::filesystem;
-                fs::path p(resolved_path);
-                minimal.filename = p.filename().string();
-                minimal.title = p.stem().string();
-                minimal.duration_ms = 0;
-                minimal.file_mtime = 0;
-
-                tracks_.push_back(minimal);
-            }
+    // The worker thread only starts once there is something to resolve
+    if (!prefetcher_)
+    {
+        if (upcoming.empty())
+        {
+            return;
         }
+        prefetcher_ = std::make_unique<MetadataPrefetcher>(base_path_, trust_absolute_paths_, index_);
+    }
+    prefetcher_->request(upcoming);
+}
+
+void Playlist::setMetadataIndex(std::shared_ptr<const MetadataIndex> index)
+{
+    index_ = std::move(index);
+
+    // The worker keeps its own reference, so start a fresh one
+    prefetcher_.reset();
+    scheduleLookAhead();
+}
+
+void Playlist::extractAllMetadata()
+{
+    for (size_t i = 0; i < size(); ++i)
+    {
+        track(i);
     }
 }
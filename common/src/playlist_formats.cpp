@@ -0,0 +1,777 @@
+/*
+ * vibe-player
+ * playlist_formats.cpp
+ *
+ * Readers for the playlist file formats: plain text, extended M3U/M3U8,
+ * PLS and XSPF. Entries that carry metadata (#EXTINF and friends) become
+ * resolved tracks without opening the audio files.
+ */
+
+#include "playlist.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <map>
+
+namespace
+{
+    constexpr std::string_view UTF8_BOM = "\xEF\xBB\xBF";
+    constexpr size_t STREAM_CHUNK_SIZE = 64 * 1024;
+
+    std::string_view Trim(std::string_view str)
+    {
+        size_t start = str.find_first_not_of(" \t\r\n");
+        if (start == std::string_view::npos)
+        {
+            return {};
+        }
+        size_t end = str.find_last_not_of(" \t\r\n");
+        return str.substr(start, end - start + 1);
+    }
+
+    std::string ToLower(std::string_view str)
+    {
+        std::string lower(str);
+        std::transform(lower.begin(), lower.end(), lower.begin(),
+                       [](unsigned char c)
+                       { return std::tolower(c); });
+        return lower;
+    }
+
+    // Call fn with every trimmed line, dropping a UTF-8 byte order mark.
+    // The views point into content, so nothing is copied.
+    template <typename Fn>
+    void ForEachLine(std::string_view content, Fn fn)
+    {
+        if (content.starts_with(UTF8_BOM))
+        {
+            content.remove_prefix(UTF8_BOM.size());
+        }
+
+        while (!content.empty())
+        {
+            size_t newline = content.find('\n');
+            fn(Trim(content.substr(0, newline)));
+            if (newline == std::string_view::npos)
+            {
+                break;
+            }
+            content.remove_prefix(newline + 1);
+        }
+    }
+
+    enum class ContentFormat
+    {
+        TEXT,
+        M3U,
+        PLS,
+        XSPF
+    };
+
+    // Format announced by the first meaningful line
+    ContentFormat DetectFormat(std::string_view first_line)
+    {
+        if (first_line.starts_with("#EXTM3U"))
+        {
+            return ContentFormat::M3U;
+        }
+        if (ToLower(first_line) == "[playlist]")
+        {
+            return ContentFormat::PLS;
+        }
+        if (first_line.starts_with("<?xml") || first_line.starts_with("<playlist"))
+        {
+            return ContentFormat::XSPF;
+        }
+        return ContentFormat::TEXT;
+    }
+
+    std::optional<int64_t> ParseInteger(std::string_view str)
+    {
+        int64_t value = 0;
+        auto [end, ec] = std::from_chars(str.data(), str.data() + str.size(), value);
+        if (ec != std::errc() || end != str.data() + str.size())
+        {
+            return std::nullopt;
+        }
+        return value;
+    }
+
+    // Decode %XX escapes of a file:// URI; other URIs are returned as-is
+    std::string UriToPath(std::string_view uri)
+    {
+        if (!uri.starts_with("file://"))
+        {
+            return std::string(uri);
+        }
+
+        std::string_view encoded = uri.substr(7);
+        // file://localhost/path
+        if (encoded.starts_with("localhost/"))
+        {
+            encoded.remove_prefix(9);
+        }
+
+        std::string path;
+        path.reserve(encoded.size());
+        for (size_t i = 0; i < encoded.size(); ++i)
+        {
+            unsigned int byte = 0;
+            if (encoded[i] == '%' && i + 2 < encoded.size() &&
+                std::from_chars(encoded.data() + i + 1, encoded.data() + i + 3, byte, 16).ptr == encoded.data() + i + 3)
+            {
+                path += static_cast<char>(byte);
+                i += 2;
+            }
+            else
+            {
+                path += encoded[i];
+            }
+        }
+        return path;
+    }
+
+    // Absolute path for a playlist entry without touching the filesystem
+    std::string LexicalPath(const std::string &path, const std::string &base_path)
+    {
+        namespace fs = std::filesystem;
+
+        std::string expanded = path;
+        if (path.starts_with("~/"))
+        {
+            const char *home = std::getenv("HOME");
+            if (home)
+            {
+                expanded = std::string(home) + path.substr(1);
+            }
+        }
+
+        fs::path p(expanded);
+        if (p.is_relative() && !base_path.empty())
+        {
+            p = fs::path(base_path) / p;
+        }
+
+        std::error_code ec;
+        fs::path absolute = fs::absolute(p, ec);
+        return (ec ? p : absolute).lexically_normal().string();
+    }
+
+    // "Artist - Title" as written by toM3u(), or just a title. artist_tag
+    // is the #EXTART line, if there was one: its artist is trusted and
+    // only stripped from the display name, which is split on " - " only
+    // for playlists without it.
+    void ApplyDisplayName(TrackMetadata &track, std::string_view display_name,
+                          const std::optional<std::string> &artist_tag = std::nullopt)
+    {
+        if (artist_tag)
+        {
+            if (!artist_tag->empty())
+            {
+                track.artist = *artist_tag;
+                std::string prefix = *artist_tag + " - ";
+                if (display_name.starts_with(prefix))
+                {
+                    display_name.remove_prefix(prefix.size());
+                }
+            }
+            if (!display_name.empty() && display_name != track.filename)
+            {
+                track.title = std::string(display_name);
+            }
+            return;
+        }
+
+        if (display_name.empty() || display_name == track.filename)
+        {
+            return;
+        }
+
+        size_t separator = display_name.find(" - ");
+        if (separator != std::string_view::npos)
+        {
+            track.artist = std::string(display_name.substr(0, separator));
+            track.title = std::string(display_name.substr(separator + 3));
+        }
+        else
+        {
+            track.title = std::string(display_name);
+        }
+    }
+
+    TrackMetadata DescribedTrack(const std::string &path, const std::string &base_path)
+    {
+        namespace fs = std::filesystem;
+
+        TrackMetadata track;
+        track.filepath = LexicalPath(path, base_path);
+        track.filename = fs::path(track.filepath).filename().string();
+        track.duration_ms = 0;
+        track.file_mtime = 0;
+        return track;
+    }
+
+    struct ParsedEntry
+    {
+        std::string path;
+        std::optional<TrackMetadata> metadata;
+    };
+
+    // One trimmed M3U line. Tag lines accumulate in pending, which
+    // describes the next path line; a path line yields an entry.
+    std::optional<ParsedEntry> ParseM3uLine(std::string_view line, std::optional<TrackMetadata> &pending,
+                                            const std::string &base_path)
+    {
+        if (line.empty() || line.starts_with("#EXTM3U"))
+        {
+            return std::nullopt;
+        }
+
+        if (line[0] == '#')
+        {
+            if (!pending)
+            {
+                pending = TrackMetadata();
+                pending->duration_ms = -1;
+                pending->file_mtime = 0;
+            }
+
+            if (line.starts_with("#EXTINF:"))
+            {
+                // #EXTINF:<seconds>[ attributes],<display name>
+                std::string_view info = line.substr(8);
+                size_t comma = info.find(',');
+                std::string_view seconds = info.substr(0, std::min(comma, info.find(' ')));
+                if (auto value = ParseInteger(seconds); value && *value >= 0)
+                {
+                    pending->duration_ms = *value * 1000;
+                }
+                if (comma != std::string_view::npos)
+                {
+                    pending->title = std::string(Trim(info.substr(comma + 1)));
+                }
+            }
+            else if (line.starts_with("#EXTART:"))
+            {
+                pending->artist = std::string(Trim(line.substr(8)));
+            }
+            else if (line.starts_with("#EXTALB:"))
+            {
+                pending->album = std::string(Trim(line.substr(8)));
+            }
+            else if (line.starts_with("#EXTGENRE:"))
+            {
+                pending->genre = std::string(Trim(line.substr(10)));
+            }
+            else if (line.starts_with("#VIBE-YEAR:"))
+            {
+                if (auto value = ParseInteger(Trim(line.substr(11))))
+                {
+                    pending->year = static_cast<int>(*value);
+                }
+            }
+            else if (line.starts_with("#VIBE-MTIME:"))
+            {
+                pending->file_mtime = ParseInteger(Trim(line.substr(12))).value_or(0);
+            }
+            return std::nullopt;
+        }
+
+        ParsedEntry entry{UriToPath(line), std::nullopt};
+
+        // "#EXTINF:-1," carries nothing worth trusting over the file's tags
+        bool described = pending && (pending->duration_ms >= 0 ||
+                                     (pending->title && !pending->title->empty()) ||
+                                     (pending->artist && !pending->artist->empty()) ||
+                                     pending->album || pending->genre || pending->year);
+        if (described)
+        {
+            TrackMetadata track = DescribedTrack(entry.path, base_path);
+
+            // Written by toM3u() with the file's mtime: a file changed (or
+            // gone) since is read again like an undescribed entry
+            if (pending->file_mtime != 0 &&
+                MetadataExtractor::getFileModificationTime(track.filepath) != pending->file_mtime)
+            {
+                pending.reset();
+                return entry;
+            }
+            ApplyDisplayName(track, pending->title.value_or(""), pending->artist);
+            track.album = std::move(pending->album);
+            track.genre = std::move(pending->genre);
+            track.year = pending->year;
+            track.duration_ms = std::max<int64_t>(pending->duration_ms, 0);
+            track.file_mtime = pending->file_mtime;
+            entry.metadata = std::move(track);
+        }
+        pending.reset();
+        return entry;
+    }
+
+    std::string DecodeXmlEntities(std::string_view text)
+    {
+        std::string decoded;
+        decoded.reserve(text.size());
+        for (size_t i = 0; i < text.size(); ++i)
+        {
+            if (text[i] != '&')
+            {
+                decoded += text[i];
+                continue;
+            }
+
+            size_t semicolon = text.find(';', i);
+            if (semicolon == std::string_view::npos)
+            {
+                decoded += text[i];
+                continue;
+            }
+
+            std::string_view entity = text.substr(i + 1, semicolon - i - 1);
+            if (entity == "amp")
+                decoded += '&';
+            else if (entity == "lt")
+                decoded += '<';
+            else if (entity == "gt")
+                decoded += '>';
+            else if (entity == "quot")
+                decoded += '"';
+            else if (entity == "apos")
+                decoded += '\'';
+            else if (entity.starts_with("#"))
+            {
+                // Numeric character reference, encoded back to UTF-8
+                bool hex = entity.starts_with("#x");
+                std::string_view digits = entity.substr(hex ? 2 : 1);
+                uint32_t code = 0;
+                auto [end, ec] = std::from_chars(digits.data(), digits.data() + digits.size(), code, hex ? 16 : 10);
+                if (ec != std::errc() || end != digits.data() + digits.size())
+                {
+                    decoded += text.substr(i, semicolon - i + 1);
+                    i = semicolon;
+                    continue;
+                }
+                if (code < 0x80)
+                {
+                    decoded += static_cast<char>(code);
+                }
+                else if (code < 0x800)
+                {
+                    decoded += static_cast<char>(0xC0 | (code >> 6));
+                    decoded += static_cast<char>(0x80 | (code & 0x3F));
+                }
+                else if (code < 0x10000)
+                {
+                    decoded += static_cast<char>(0xE0 | (code >> 12));
+                    decoded += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+                    decoded += static_cast<char>(0x80 | (code & 0x3F));
+                }
+                else
+                {
+                    decoded += static_cast<char>(0xF0 | (code >> 18));
+                    decoded += static_cast<char>(0x80 | ((code >> 12) & 0x3F));
+                    decoded += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+                    decoded += static_cast<char>(0x80 | (code & 0x3F));
+                }
+            }
+            else
+            {
+                decoded += text.substr(i, semicolon - i + 1);
+            }
+            i = semicolon;
+        }
+        return decoded;
+    }
+
+    // Text of the first <tag>...</tag> inside element, if any
+    std::optional<std::string> XmlElementText(std::string_view element, const std::string &tag)
+    {
+        std::string open = "<" + tag + ">";
+        std::string close = "</" + tag + ">";
+        size_t start = element.find(open);
+        if (start == std::string_view::npos)
+        {
+            return std::nullopt;
+        }
+        start += open.size();
+        size_t end = element.find(close, start);
+        if (end == std::string_view::npos)
+        {
+            return std::nullopt;
+        }
+        return std::string(Trim(DecodeXmlEntities(element.substr(start, end - start))));
+    }
+}
+
+std::optional<Playlist> Playlist::fromString(std::string_view content, const std::string &base_path)
+{
+    // Sniff the first meaningful line
+    ContentFormat format = ContentFormat::TEXT;
+    bool detected = false;
+    ForEachLine(content, [&](std::string_view line)
+                {
+        if (!detected && !line.empty())
+        {
+            format = DetectFormat(line);
+            detected = true;
+        } });
+
+    switch (format)
+    {
+    case ContentFormat::M3U:
+        return fromM3u(content, base_path);
+    case ContentFormat::PLS:
+        return fromPls(content, base_path);
+    case ContentFormat::XSPF:
+        return fromXspf(content, base_path);
+    case ContentFormat::TEXT:
+        break;
+    }
+    return fromText(content, base_path);
+}
+
+std::optional<Playlist> Playlist::fromText(std::string_view content, const std::string &base_path)
+{
+    // Paths go straight from the (possibly mapped) content into the arena
+    Playlist playlist(base_path);
+    ForEachLine(content, [&](std::string_view line)
+                {
+        // Skip empty lines and comments
+        if (!line.empty() && line[0] != '#')
+        {
+            playlist.addEntry(line);
+        } });
+
+    if (playlist.empty())
+    {
+        std::cerr << "Error: Playlist contains no valid paths" << std::endl;
+        return std::nullopt;
+    }
+    return playlist;
+}
+
+std::optional<Playlist> Playlist::fromM3u(std::string_view content, const std::string &base_path)
+{
+    Playlist playlist(base_path);
+    std::optional<TrackMetadata> pending;
+    ForEachLine(content, [&](std::string_view line)
+                {
+        if (auto entry = ParseM3uLine(line, pending, base_path))
+        {
+            playlist.addEntry(entry->path, std::move(entry->metadata));
+        } });
+
+    if (playlist.empty())
+    {
+        std::cerr << "Error: Playlist contains no valid paths" << std::endl;
+        return std::nullopt;
+    }
+    return playlist;
+}
+
+std::optional<Playlist> Playlist::fromPls(std::string_view content, const std::string &base_path)
+{
+    // FileN=, TitleN=, LengthN= keyed by N, in N order
+    struct PlsEntry
+    {
+        std::string file;
+        std::string title;
+        std::optional<int64_t> length;
+    };
+    std::map<int64_t, PlsEntry> numbered;
+
+    ForEachLine(content, [&](std::string_view line)
+                {
+        size_t equals = line.find('=');
+        if (equals == std::string_view::npos)
+        {
+            return;
+        }
+
+        std::string key = ToLower(Trim(line.substr(0, equals)));
+        std::string_view value = Trim(line.substr(equals + 1));
+        size_t digits = key.find_first_of("0123456789");
+        if (digits == std::string::npos)
+        {
+            return;
+        }
+        auto number = ParseInteger(std::string_view(key).substr(digits));
+        if (!number)
+        {
+            return;
+        }
+
+        std::string field = key.substr(0, digits);
+        PlsEntry &entry = numbered[*number];
+        if (field == "file")
+        {
+            entry.file = value;
+        }
+        else if (field == "title")
+        {
+            entry.title = value;
+        }
+        else if (field == "length")
+        {
+            entry.length = ParseInteger(value);
+        } });
+
+    Playlist playlist(base_path);
+    for (const auto &[number, pls] : numbered)
+    {
+        if (pls.file.empty())
+        {
+            continue;
+        }
+
+        std::string path = UriToPath(pls.file);
+        std::optional<TrackMetadata> metadata;
+        if (!pls.title.empty() || (pls.length && *pls.length >= 0))
+        {
+            TrackMetadata track = DescribedTrack(path, base_path);
+            ApplyDisplayName(track, pls.title);
+            track.duration_ms = pls.length && *pls.length > 0 ? *pls.length * 1000 : 0;
+            metadata = std::move(track);
+        }
+        playlist.addEntry(path, std::move(metadata));
+    }
+
+    if (playlist.empty())
+    {
+        std::cerr << "Error: Playlist contains no valid paths" << std::endl;
+        return std::nullopt;
+    }
+    return playlist;
+}
+
+std::optional<Playlist> Playlist::fromXspf(std::string_view content, const std::string &base_path)
+{
+    Playlist playlist(base_path);
+
+    // Only <track> elements matter; this is not a general XML parser
+    size_t pos = 0;
+    while ((pos = content.find("<track>", pos)) != std::string_view::npos)
+    {
+        size_t end = content.find("</track>", pos);
+        if (end == std::string_view::npos)
+        {
+            break;
+        }
+        std::string_view element = content.substr(pos, end - pos);
+        pos = end;
+
+        auto location = XmlElementText(element, "location");
+        if (!location || location->empty())
+        {
+            continue;
+        }
+
+        std::string path = UriToPath(*location);
+        TrackMetadata track = DescribedTrack(path, base_path);
+        track.title = XmlElementText(element, "title");
+        track.artist = XmlElementText(element, "creator");
+        track.album = XmlElementText(element, "album");
+        if (auto duration = XmlElementText(element, "duration"))
+        {
+            track.duration_ms = ParseInteger(*duration).value_or(0);
+        }
+
+        std::optional<TrackMetadata> metadata;
+        if (track.title || track.artist || track.album || track.duration_ms > 0)
+        {
+            metadata = std::move(track);
+        }
+        playlist.addEntry(path, std::move(metadata));
+    }
+
+    if (playlist.empty())
+    {
+        std::cerr << "Error: Playlist contains no valid paths" << std::endl;
+        return std::nullopt;
+    }
+    return playlist;
+}
+
+PlaylistStream::PlaylistStream(int fd, const std::string &base_path)
+    : fd_(fd), base_path_(base_path)
+{
+}
+
+PlaylistStream::~PlaylistStream()
+{
+    finish();
+}
+
+void PlaylistStream::finish()
+{
+    if (fd_ >= 0)
+    {
+        close(fd_);
+        fd_ = -1;
+    }
+}
+
+PlaylistStream::ReadResult PlaylistStream::readChunk()
+{
+    size_t old_size = buffer_.size();
+    buffer_.resize(old_size + STREAM_CHUNK_SIZE);
+    ssize_t count;
+    do
+    {
+        count = read(fd_, buffer_.data() + old_size, STREAM_CHUNK_SIZE);
+    } while (count < 0 && errno == EINTR);
+    buffer_.resize(old_size + std::max<ssize_t>(count, 0));
+
+    if (count > 0)
+    {
+        return ReadResult::DATA;
+    }
+    if (count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+    {
+        return ReadResult::AGAIN;
+    }
+    if (count < 0)
+    {
+        std::cerr << "Error: Could not read playlist: " << strerror(errno) << std::endl;
+    }
+    return ReadResult::END;
+}
+
+size_t PlaylistStream::consumeLine(Playlist &playlist, std::string_view line)
+{
+    if (mode_ == Mode::DETECT)
+    {
+        if (line.starts_with(UTF8_BOM))
+        {
+            line = Trim(line.substr(UTF8_BOM.size()));
+        }
+        if (line.empty())
+        {
+            return 0;
+        }
+
+        switch (DetectFormat(line))
+        {
+        case ContentFormat::TEXT:
+            mode_ = Mode::TEXT;
+            break;
+        case ContentFormat::M3U:
+            mode_ = Mode::M3U;
+            break;
+        case ContentFormat::PLS:
+        case ContentFormat::XSPF:
+            mode_ = Mode::BUFFERED;
+            return 0;
+        }
+    }
+
+    if (mode_ == Mode::M3U)
+    {
+        if (auto entry = ParseM3uLine(line, m3u_pending_, base_path_))
+        {
+            playlist.addEntry(entry->path, std::move(entry->metadata));
+            return 1;
+        }
+        return 0;
+    }
+
+    // Skip empty lines and comments
+    if (line.empty() || line[0] == '#')
+    {
+        return 0;
+    }
+    playlist.addEntry(line);
+    return 1;
+}
+
+size_t PlaylistStream::consumeLines(Playlist &playlist, bool at_end)
+{
+    size_t added = 0;
+    size_t start = 0;
+    while (mode_ != Mode::BUFFERED)
+    {
+        size_t newline = buffer_.find('\n', start);
+        if (newline == std::string::npos)
+        {
+            // A final line without a newline
+            if (at_end && start < buffer_.size())
+            {
+                added += consumeLine(playlist, Trim(std::string_view(buffer_).substr(start)));
+                start = buffer_.size();
+            }
+            break;
+        }
+        added += consumeLine(playlist, Trim(std::string_view(buffer_).substr(start, newline - start)));
+        start = newline + 1;
+    }
+
+    // PLS and XSPF keep everything for the whole-document readers
+    if (mode_ != Mode::BUFFERED)
+    {
+        buffer_.erase(0, start);
+    }
+    return added;
+}
+
+std::optional<Playlist> PlaylistStream::start()
+{
+    Playlist playlist(base_path_);
+    while (fd_ >= 0 && playlist.empty() && mode_ != Mode::BUFFERED)
+    {
+        bool more = readChunk() != ReadResult::END;
+        consumeLines(playlist, !more);
+        if (!more)
+        {
+            finish();
+        }
+    }
+
+    if (mode_ == Mode::BUFFERED)
+    {
+        while (fd_ >= 0 && readChunk() != ReadResult::END)
+        {
+        }
+        finish();
+        auto complete = Playlist::fromString(buffer_, base_path_);
+        buffer_.clear();
+        return complete;
+    }
+
+    if (playlist.empty())
+    {
+        std::cerr << "Error: Playlist contains no valid paths" << std::endl;
+        return std::nullopt;
+    }
+
+    // The rest is picked up by readAvailable() from the player's event loop
+    if (fd_ >= 0)
+    {
+        fcntl(fd_, F_SETFL, fcntl(fd_, F_GETFL) | O_NONBLOCK);
+    }
+    return playlist;
+}
+
+size_t PlaylistStream::readAvailable(Playlist &playlist)
+{
+    size_t added = 0;
+    while (fd_ >= 0)
+    {
+        ReadResult result = readChunk();
+        if (result == ReadResult::AGAIN)
+        {
+            break; // Nothing more for now
+        }
+        added += consumeLines(playlist, result == ReadResult::END);
+        if (result == ReadResult::END)
+        {
+            finish();
+        }
+    }
+    return added;
+}
@@ -0,0 +1,145 @@
+/*
+ * vibe-player
+ * shuffle.cpp
+ */
+
+#include "shuffle.h"
+#include "fnv_hash.h"
+#include <algorithm>
+#include <numeric>
+#include <random>
+#include <unordered_map>
+#include <utility>
+
+namespace
+{
+    // std::shuffle and the standard distributions differ between standard
+    // libraries; these only depend on the engine, which is fully specified
+    double UnitRandom(std::mt19937_64 &rng)
+    {
+        return static_cast<double>(rng() >> 11) * 0x1.0p-53;
+    }
+
+    // Uniform in [0, n): draws below 2^64 mod n are rejected, so every
+    // remainder is equally likely (rng() % n alone favours small values)
+    uint64_t UniformIndex(std::mt19937_64 &rng, uint64_t n)
+    {
+        uint64_t threshold = -n % n;
+        while (true)
+        {
+            uint64_t value = rng();
+            if (value >= threshold)
+            {
+                return value % n;
+            }
+        }
+    }
+
+    void ShuffleItems(std::vector<size_t> &items, std::mt19937_64 &rng)
+    {
+        for (size_t i = items.size(); i > 1; --i)
+        {
+            std::swap(items[i - 1], items[UniformIndex(rng, i)]);
+        }
+    }
+
+    // Groups in order of first appearance, so the result depends only on
+    // the input order and the seed
+    template <typename KeyFn>
+    std::vector<std::vector<size_t>> GroupBy(const std::vector<size_t> &items, KeyFn key)
+    {
+        std::unordered_map<uint64_t, size_t> group_of;
+        std::vector<std::vector<size_t>> groups;
+        for (size_t item : items)
+        {
+            auto [it, inserted] = group_of.try_emplace(key(item), groups.size());
+            if (inserted)
+            {
+                groups.emplace_back();
+            }
+            groups[it->second].push_back(item);
+        }
+        return groups;
+    }
+
+    // Give each group's members evenly spaced positions in [0, 1) from a
+    // random offset, jittered by up to a tenth of their spacing, and merge
+    // the groups by position
+    std::vector<size_t> Spread(const std::vector<std::vector<size_t>> &groups, std::mt19937_64 &rng)
+    {
+        std::vector<std::pair<double, size_t>> positioned;
+        for (const auto &group : groups)
+        {
+            double spacing = 1.0 / static_cast<double>(group.size());
+            double offset = UnitRandom(rng) * spacing;
+            for (size_t i = 0; i < group.size(); ++i)
+            {
+                double jitter = (UnitRandom(rng) - 0.5) * 0.2 * spacing;
+                positioned.emplace_back(offset + static_cast<double>(i) * spacing + jitter, group[i]);
+            }
+        }
+        std::sort(positioned.begin(), positioned.end());
+
+        std::vector<size_t> order;
+        order.reserve(positioned.size());
+        for (const auto &[position, item] : positioned)
+        {
+            order.push_back(item);
+        }
+        return order;
+    }
+}
+
+ShuffleKey ShuffleKeyForPath(std::string_view path)
+{
+    size_t file_slash = path.rfind('/');
+    std::string_view album_dir = file_slash == std::string_view::npos ? std::string_view() : path.substr(0, file_slash);
+    size_t dir_slash = album_dir.rfind('/');
+    std::string_view artist_dir = dir_slash == std::string_view::npos ? album_dir : album_dir.substr(0, dir_slash);
+    return {Fnv1aHash(artist_dir), Fnv1aHash(album_dir)};
+}
+
+ShuffleKey ShuffleKeyFor(const TrackMetadata &track)
+{
+    ShuffleKey key = ShuffleKeyForPath(track.filepath);
+    if (track.artist && !track.artist->empty())
+    {
+        key.artist = Fnv1aHash(*track.artist);
+    }
+    if (track.album && !track.album->empty())
+    {
+        // Albums only need telling apart within an artist
+        key.album = Fnv1aHash(*track.album, key.artist);
+    }
+    return key;
+}
+
+std::vector<size_t> SpreadShuffle(const std::vector<ShuffleKey> &keys, uint64_t seed)
+{
+    std::mt19937_64 rng(seed);
+
+    std::vector<size_t> all(keys.size());
+    std::iota(all.begin(), all.end(), 0);
+
+    auto artists = GroupBy(all, [&keys](size_t i)
+                           { return keys[i].artist; });
+    for (auto &artist : artists)
+    {
+        // Albums spread over the artist's tracks; tracks of an album in
+        // random order
+        auto albums = GroupBy(artist, [&keys](size_t i)
+                              { return keys[i].album; });
+        for (auto &album : albums)
+        {
+            ShuffleItems(album, rng);
+        }
+        artist = Spread(albums, rng);
+    }
+    return Spread(artists, rng);
+}
+
+uint64_t RandomShuffleSeed()
+{
+    std::random_device device;
+    return (static_cast<uint64_t>(device()) << 32) | device();
+}
@@ -0,0 +1,951 @@
+/*
+ * vibe-player
+ * tag_reader.cpp
+ */
+
+#include "tag_reader.h"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <string_view>
+#include <vector>
+
+namespace
+{
+    // Neighbouring small reads are served from one read of this size
+    constexpr size_t READ_WINDOW = 16 * 1024;
+    // Larger tag fields and blocks (embedded art, mostly) are left to TagLib
+    constexpr uint32_t MAX_FIELD_BYTES = 1024 * 1024;
+    // How far past the ID3v2 tag the first MPEG frame is looked for
+    constexpr size_t MPEG_SYNC_SEARCH_BYTES = 64 * 1024;
+    // Holds the last Ogg page, which is at most 64 KiB plus its header
+    constexpr size_t OGG_TAIL_BYTES = 64 * 1024 + 512;
+
+    // Reads through a window, so the many small reads of tag parsing cost
+    // few syscalls. The window's storage is reused from file to file.
+    class FileWindow {
+    public:
+        FileWindow(int fd, uint64_t size, std::vector<uint8_t> &data) : fd_(fd), size_(size), data_(data)
+        {
+            data_.clear();
+        }
+
+        uint64_t size() const { return size_; }
+
+        // length bytes at offset, or nullptr if they are not all in the
+        // file. Valid until the next call.
+        const uint8_t *read(uint64_t offset, size_t length)
+        {
+            if (offset > size_ || length > size_ - offset)
+            {
+                return nullptr;
+            }
+            if (offset >= start_ && offset - start_ + length <= data_.size())
+            {
+                return data_.data() + (offset - start_);
+            }
+
+            size_t wanted = static_cast<size_t>(std::min<uint64_t>(std::max(length, READ_WINDOW), size_ - offset));
+            data_.resize(wanted);
+            size_t done = 0;
+            while (done < wanted)
+            {
+                ssize_t n = pread(fd_, data_.data() + done, wanted - done, static_cast<off_t>(offset + done));
+                if (n < 0 && errno == EINTR)
+                {
+                    continue;
+                }
+                if (n <= 0)
+                {
+                    break;
+                }
+                done += static_cast<size_t>(n);
+            }
+            data_.resize(done);
+            start_ = offset;
+            return done >= length ? data_.data() : nullptr;
+        }
+
+    private:
+        int fd_;
+        uint64_t size_;
+        uint64_t start_ = 0;
+        std::vector<uint8_t> &data_;
+    };
+
+    uint32_t BigEndian32(const uint8_t *p)
+    {
+        return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | p[3];
+    }
+
+    uint32_t BigEndian24(const uint8_t *p)
+    {
+        return (uint32_t(p[0]) << 16) | (uint32_t(p[1]) << 8) | p[2];
+    }
+
+    uint16_t LittleEndian16(const uint8_t *p)
+    {
+        return static_cast<uint16_t>(p[0] | (p[1] << 8));
+    }
+
+    uint32_t LittleEndian32(const uint8_t *p)
+    {
+        return p[0] | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24);
+    }
+
+    uint64_t LittleEndian64(const uint8_t *p)
+    {
+        return LittleEndian32(p) | (uint64_t(LittleEndian32(p + 4)) << 32);
+    }
+
+    // ID3v2 sizes use 7 bits per byte
+    uint32_t Syncsafe32(const uint8_t *p)
+    {
+        return (uint32_t(p[0] & 0x7f) << 21) | (uint32_t(p[1] & 0x7f) << 14) | (uint32_t(p[2] & 0x7f) << 7) | (p[3] & 0x7f);
+    }
+
+    bool IsSyncsafe(const uint8_t *p)
+    {
+        return ((p[0] | p[1] | p[2] | p[3]) & 0x80) == 0;
+    }
+
+    // Milliseconds for a count of samples, rounded like TagLib does
+    int64_t DurationMs(uint64_t samples, uint32_t sample_rate)
+    {
+        return sample_rate == 0 ? 0 : static_cast<int64_t>((samples * 1000 + sample_rate / 2) / sample_rate);
+    }
+
+    bool EqualsIgnoreCase(std::string_view a, std::string_view upper)
+    {
+        if (a.size() != upper.size())
+        {
+            return false;
+        }
+        for (size_t i = 0; i < a.size(); ++i)
+        {
+            char c = a[i];
+            if (c >= 'a' && c <= 'z')
+            {
+                c = static_cast<char>(c - 'a' + 'A');
+            }
+            if (c != upper[i])
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void AppendUtf8(std::string &out, uint32_t code_point)
+    {
+        if (code_point < 0x80)
+        {
+            out += static_cast<char>(code_point);
+        }
+        else if (code_point < 0x800)
+        {
+            out += static_cast<char>(0xC0 | (code_point >> 6));
+            out += static_cast<char>(0x80 | (code_point & 0x3F));
+        }
+        else if (code_point < 0x10000)
+        {
+            out += static_cast<char>(0xE0 | (code_point >> 12));
+            out += static_cast<char>(0x80 | ((code_point >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (code_point & 0x3F));
+        }
+        else
+        {
+            out += static_cast<char>(0xF0 | (code_point >> 18));
+            out += static_cast<char>(0x80 | ((code_point >> 12) & 0x3F));
+            out += static_cast<char>(0x80 | ((code_point >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (code_point & 0x3F));
+        }
+    }
+
+    std::string Latin1ToUtf8(const uint8_t *p, size_t length)
+    {
+        std::string out;
+        out.reserve(length);
+        for (size_t i = 0; i < length; ++i)
+        {
+            AppendUtf8(out, p[i]);
+        }
+        return out;
+    }
+
+    // Unpaired surrogates are dropped
+    std::string Utf16ToUtf8(const uint8_t *p, size_t length, bool big_endian)
+    {
+        std::string out;
+        out.reserve(length);
+        auto unit = [p, big_endian](size_t i)
+        {
+            return big_endian ? static_cast<uint32_t>((p[i] << 8) | p[i + 1]) : static_cast<uint32_t>(p[i] | (p[i + 1] << 8));
+        };
+        for (size_t i = 0; i + 1 < length; i += 2)
+        {
+            uint32_t code_point = unit(i);
+            if (code_point >= 0xD800 && code_point <= 0xDBFF && i + 3 < length)
+            {
+                uint32_t low = unit(i + 2);
+                if (low >= 0xDC00 && low <= 0xDFFF)
+                {
+                    AppendUtf8(out, 0x10000 + ((code_point - 0xD800) << 10) + (low - 0xDC00));
+                    i += 2;
+                }
+                continue;
+            }
+            if (code_point < 0xD800 || code_point > 0xDFFF)
+            {
+                AppendUtf8(out, code_point);
+            }
+        }
+        return out;
+    }
+
+    // Several values of a field are joined the way TagLib joins them
+    void AddValue(std::optional<std::string> &field, std::string value)
+    {
+        if (value.empty())
+        {
+            return;
+        }
+        if (field)
+        {
+            *field += " / ";
+            *field += value;
+        }
+        else
+        {
+            field = std::move(value);
+        }
+    }
+
+    // Year from the start of a date such as "1999" or "1999-04-01"
+    std::optional<int> LeadingYear(std::string_view date)
+    {
+        int year = 0;
+        size_t digits = 0;
+        while (digits < date.size() && digits < 4 && date[digits] >= '0' && date[digits] <= '9')
+        {
+            year = year * 10 + (date[digits] - '0');
+            ++digits;
+        }
+        return year > 0 ? std::optional<int>(year) : std::nullopt;
+    }
+
+    // Vorbis comment block, used by FLAC and by Ogg Vorbis and Opus
+    bool ParseVorbisComment(const uint8_t *p, size_t length, AudioTags &tags)
+    {
+        if (length < 8)
+        {
+            return false;
+        }
+        uint32_t vendor_length = LittleEndian32(p);
+        if (vendor_length > length - 8)
+        {
+            return false;
+        }
+        size_t pos = 4 + vendor_length;
+        uint32_t count = LittleEndian32(p + pos);
+        pos += 4;
+
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            if (length - pos < 4)
+            {
+                return false;
+            }
+            uint32_t field_length = LittleEndian32(p + pos);
+            pos += 4;
+            if (field_length > length - pos)
+            {
+                return false;
+            }
+            std::string_view field(reinterpret_cast<const char *>(p + pos), field_length);
+            pos += field_length;
+
+            size_t equals = field.find('=');
+            if (equals == std::string_view::npos)
+            {
+                continue;
+            }
+            std::string_view key = field.substr(0, equals);
+            std::string value(field.substr(equals + 1));
+            if (EqualsIgnoreCase(key, "TITLE"))
+            {
+                AddValue(tags.title, std::move(value));
+            }
+            else if (EqualsIgnoreCase(key, "ARTIST"))
+            {
+                AddValue(tags.artist, std::move(value));
+            }
+            else if (EqualsIgnoreCase(key, "ALBUM"))
+            {
+                AddValue(tags.album, std::move(value));
+            }
+            else if (EqualsIgnoreCase(key, "GENRE"))
+            {
+                AddValue(tags.genre, std::move(value));
+            }
+            else if (EqualsIgnoreCase(key, "DATE") && !tags.year)
+            {
+                tags.year = LeadingYear(value);
+            }
+        }
+        return true;
+    }
+
+    std::optional<AudioTags> ReadFlac(FileWindow &file)
+    {
+        AudioTags tags;
+        bool have_stream_info = false;
+        uint64_t pos = 4;
+        for (;;)
+        {
+            const uint8_t *header = file.read(pos, 4);
+            if (!header)
+            {
+                return std::nullopt;
+            }
+            bool last = header[0] & 0x80;
+            uint8_t type = header[0] & 0x7f;
+            uint32_t length = BigEndian24(header + 1);
+            pos += 4;
+
+            if (type == 0 && length >= 18)
+            {
+                // STREAMINFO: 20-bit sample rate, 36-bit sample count
+                const uint8_t *info = file.read(pos, 18);
+                if (!info)
+                {
+                    return std::nullopt;
+                }
+                uint32_t sample_rate = (uint32_t(info[10]) << 12) | (uint32_t(info[11]) << 4) | (info[12] >> 4);
+                uint64_t samples = (uint64_t(info[13] & 0x0f) << 32) | BigEndian32(info + 14);
+                tags.duration_ms = DurationMs(samples, sample_rate);
+                have_stream_info = true;
+            }
+            else if (type == 4)
+            {
+                const uint8_t *comment = length <= MAX_FIELD_BYTES ? file.read(pos, length) : nullptr;
+                if (!comment || !ParseVorbisComment(comment, length, tags))
+                {
+                    return std::nullopt;
+                }
+            }
+
+            // Pictures and padding are skipped without being read
+            pos += length;
+            if (last)
+            {
+                break;
+            }
+        }
+        return have_stream_info ? std::optional<AudioTags>(std::move(tags)) : std::nullopt;
+    }
+
+    // The first two packets of the file's first logical stream: the
+    // identification and comment headers
+    bool ReadOggHeaders(FileWindow &file, uint32_t &serial, std::string &identification, std::string &comment)
+    {
+        std::string packets[2];
+        size_t complete = 0;
+        size_t total = 0;
+        uint64_t pos = 0;
+        while (complete < 2)
+        {
+            const uint8_t *header = file.read(pos, 27);
+            if (!header || std::memcmp(header, "OggS", 4) != 0)
+            {
+                return false;
+            }
+            uint32_t page_serial = LittleEndian32(header + 14);
+            if (pos == 0)
+            {
+                serial = page_serial;
+            }
+            uint8_t segment_count = header[26];
+
+            const uint8_t *table = file.read(pos + 27, segment_count);
+            if (!table)
+            {
+                return false;
+            }
+            uint8_t lacing[255];
+            std::memcpy(lacing, table, segment_count);
+            size_t body_size = 0;
+            for (size_t i = 0; i < segment_count; ++i)
+            {
+                body_size += lacing[i];
+            }
+
+            const uint8_t *body = file.read(pos + 27 + segment_count, body_size);
+            if (!body)
+            {
+                return false;
+            }
+            if (page_serial == serial)
+            {
+                size_t at = 0;
+                for (size_t i = 0; i < segment_count && complete < 2; ++i)
+                {
+                    packets[complete].append(reinterpret_cast<const char *>(body + at), lacing[i]);
+                    at += lacing[i];
+                    total += lacing[i];
+                    // A segment shorter than 255 bytes ends its packet
+                    if (lacing[i] < 255)
+                    {
+                        ++complete;
+                    }
+                }
+                if (total > MAX_FIELD_BYTES)
+                {
+                    return false;
+                }
+            }
+            pos += 27 + segment_count + body_size;
+        }
+        identification = std::move(packets[0]);
+        comment = std::move(packets[1]);
+        return true;
+    }
+
+    // Granule position of the stream's last page, which counts its samples
+    std::optional<uint64_t> LastOggGranule(FileWindow &file, uint32_t serial)
+    {
+        size_t tail = static_cast<size_t>(std::min<uint64_t>(file.size(), OGG_TAIL_BYTES));
+        const uint8_t *p = file.read(file.size() - tail, tail);
+        if (!p || tail < 27)
+        {
+            return std::nullopt;
+        }
+        for (size_t i = tail - 27 + 1; i-- > 0;)
+        {
+            if (std::memcmp(p + i, "OggS", 4) == 0 && p[i + 4] == 0 && LittleEndian32(p + i + 14) == serial)
+            {
+                uint64_t granule = LittleEndian64(p + i + 6);
+                // -1 marks a page on which no packet ends
+                if (granule != ~uint64_t(0))
+                {
+                    return granule;
+                }
+            }
+        }
+        return std::nullopt;
+    }
+
+    std::optional<AudioTags> ReadOgg(FileWindow &file)
+    {
+        uint32_t serial = 0;
+        std::string identification;
+        std::string comment;
+        if (!ReadOggHeaders(file, serial, identification, comment))
+        {
+            return std::nullopt;
+        }
+
+        AudioTags tags;
+        uint32_t sample_rate;
+        uint64_t pre_skip = 0;
+        const auto *comment_bytes = reinterpret_cast<const uint8_t *>(comment.data());
+        if (identification.size() >= 30 && identification.compare(0, 7, "\x01vorbis") == 0 &&
+            comment.compare(0, 7, "\x03vorbis") == 0)
+        {
+            sample_rate = LittleEndian32(reinterpret_cast<const uint8_t *>(identification.data()) + 12);
+            if (!ParseVorbisComment(comment_bytes + 7, comment.size() - 7, tags))
+            {
+                return std::nullopt;
+            }
+        }
+        else if (identification.size() >= 19 && identification.compare(0, 8, "OpusHead") == 0 &&
+                 comment.compare(0, 8, "OpusTags") == 0)
+        {
+            // Opus granules always count 48 kHz samples
+            sample_rate = 48000;
+            pre_skip = LittleEndian16(reinterpret_cast<const uint8_t *>(identification.data()) + 10);
+            if (!ParseVorbisComment(comment_bytes + 8, comment.size() - 8, tags))
+            {
+                return std::nullopt;
+            }
+        }
+        else
+        {
+            return std::nullopt;
+        }
+
+        auto granule = LastOggGranule(file, serial);
+        if (!granule)
+        {
+            return std::nullopt;
+        }
+        tags.duration_ms = *granule > pre_skip ? DurationMs(*granule - pre_skip, sample_rate) : 0;
+        return tags;
+    }
+
+    std::optional<AudioTags> ReadWav(FileWindow &file)
+    {
+        AudioTags tags;
+        std::optional<uint32_t> sample_rate;
+        uint16_t format = 0;
+        uint16_t block_align = 0;
+        std::optional<uint64_t> data_size;
+
+        uint64_t pos = 12;
+        while (pos + 8 <= file.size())
+        {
+            const uint8_t *header = file.read(pos, 8);
+            if (!header)
+            {
+                return std::nullopt;
+            }
+            std::string_view id(reinterpret_cast<const char *>(header), 4);
+            uint32_t length = LittleEndian32(header + 4);
+            pos += 8;
+
+            if (id == "fmt " && length >= 16)
+            {
+                const uint8_t *fmt = file.read(pos, 16);
+                if (!fmt)
+                {
+                    return std::nullopt;
+                }
+                format = LittleEndian16(fmt);
+                sample_rate = LittleEndian32(fmt + 4);
+                block_align = LittleEndian16(fmt + 12);
+            }
+            else if (id == "data")
+            {
+                data_size = std::min<uint64_t>(length, file.size() - pos);
+            }
+            else if (id == "id3 " || id == "ID3 ")
+            {
+                // TagLib prefers an ID3v2 chunk over the INFO list
+                return std::nullopt;
+            }
+            else if (id == "LIST" && length >= 4)
+            {
+                const uint8_t *list = length <= MAX_FIELD_BYTES ? file.read(pos, length) : nullptr;
+                if (!list)
+                {
+                    return std::nullopt;
+                }
+                if (std::memcmp(list, "INFO", 4) == 0)
+                {
+                    size_t at = 4;
+                    while (at + 8 <= length)
+                    {
+                        std::string_view field_id(reinterpret_cast<const char *>(list + at), 4);
+                        uint32_t field_length = std::min<uint32_t>(LittleEndian32(list + at + 4), length - at - 8);
+                        const uint8_t *text = list + at + 8;
+                        // Values are NUL-terminated Latin-1
+                        size_t text_length = std::find(text, text + field_length, 0) - text;
+                        std::string value = Latin1ToUtf8(text, text_length);
+                        if (field_id == "INAM")
+                        {
+                            tags.title = std::move(value);
+                        }
+                        else if (field_id == "IART")
+                        {
+                            tags.artist = std::move(value);
+                        }
+                        else if (field_id == "IPRD")
+                        {
+                            tags.album = std::move(value);
+                        }
+                        else if (field_id == "IGNR")
+                        {
+                            tags.genre = std::move(value);
+                        }
+                        else if (field_id == "ICRD")
+                        {
+                            tags.year = LeadingYear(value);
+                        }
+                        at += 8 + field_length + (field_length & 1);
+                    }
+                }
+            }
+            pos += uint64_t(length) + (length & 1);
+        }
+
+        // Other encodings need a fact chunk or codec knowledge; leave them
+        // to TagLib
+        bool pcm = format == 1 || format == 3 || format == 0xFFFE;
+        if (!sample_rate || !data_size || !pcm || block_align == 0)
+        {
+            return std::nullopt;
+        }
+        tags.duration_ms = DurationMs(*data_size / block_align, *sample_rate);
+
+        for (auto *field : {&tags.title, &tags.artist, &tags.album, &tags.genre})
+        {
+            if (*field && (*field)->empty())
+            {
+                field->reset();
+            }
+        }
+        return tags;
+    }
+
+    // Values of an ID3v2 text frame, or nullopt for an unknown encoding
+    std::optional<std::vector<std::string>> DecodeTextFrame(const uint8_t *p, size_t length)
+    {
+        std::vector<std::string> values;
+        if (length == 0)
+        {
+            return values;
+        }
+        uint8_t encoding = p[0];
+        if (encoding > 3)
+        {
+            return std::nullopt;
+        }
+
+        bool wide = encoding == 1 || encoding == 2;
+        size_t unit = wide ? 2 : 1;
+        size_t start = 1;
+        while (start < length)
+        {
+            // Values are separated by a NUL of the encoding's width
+            size_t end = start;
+            while (end + unit <= length && !(p[end] == 0 && (!wide || p[end + 1] == 0)))
+            {
+                end += unit;
+            }
+            end = std::min(end, length);
+
+            const uint8_t *text = p + start;
+            size_t text_length = end - start;
+            std::string value;
+            if (encoding == 0)
+            {
+                value = Latin1ToUtf8(text, text_length);
+            }
+            else if (encoding == 3)
+            {
+                value.assign(reinterpret_cast<const char *>(text), text_length);
+            }
+            else
+            {
+                bool big_endian = true;
+                if (encoding == 1 && text_length >= 2 && ((text[0] == 0xFF && text[1] == 0xFE) || (text[0] == 0xFE && text[1] == 0xFF)))
+                {
+                    big_endian = text[0] == 0xFE;
+                    text += 2;
+                    text_length -= 2;
+                }
+                value = Utf16ToUtf8(text, text_length, big_endian);
+            }
+            if (!value.empty())
+            {
+                values.push_back(std::move(value));
+            }
+            start = end + unit;
+        }
+        return values;
+    }
+
+    // Genres written as ID3v1 genre numbers need TagLib's genre list
+    bool IsNumericGenre(std::string_view genre)
+    {
+        return genre.front() == '(' ||
+               std::all_of(genre.begin(), genre.end(), [](char c)
+                           { return c >= '0' && c <= '9'; });
+    }
+
+    // ID3v2.3 or 2.4 tag at the start of the file; tag_end is set to the
+    // offset just past it
+    bool ReadId3v2(FileWindow &file, AudioTags &tags, uint64_t &tag_end)
+    {
+        const uint8_t *header = file.read(0, 10);
+        if (!header || !IsSyncsafe(header + 6))
+        {
+            return false;
+        }
+        uint8_t major = header[3];
+        uint8_t flags = header[5];
+        // Unsynchronisation rewrites the whole tag
+        if ((major != 3 && major != 4) || (flags & 0x80))
+        {
+            return false;
+        }
+        uint64_t frames_end = 10 + uint64_t(Syncsafe32(header + 6));
+        tag_end = frames_end + ((major == 4 && (flags & 0x10)) ? 10 : 0);
+
+        uint64_t pos = 10;
+        if (flags & 0x40)
+        {
+            const uint8_t *extended = file.read(pos, 4);
+            if (!extended)
+            {
+                return false;
+            }
+            // 2.4 counts the size field itself, 2.3 does not
+            pos += major == 4 ? Syncsafe32(extended) : BigEndian32(extended) + 4;
+        }
+
+        while (pos + 10 <= frames_end)
+        {
+            const uint8_t *frame = file.read(pos, 10);
+            if (!frame)
+            {
+                return false;
+            }
+            if (frame[0] == 0)
+            {
+                break; // Padding
+            }
+            char id_bytes[4];
+            std::memcpy(id_bytes, frame, 4);
+            std::string_view id(id_bytes, 4);
+            if (!std::all_of(id.begin(), id.end(), [](char c)
+                             { return (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9'); }))
+            {
+                return false;
+            }
+            // Some writers put plain sizes in 2.4 tags; TagLib guesses,
+            // so leave those to it
+            if (major == 4 && !IsSyncsafe(frame + 4))
+            {
+                return false;
+            }
+            uint32_t size = major == 4 ? Syncsafe32(frame + 4) : BigEndian32(frame + 4);
+            uint8_t format_flags = frame[9];
+            pos += 10;
+            if (size > frames_end - pos)
+            {
+                return false;
+            }
+
+            std::optional<std::string> *field = nullptr;
+            bool is_year = id == "TDRC" || id == "TYER";
+            if (id == "TIT2")
+            {
+                field = &tags.title;
+            }
+            else if (id == "TPE1")
+            {
+                field = &tags.artist;
+            }
+            else if (id == "TALB")
+            {
+                field = &tags.album;
+            }
+            else if (id == "TCON")
+            {
+                field = &tags.genre;
+            }
+
+            if (field || is_year)
+            {
+                // Compressed, encrypted, grouped or unsynchronised frames
+                bool encoded = major == 4 ? (format_flags & 0x0f) != 0 : (format_flags & 0xe0) != 0;
+                const uint8_t *data = !encoded && size <= MAX_FIELD_BYTES ? file.read(pos, size) : nullptr;
+                if (!data)
+                {
+                    return false;
+                }
+                auto values = DecodeTextFrame(data, size);
+                if (!values)
+                {
+                    return false;
+                }
+                for (auto &value : *values)
+                {
+                    if (is_year)
+                    {
+                        tags.year = tags.year ? tags.year : LeadingYear(value);
+                        continue;
+                    }
+                    if (field == &tags.genre && IsNumericGenre(value))
+                    {
+                        return false;
+                    }
+                    AddValue(*field, std::move(value));
+                }
+            }
+            pos += size;
+        }
+        return true;
+    }
+
+    struct MpegFrame {
+        uint32_t bitrate_kbps;
+        uint32_t sample_rate;
+        uint32_t samples_per_frame;
+        uint32_t length;
+        bool mpeg1;
+        bool mono;
+    };
+
+    std::optional<MpegFrame> ParseMpegHeader(const uint8_t *p)
+    {
+        static const uint16_t BITRATES_V1[3][16] = {
+            {0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448, 0},
+            {0, 32, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384, 0},
+            {0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 0},
+        };
+        static const uint16_t BITRATES_V2[3][16] = {
+            {0, 32, 48, 56, 64, 80, 96, 112, 128, 144, 160, 176, 192, 224, 256, 0},
+            {0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160, 0},
+            {0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160, 0},
+        };
+        static const uint32_t SAMPLE_RATES[3] = {44100, 48000, 32000};
+
+        if (p[0] != 0xFF || (p[1] & 0xE0) != 0xE0)
+        {
+            return std::nullopt;
+        }
+        uint8_t version = (p[1] >> 3) & 3; // 3: MPEG-1, 2: MPEG-2, 0: MPEG-2.5
+        uint8_t layer_bits = (p[1] >> 1) & 3;
+        uint8_t bitrate_index = p[2] >> 4;
+        uint8_t rate_index = (p[2] >> 2) & 3;
+        if (version == 1 || layer_bits == 0 || bitrate_index == 0 || bitrate_index == 15 || rate_index == 3)
+        {
+            return std::nullopt;
+        }
+
+        int layer = 4 - layer_bits;
+        MpegFrame frame;
+        frame.mpeg1 = version == 3;
+        frame.mono = (p[3] >> 6) == 3;
+        frame.bitrate_kbps = (frame.mpeg1 ? BITRATES_V1 : BITRATES_V2)[layer - 1][bitrate_index];
+        frame.sample_rate = SAMPLE_RATES[rate_index] >> (version == 3 ? 0 : version == 2 ? 1 : 2);
+        frame.samples_per_frame = layer == 1 ? 384 : (layer == 3 && !frame.mpeg1) ? 576 : 1152;
+        uint32_t padding = (p[2] >> 1) & 1;
+        frame.length = layer == 1 ? (12 * frame.bitrate_kbps * 1000 / frame.sample_rate + padding) * 4
+                                  : frame.samples_per_frame / 8 * frame.bitrate_kbps * 1000 / frame.sample_rate + padding;
+        return frame;
+    }
+
+    // Duration from the first MPEG frame: the frame count of a Xing/Info
+    // or VBRI header, or else the stream size at the first frame's bitrate
+    bool ReadMpegDuration(FileWindow &file, uint64_t audio_start, uint64_t audio_end, AudioTags &tags)
+    {
+        size_t search = static_cast<size_t>(std::min<uint64_t>(audio_end - std::min(audio_start, audio_end), MPEG_SYNC_SEARCH_BYTES));
+        const uint8_t *p = file.read(audio_start, search);
+        if (!p)
+        {
+            return false;
+        }
+        std::vector<uint8_t> area(p, p + search);
+
+        std::optional<MpegFrame> frame;
+        uint64_t frame_start = 0;
+        for (size_t i = 0; i + 4 <= area.size() && !frame; ++i)
+        {
+            frame = ParseMpegHeader(area.data() + i);
+            if (!frame)
+            {
+                continue;
+            }
+            // A real frame is followed by another one
+            size_t next = i + frame->length;
+            if (next + 4 <= area.size())
+            {
+                auto following = ParseMpegHeader(area.data() + next);
+                if (!following || following->sample_rate != frame->sample_rate)
+                {
+                    frame.reset();
+                    continue;
+                }
+            }
+            frame_start = audio_start + i;
+        }
+        if (!frame)
+        {
+            return false;
+        }
+
+        size_t side_info = frame->mpeg1 ? (frame->mono ? 17 : 32) : (frame->mono ? 9 : 17);
+        const uint8_t *xing = file.read(frame_start + 4 + side_info, 12);
+        if (xing && (std::memcmp(xing, "Xing", 4) == 0 || std::memcmp(xing, "Info", 4) == 0) && (BigEndian32(xing + 4) & 1))
+        {
+            uint32_t frames = BigEndian32(xing + 8);
+            if (frames > 0)
+            {
+                tags.duration_ms = DurationMs(uint64_t(frames) * frame->samples_per_frame, frame->sample_rate);
+                return true;
+            }
+        }
+        const uint8_t *vbri = file.read(frame_start + 4 + 32, 18);
+        if (vbri && std::memcmp(vbri, "VBRI", 4) == 0)
+        {
+            uint32_t frames = BigEndian32(vbri + 14);
+            if (frames > 0)
+            {
+                tags.duration_ms = DurationMs(uint64_t(frames) * frame->samples_per_frame, frame->sample_rate);
+                return true;
+            }
+        }
+        tags.duration_ms = static_cast<int64_t>((audio_end - frame_start) * 8 / frame->bitrate_kbps);
+        return true;
+    }
+
+    std::optional<AudioTags> ReadMpeg(FileWindow &file)
+    {
+        AudioTags tags;
+        uint64_t tag_end = 0;
+        if (!ReadId3v2(file, tags, tag_end))
+        {
+            return std::nullopt;
+        }
+
+        // TagLib fills fields the ID3v2 tag lacks from an APE or ID3v1 tag
+        // at the end of the file
+        uint64_t audio_end = file.size();
+        const uint8_t *id3v1 = file.size() >= 128 ? file.read(file.size() - 128, 128) : nullptr;
+        bool has_id3v1 = id3v1 && std::memcmp(id3v1, "TAG", 3) == 0;
+        if (has_id3v1)
+        {
+            audio_end -= 128;
+        }
+        const uint8_t *ape = audio_end >= 32 ? file.read(audio_end - 32, 8) : nullptr;
+        bool has_ape = ape && std::memcmp(ape, "APETAGEX", 8) == 0;
+        bool complete = tags.title && tags.artist && tags.album && tags.genre && tags.year;
+        if ((has_id3v1 || has_ape) && !complete)
+        {
+            return std::nullopt;
+        }
+
+        if (!ReadMpegDuration(file, tag_end, audio_end, tags))
+        {
+            return std::nullopt;
+        }
+        return tags;
+    }
+}
+
+std::optional<AudioTags> ReadTagsFast(int fd, uint64_t file_size)
+{
+    static thread_local std::vector<uint8_t> window;
+    FileWindow file(fd, file_size, window);
+    const uint8_t *head = file.read(0, 12);
+    if (!head)
+    {
+        return std::nullopt;
+    }
+
+    if (std::memcmp(head, "fLaC", 4) == 0)
+    {
+        return ReadFlac(file);
+    }
+    if (std::memcmp(head, "OggS", 4) == 0)
+    {
+        return ReadOgg(file);
+    }
+    if (std::memcmp(head, "RIFF", 4) == 0 && std::memcmp(head + 8, "WAVE", 4) == 0)
+    {
+        return ReadWav(file);
+    }
+    if (std::memcmp(head, "ID3", 3) == 0)
+    {
+        return ReadMpeg(file);
+    }
+    // MPEG streams without an ID3v2 tag, FLAC behind an ID3v2 tag and
+    // anything else go through TagLib
+    return std::nullopt;
+}
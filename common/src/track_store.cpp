@@ -0,0 +1,27 @@
+/*
+ * vibe-player
+ * track_store.cpp
+ */
+
+#include "track_store.h"
+
+TrackStore::TrackId TrackStore::add(TrackMetadata track)
+{
+    auto it = ids_.find(track.filepath);
+    // Metadata without an mtime cannot be newer than what is stored
+    if (it != ids_.end() && (track.file_mtime == 0 || tracks_[it->second].file_mtime == track.file_mtime))
+    {
+        return it->second;
+    }
+
+    // A file changed since it was stored gets a new entry; the old one
+    // stays for the tracks already referring to it
+    TrackId id = static_cast<TrackId>(tracks_.size());
+    tracks_.push_back(std::move(track));
+    if (it != ids_.end())
+    {
+        ids_.erase(it);
+    }
+    ids_.emplace(tracks_.back().filepath, id);
+    return id;
+}
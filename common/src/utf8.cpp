@@ -0,0 +1,201 @@
+/*
+ * vibe-player
+ * utf8.cpp
+ */
+
+#include "utf8.h"
+
+#include <bit>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+namespace
+{
+    constexpr uint64_t HIGH_BITS = 0x8080808080808080ull;
+
+    // Index of the first non-ASCII byte in a word loaded from memory, given
+    // word & HIGH_BITS != 0
+    size_t FirstNonAscii(uint64_t high_bits)
+    {
+        if constexpr (std::endian::native == std::endian::little)
+        {
+            return static_cast<size_t>(std::countr_zero(high_bits)) / 8;
+        }
+        else
+        {
+            return static_cast<size_t>(std::countl_zero(high_bits)) / 8;
+        }
+    }
+
+    // End of the run of ASCII bytes starting at bytes[i]. Tags and paths
+    // are mostly ASCII, so long runs are checked a block at a time; the
+    // short runs between CJK characters end within the first word.
+    size_t AsciiRunEnd(const unsigned char *bytes, size_t i, size_t len)
+    {
+        uint64_t word;
+        if (i + 8 > len)
+        {
+            while (i < len && bytes[i] < 0x80)
+            {
+                i++;
+            }
+            return i;
+        }
+        std::memcpy(&word, bytes + i, sizeof(word));
+        if (word & HIGH_BITS)
+        {
+            return i + FirstNonAscii(word & HIGH_BITS);
+        }
+        i += 8;
+
+#if defined(__SSE2__)
+        for (; i + 32 <= len; i += 32)
+        {
+            __m128i low = _mm_loadu_si128(reinterpret_cast<const __m128i *>(bytes + i));
+            __m128i high = _mm_loadu_si128(reinterpret_cast<const __m128i *>(bytes + i + 16));
+            if (_mm_movemask_epi8(_mm_or_si128(low, high)) != 0)
+            {
+                break;
+            }
+        }
+        for (; i + 16 <= len; i += 16)
+        {
+            int mask = _mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(bytes + i)));
+            if (mask != 0)
+            {
+                return i + static_cast<size_t>(std::countr_zero(static_cast<unsigned>(mask)));
+            }
+        }
+#elif defined(__aarch64__)
+        for (; i + 16 <= len; i += 16)
+        {
+            if (vmaxvq_u8(vld1q_u8(bytes + i)) >= 0x80)
+            {
+                break;
+            }
+        }
+#endif
+        // What is left, and everything on other targets, a word at a time
+        for (; i + 8 <= len; i += 8)
+        {
+            std::memcpy(&word, bytes + i, sizeof(word));
+            if (word & HIGH_BITS)
+            {
+                return i + FirstNonAscii(word & HIGH_BITS);
+            }
+        }
+        while (i < len && bytes[i] < 0x80)
+        {
+            i++;
+        }
+        return i;
+    }
+
+    // Length of the valid multi-byte sequence at bytes[i], or 0
+    size_t SequenceLength(const unsigned char *bytes, size_t i, size_t len)
+    {
+        unsigned char c = bytes[i];
+        auto continuation = [bytes](size_t at)
+        {
+            return (bytes[at] & 0xC0) == 0x80;
+        };
+
+        // 3-byte sequence (0xE0-0xEF), most of CJK text; rejecting overlong
+        // encodings and UTF-16 surrogates, which JSON writers refuse
+        if ((c & 0xF0) == 0xE0)
+        {
+            bool valid = i + 2 < len && continuation(i + 1) && continuation(i + 2) &&
+                         !(c == 0xE0 && bytes[i + 1] < 0xA0) && !(c == 0xED && bytes[i + 1] > 0x9F);
+            return valid ? 3 : 0;
+        }
+        // 2-byte sequence (0xC2-0xDF)
+        // Note: 0xC0 and 0xC1 are invalid (overlong encodings)
+        if (c >= 0xC2 && c <= 0xDF)
+        {
+            return i + 1 < len && continuation(i + 1) ? 2 : 0;
+        }
+        // 4-byte sequence (0xF0-0xF4), rejecting overlong encodings and
+        // values past U+10FFFF
+        // Note: 0xF5-0xFF are invalid
+        if (c >= 0xF0 && c <= 0xF4)
+        {
+            bool valid = i + 3 < len && continuation(i + 1) && continuation(i + 2) && continuation(i + 3) &&
+                         !(c == 0xF0 && bytes[i + 1] < 0x90) && !(c == 0xF4 && bytes[i + 1] > 0x8F);
+            return valid ? 4 : 0;
+        }
+        // Invalid start byte (0x80-0xBF, 0xC0-0xC1, 0xF5-0xFF)
+        return 0;
+    }
+}
+
+size_t ValidUtf8Prefix(std::string_view text)
+{
+    const unsigned char *bytes = reinterpret_cast<const unsigned char *>(text.data());
+    size_t len = text.size();
+
+    size_t i = 0;
+    while (i < len)
+    {
+        unsigned char c = bytes[i];
+        if (c < 0x80)
+        {
+            // A lone space or slash between CJK characters is stepped over
+            i = i + 1 < len && bytes[i + 1] >= 0x80 ? i + 1 : AsciiRunEnd(bytes, i, len);
+            continue;
+        }
+        // Most CJK characters: a 3-byte sequence past U+0800 and not a
+        // surrogate, checked here without the call
+        if (c > 0xE0 && c < 0xF0 && c != 0xED && i + 2 < len)
+        {
+            if ((bytes[i + 1] & 0xC0) != 0x80 || (bytes[i + 2] & 0xC0) != 0x80)
+            {
+                break;
+            }
+            i += 3;
+            continue;
+        }
+        size_t n = SequenceLength(bytes, i, len);
+        if (n == 0)
+        {
+            break;
+        }
+        i += n;
+    }
+    return i;
+}
+
+std::string SanitizeUtf8(std::string text)
+{
+    size_t valid = ValidUtf8Prefix(text);
+    if (valid == text.size())
+    {
+        return text;
+    }
+
+    // Keep the valid prefix, then copy valid runs and drop invalid bytes
+    const unsigned char *bytes = reinterpret_cast<const unsigned char *>(text.data());
+    size_t len = text.size();
+    std::string result;
+    result.reserve(len);
+    result.append(text, 0, valid);
+
+    size_t i = valid;
+    while (i < len)
+    {
+        size_t n = bytes[i] < 0x80 ? AsciiRunEnd(bytes, i, len) - i : SequenceLength(bytes, i, len);
+        if (n == 0)
+        {
+            i++;
+            continue;
+        }
+        result.append(text, i, n);
+        i += n;
+    }
+    return result;
+}
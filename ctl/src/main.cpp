@@ -0,0 +1,122 @@
+/*
+ * vibe-player
+ * main.cpp
+ */
+
+#include "control_client.h"
+#include "control_server.h"
+
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <cxxopts.hpp>
+#include <nlohmann/json.hpp>
+
+int main(int argc, char *argv[])
+{
+    cxxopts::Options options("vibe-ctl",
+                             "Vibe Control - Remote control a running vibe-player or tui-player");
+
+    // clang-format off
+    options.add_options()
+        ("command", "Command to send", cxxopts::value<std::string>())
+        ("args", "Command argument", cxxopts::value<std::vector<std::string>>())
+        ("s,socket", "Player control socket",
+         cxxopts::value<std::string>()->default_value(ControlServer::defaultSocketPath()))
+        ("h,help", "Print usage");
+    // clang-format on
+
+    options.parse_positional({"command", "args"});
+    options.positional_help("<command> [argument]");
+
+    cxxopts::ParseResult result;
+    try
+    {
+        result = options.parse(argc, argv);
+    }
+    catch (const cxxopts::exceptions::exception &e)
+    {
+        std::cerr << "Error parsing options: " << e.what() << std::endl;
+        std::cout << options.help() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    if (result.count("help") || !result.count("command"))
+    {
+        std::cout << options.help() << std::endl
+                  << "Commands:\n"
+                  << "  status                  Print the current status\n"
+                  << "  subscribe               Print every status change until the player exits\n"
+                  << "  play | pause | toggle | stop\n"
+                  << "  next | prev             Change track\n"
+                  << "  seek <sec|+sec|-sec>    Seek to or by a number of seconds\n"
+                  << "  volume <pct|+pct|-pct>  Set or adjust the volume\n"
+                  << "  enqueue <file>          Append a file to the playlist\n"
+                  << "  insert <file>           Queue a file to play next\n"
+                  << "  enqueue-list <json>     Append a JSON array of files (or: insert-list)\n"
+                  << "  remove <n>              Remove track n\n"
+                  << "  move <from> <to>        Move a track within the playlist\n"
+                  << "  jump <n>                Play track n\n"
+                  << "  shuffle [seed]          Shuffle the tracks after the current one\n"
+                  << "  clear                   Remove every track but the current one\n"
+                  << "  queue                   Print the playlist as JSON\n"
+                  << "  quit                    Stop the player\n"
+                  << std::endl;
+        return result.count("help") ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    std::string command = result["command"].as<std::string>();
+    std::string argument;
+    if (result.count("args"))
+    {
+        for (const auto &arg : result["args"].as<std::vector<std::string>>())
+        {
+            argument += (argument.empty() ? "" : " ") + arg;
+        }
+    }
+
+    // The player may run in another directory
+    if ((command == "enqueue" || command == "insert") && !argument.empty())
+    {
+        namespace fs = std::filesystem;
+        std::error_code ec;
+        fs::path absolute = fs::absolute(argument, ec);
+        if (!ec)
+        {
+            argument = absolute.string();
+        }
+    }
+
+    ControlClient client;
+    if (!client.connect(result["socket"].as<std::string>()))
+    {
+        return EXIT_FAILURE;
+    }
+    if (!client.send(command, argument))
+    {
+        std::cerr << "Error: Could not send command" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::string line;
+    if (command == "subscribe")
+    {
+        while (client.readLine(line))
+        {
+            std::cout << line << std::endl;
+        }
+        return EXIT_SUCCESS;
+    }
+
+    if (!client.readLine(line))
+    {
+        std::cerr << "Error: Player closed the connection without replying" << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::cout << line << std::endl;
+
+    auto reply = nlohmann::json::parse(line, nullptr, false);
+    return !reply.is_discarded() && reply.value("ok", false) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -5,20 +5,38 @@
 
 #include "metadata.h"
 #include "metadata_cache.h"
+#include "library_scanner.h"
 #include "playlist.h"
+#include "shuffle.h"
+#include "utf8.h"
+#include "control_client.h"
+#include "control_server.h"
 #include "ai_backend.h"
 #include "ai_backend_claude.h"
 #include "ai_backend_llamacpp.h"
 #include "ai_backend_chatgpt.h"
 #include "ai_backend_keyword.h"
 
+#include <fcntl.h>
+#include <unistd.h>
+
 #include <algorithm>
+#include <chrono>
+#include <condition_variable>
 #include <filesystem>
+#include <fstream>
 #include <iostream>
-#include <random>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
 #include <string>
+#include <thread>
+#include <unordered_set>
 #include <vector>
 
+// --library is repeated for more roots; a path may contain commas
+#define CXXOPTS_VECTOR_DELIMITER '\0'
 #include <cxxopts.hpp>
 #include <spdlog/spdlog.h>
 #include <spdlog/sinks/basic_file_sink.h>
@@ -60,12 +78,42 @@ void InitializeLogger(bool verbose)
     }
 }
 
+// How much of a library without a usable cache is enough to start
+// generating; zero disables a limit, both zero waits for the whole library
+struct ScanPolicy
+{
+    size_t min_tracks = 0;
+    std::chrono::seconds max_wait{0};
+};
+
+// Wait for a library scan to read everything and cache the result
+std::vector<TrackMetadata> FinishLibraryScan(const std::string &library_path, LibraryScanner &scan)
+{
+    auto metadata = scan.finish();
+
+    spdlog::info("Extracted metadata for {} tracks", metadata.size());
+
+    MetadataCache cache;
+    if (!cache.save(library_path, metadata))
+    {
+        spdlog::warn("Failed to save metadata cache");
+    }
+
+    return metadata;
+}
+
+// Metadata from the cache if it is current. Otherwise the library is
+// scanned and, once the policy allows, the tracks read so far are
+// returned with the scan left running in scan for FinishLibraryScan.
 std::vector<TrackMetadata> GetLibraryMetadata(
     const std::string &library_path,
+    std::unique_ptr<LibraryScanner> &scan,
+    const ScanPolicy &policy,
     bool force_rescan = false,
     bool verbose = false)
 {
     MetadataCache cache;
+    std::vector<TrackMetadata> previous;
 
     if (!force_rescan)
     {
@@ -75,21 +123,278 @@ std::vector<TrackMetadata> GetLibraryMetadata(
             spdlog::info("Using cached metadata ({} tracks)", cached->size());
             return *cached;
         }
+        // Files that did not change, even if moved, keep their cached metadata
+        if (cached)
+        {
+            previous = std::move(*cached);
+        }
     }
 
-    spdlog::info("Scanning library and extracting metadata...");
-    auto metadata = MetadataExtractor::extractFromDirectory(library_path, true, verbose);
+    // A stale cache (isValid samples only a few files, so one moved file
+    // fails it) still has nearly every track, and the rescan reuses them at
+    // a stat each. Generating from its first few thousand would hide most of
+    // the library, so the policy only applies without a usable cache.
+    bool cold = previous.empty();
 
-    spdlog::info("Extracted metadata for {} tracks", metadata.size());
+    spdlog::info("Scanning library and extracting metadata...");
+    scan = std::make_unique<LibraryScanner>(library_path, std::move(previous), verbose);
+    size_t found = scan->start();
+    std::vector<TrackMetadata> metadata;
+    if (cold)
+    {
+        metadata = scan->waitForTracks(policy.min_tracks, policy.max_wait);
+    }
 
-    if (!cache.save(library_path, metadata))
+    if (cold && !scan->complete())
     {
-        spdlog::warn("Failed to save metadata cache");
+        spdlog::info("Generating from {} of {} tracks, scanning the rest in the background",
+                     metadata.size(), found);
+        return metadata;
     }
 
+    metadata = FinishLibraryScan(library_path, *scan);
+    scan.reset();
     return metadata;
 }
 
+// The --library roots, each loaded (from its cache, or scanned) on a
+// thread of its own so a slow one, say a NAS, does not hold up the rest
+struct LibraryRoot
+{
+    std::string path;
+    bool done = false;
+    std::vector<TrackMetadata> metadata;
+    // Scan left running by GetLibraryMetadata, for FinishLibraryLoad
+    std::unique_ptr<LibraryScanner> scan;
+};
+
+struct LibraryLoad
+{
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::vector<LibraryRoot> roots;
+};
+
+std::shared_ptr<LibraryLoad> StartLibraryLoad(const std::vector<std::string> &library_paths,
+                                              const ScanPolicy &policy,
+                                              bool force_rescan,
+                                              bool verbose)
+{
+    auto load = std::make_shared<LibraryLoad>();
+    for (const auto &path : library_paths)
+    {
+        load->roots.push_back({path});
+    }
+
+    // Detached: a root that hangs must not keep vibe-playlist from exiting
+    for (size_t i = 0; i < load->roots.size(); ++i)
+    {
+        std::thread([load, i, policy, force_rescan, verbose]()
+                    {
+                        const std::string &path = load->roots[i].path;
+                        std::vector<TrackMetadata> metadata;
+                        std::unique_ptr<LibraryScanner> scan;
+                        try
+                        {
+                            metadata = GetLibraryMetadata(path, scan, policy, force_rescan, verbose);
+                        }
+                        catch (const std::exception &e)
+                        {
+                            spdlog::error("Failed to load library {}: {}", path, e.what());
+                        }
+
+                        std::lock_guard<std::mutex> lock(load->mutex);
+                        load->roots[i].metadata = std::move(metadata);
+                        load->roots[i].scan = std::move(scan);
+                        load->roots[i].done = true;
+                        load->changed.notify_all(); })
+            .detach();
+    }
+    return load;
+}
+
+// Whether two files hold the same bytes
+bool SameContents(const std::string &a, const std::string &b)
+{
+    std::ifstream first(a, std::ios::binary);
+    std::ifstream second(b, std::ios::binary);
+    if (!first || !second)
+    {
+        return false;
+    }
+    std::vector<char> buffer_a(64 * 1024);
+    std::vector<char> buffer_b(64 * 1024);
+    while (true)
+    {
+        first.read(buffer_a.data(), buffer_a.size());
+        second.read(buffer_b.data(), buffer_b.size());
+        if (first.gcount() != second.gcount() ||
+            !std::equal(buffer_a.begin(), buffer_a.begin() + first.gcount(), buffer_b.begin()))
+        {
+            return false;
+        }
+        if (first.gcount() == 0 || !first || !second)
+        {
+            return first.eof() && second.eof();
+        }
+    }
+}
+
+// Wait for the roots to load, each given until timeout (zero: no limit)
+// after the load started, but at least until one has. Returns the tracks
+// of the roots loaded by then, merged in the order the roots were given;
+// a file found under several roots, or copied to several, is listed once,
+// from the first.
+std::vector<TrackMetadata> WaitForLibraries(LibraryLoad &load, std::chrono::steady_clock::time_point started,
+                                            std::chrono::seconds timeout)
+{
+    std::unique_lock<std::mutex> lock(load.mutex);
+    auto all_done = [&]()
+    {
+        return std::all_of(load.roots.begin(), load.roots.end(), [](const LibraryRoot &root)
+                           { return root.done; });
+    };
+    auto any_done = [&]()
+    {
+        return std::any_of(load.roots.begin(), load.roots.end(), [](const LibraryRoot &root)
+                           { return root.done && !root.metadata.empty(); }) ||
+               all_done();
+    };
+    if (timeout.count() == 0)
+    {
+        load.changed.wait(lock, all_done);
+    }
+    else if (!load.changed.wait_until(lock, started + timeout, all_done))
+    {
+        load.changed.wait(lock, any_done);
+    }
+
+    // A loaded root's tracks no longer change, so copies can be compared
+    // without holding up the roots still loading
+    std::vector<const LibraryRoot *> roots;
+    for (const auto &root : load.roots)
+    {
+        if (!root.done)
+        {
+            spdlog::warn("Library {} did not load within {} seconds, leaving it out", root.path, timeout.count());
+            std::cerr << "Warning: Library " << root.path << " is still loading, leaving it out" << std::endl;
+            continue;
+        }
+        roots.push_back(&root);
+    }
+    lock.unlock();
+
+    std::vector<TrackMetadata> merged;
+    std::set<std::pair<uint64_t, uint64_t>> inodes;
+    std::unordered_set<std::string> paths;
+    // Paths of the earlier roots' tracks by size and PartialContentHash
+    std::map<std::pair<uint64_t, uint64_t>, std::vector<std::string>> contents;
+    for (const LibraryRoot *root : roots)
+    {
+        size_t before = merged.size();
+        for (const auto &track : root->metadata)
+        {
+            // The same file under overlapping roots or another mount of one
+            if (track.inode != 0 && !inodes.insert({track.device, track.inode}).second)
+            {
+                continue;
+            }
+            if (!paths.insert(track.filepath).second)
+            {
+                continue;
+            }
+            // A copy on another root; the partial hash only picks the
+            // candidates, since rips of one length can share their first
+            // and last 4 KiB
+            auto copies = contents.find({track.file_size, track.content_hash});
+            if (track.content_hash != 0 && copies != contents.end() &&
+                std::any_of(copies->second.begin(), copies->second.end(), [&](const std::string &path)
+                            { return SameContents(path, track.filepath); }))
+            {
+                continue;
+            }
+            merged.push_back(track);
+        }
+        for (size_t i = before; i < merged.size(); ++i)
+        {
+            if (merged[i].content_hash != 0)
+            {
+                contents[{merged[i].file_size, merged[i].content_hash}].push_back(merged[i].filepath);
+            }
+        }
+        spdlog::info("Library {}: {} tracks, {} new", root->path, root->metadata.size(), merged.size() - before);
+    }
+    return merged;
+}
+
+// Whether a root is still loading or scanning
+bool LibraryLoadPending(LibraryLoad &load)
+{
+    std::lock_guard<std::mutex> lock(load.mutex);
+    return std::any_of(load.roots.begin(), load.roots.end(), [](const LibraryRoot &root)
+                       { return !root.done || root.scan; });
+}
+
+// Let the roots finish scanning into their caches, giving those still
+// loading until timeout (zero: no limit). Returns false if some did not
+// finish; their threads are still running.
+bool FinishLibraryLoad(LibraryLoad &load, std::chrono::seconds timeout)
+{
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    std::vector<std::pair<std::string, std::unique_ptr<LibraryScanner>>> scans;
+    bool finished = true;
+    for (size_t i = 0; i < load.roots.size(); ++i)
+    {
+        std::unique_lock<std::mutex> lock(load.mutex);
+        LibraryRoot &root = load.roots[i];
+        auto done = [&]()
+        {
+            return root.done;
+        };
+        if (timeout.count() == 0)
+        {
+            load.changed.wait(lock, done);
+        }
+        else if (!load.changed.wait_until(lock, deadline, done))
+        {
+            spdlog::warn("Library {} still loading, giving up on it", root.path);
+            finished = false;
+            continue;
+        }
+        if (root.scan)
+        {
+            scans.emplace_back(root.path, std::move(root.scan));
+        }
+    }
+
+    // The scans have been running side by side all along
+    for (auto &[path, scan] : scans)
+    {
+        FinishLibraryScan(path, *scan);
+    }
+    return finished;
+}
+
+// What main returns once a library load may have started. Its threads can
+// still be loading or scanning a root, logging as they go, and the static
+// destructors would pull spdlog out from under them; so while anything is
+// pending the process ends here instead, with the log flushed. With
+// finish, scans are first given until timeout (zero: no limit) to complete
+// their caches.
+int EndLibraryLoad(const std::shared_ptr<LibraryLoad> &load, int status, bool finish = false,
+                   std::chrono::seconds timeout = std::chrono::seconds(0))
+{
+    if (!load || !LibraryLoadPending(*load) || (finish && FinishLibraryLoad(*load, timeout)))
+    {
+        return status;
+    }
+    std::cout.flush();
+    std::cerr.flush();
+    spdlog::apply_all([](const std::shared_ptr<spdlog::logger> &logger)
+                      { logger->flush(); });
+    _exit(status);
+}
+
 int main(int argc, char *argv[])
 {
     // Parse command line arguments using cxxopts
@@ -100,7 +405,8 @@ int main(int argc, char *argv[])
     options.add_options()
         ("d,directory", "Generate playlist from directory", cxxopts::value<std::string>())
         ("f,file", "Generate playlist from single file", cxxopts::value<std::string>())
-        ("l,library", "Music library path for AI playlist generation", cxxopts::value<std::string>())
+        ("l,library", "Music library path for AI playlist generation; repeat for more roots", cxxopts::value<std::vector<std::string>>())
+        ("library-timeout", "Leave out a library root not loaded after this many seconds (0: no limit)", cxxopts::value<int>()->default_value("30"))
         ("p,prompt", "Generate AI playlist from description", cxxopts::value<std::string>())
         ("ai-backend", "AI backend: 'claude', 'chatgpt', 'llamacpp', or 'keyword' (default: claude)", cxxopts::value<std::string>()->default_value("claude"))
         ("claude-model", "Claude model preset: 'fast' (Haiku), 'balanced' (Sonnet), 'best' (Opus) or full model ID (default: fast)", cxxopts::value<std::string>()->default_value("fast"))
@@ -109,9 +415,16 @@ int main(int argc, char *argv[])
         ("ai-context-size", "Context size for llama.cpp (default: 2048)", cxxopts::value<int>()->default_value("2048"))
         ("ai-threads", "Number of threads for llama.cpp (default: 4)", cxxopts::value<int>()->default_value("4"))
         ("force-scan", "Force rescan library metadata (ignore cache)")
+        ("scan-min-tracks", "Without a usable cache, start generating once this many tracks are scanned (0: no track limit)", cxxopts::value<size_t>()->default_value("2000"))
+        ("scan-wait", "Without a usable cache, start generating after scanning this many seconds (0: no time limit)", cxxopts::value<int>()->default_value("10"))
         ("verbose", "Display AI prompts and debug information")
-        ("s,shuffle", "Shuffle playlist")
+        ("s,shuffle", "Shuffle playlist, spreading out artists and albums")
+        ("seed", "Seed for --shuffle, to repeat an earlier order", cxxopts::value<uint64_t>())
         ("save", "Save playlist to file (default: output to stdout)", cxxopts::value<std::string>())
+        ("enqueue", "Queue the playlist on a running player instead of printing it")
+        ("insert", "Like --enqueue, but play the playlist next")
+        ("control-socket", "Control socket of the running player",
+         cxxopts::value<std::string>()->default_value(ControlServer::defaultSocketPath()))
         ("h,help", "Print usage");
     // clang-format on
 
@@ -140,12 +453,19 @@ int main(int argc, char *argv[])
     const bool force_scan = result.count("force-scan") > 0;
     const bool verbose = result.count("verbose") > 0;
     const bool save_to_file = result.count("save") > 0;
+    const bool insert_next = result.count("insert") > 0;
+    const bool enqueue = result.count("enqueue") > 0 || insert_next;
 
     // Initialize logger
     InitializeLogger(verbose);
 
     std::vector<TrackMetadata> playlist_tracks;
 
+    // Library roots, some possibly still loading or being scanned after
+    // generation started
+    std::shared_ptr<LibraryLoad> library_load;
+    const std::chrono::seconds library_timeout(std::max(result["library-timeout"].as<int>(), 0));
+
     // AI Playlist mode
     if (result.count("prompt"))
     {
@@ -156,17 +476,22 @@ int main(int argc, char *argv[])
             return EXIT_FAILURE;
         }
 
-        std::string library_path = result["library"].as<std::string>();
+        auto library_paths = result["library"].as<std::vector<std::string>>();
         std::string prompt_text = result["prompt"].as<std::string>();
         std::string backend_type = result["ai-backend"].as<std::string>();
 
         // Get or generate metadata
-        auto library_metadata = GetLibraryMetadata(library_path, force_scan, verbose);
+        ScanPolicy scan_policy;
+        scan_policy.min_tracks = result["scan-min-tracks"].as<size_t>();
+        scan_policy.max_wait = std::chrono::seconds(std::max(result["scan-wait"].as<int>(), 0));
+        auto load_started = std::chrono::steady_clock::now();
+        library_load = StartLibraryLoad(library_paths, scan_policy, force_scan, verbose);
+        auto library_metadata = WaitForLibraries(*library_load, load_started, library_timeout);
 
         if (library_metadata.empty())
         {
             std::cerr << "Error: No audio files found in library" << std::endl;
-            return EXIT_FAILURE;
+            return EndLibraryLoad(library_load, EXIT_FAILURE);
         }
 
         // Create backend based on flag
@@ -181,7 +506,7 @@ int main(int argc, char *argv[])
             {
                 std::cerr << "Error: ANTHROPIC_API_KEY environment variable not set" << std::endl;
                 std::cerr << "Set it with: export ANTHROPIC_API_KEY=your_key_here" << std::endl;
-                return EXIT_FAILURE;
+                return EndLibraryLoad(library_load, EXIT_FAILURE);
             }
 
             // Get model selection
@@ -208,7 +533,7 @@ int main(int argc, char *argv[])
             {
                 std::cerr << "Error: --ai-model required for llamacpp backend" << std::endl;
                 std::cerr << "Example: --ai-model=/path/to/model.gguf" << std::endl;
-                return EXIT_FAILURE;
+                return EndLibraryLoad(library_load, EXIT_FAILURE);
             }
 
             std::string model_path = result["ai-model"].as<std::string>();
@@ -243,7 +568,7 @@ int main(int argc, char *argv[])
             {
                 std::cerr << "Error: OPENAI_API_KEY environment variable not set" << std::endl;
                 std::cerr << "Set it with: export OPENAI_API_KEY=your_key_here" << std::endl;
-                return EXIT_FAILURE;
+                return EndLibraryLoad(library_load, EXIT_FAILURE);
             }
 
             // Get model selection
@@ -272,7 +597,7 @@ int main(int argc, char *argv[])
         {
             std::cerr << "Error: Invalid AI backend '" << backend_type << "'" << std::endl;
             std::cerr << "Valid options: 'claude', 'chatgpt', 'llamacpp', or 'keyword'" << std::endl;
-            return EXIT_FAILURE;
+            return EndLibraryLoad(library_load, EXIT_FAILURE);
         }
 
         // Validate backend
@@ -280,7 +605,7 @@ int main(int argc, char *argv[])
         if (!backend->validate(error_msg))
         {
             std::cerr << "Error: " << error_msg << std::endl;
-            return EXIT_FAILURE;
+            return EndLibraryLoad(library_load, EXIT_FAILURE);
         }
 
         // Generate playlist
@@ -289,7 +614,7 @@ int main(int argc, char *argv[])
         if (!track_indices)
         {
             std::cerr << "Error: Failed to generate AI playlist" << std::endl;
-            return EXIT_FAILURE;
+            return EndLibraryLoad(library_load, EXIT_FAILURE);
         }
 
         // Convert indices to track metadata
@@ -305,7 +630,7 @@ int main(int argc, char *argv[])
         if (playlist_tracks.empty())
         {
             std::cerr << "Error: AI generated empty playlist" << std::endl;
-            return EXIT_FAILURE;
+            return EndLibraryLoad(library_load, EXIT_FAILURE);
         }
 
         spdlog::info("Generated AI playlist with {} tracks", playlist_tracks.size());
@@ -350,20 +675,101 @@ int main(int argc, char *argv[])
         return EXIT_FAILURE;
     }
 
+    // Create playlist object
+    Playlist playlist = Playlist::fromTracks(std::move(playlist_tracks));
+
     // Apply shuffle if requested
     if (shuffle)
     {
-        std::random_device rd;
-        std::mt19937 g(rd());
-        std::shuffle(playlist_tracks.begin(), playlist_tracks.end(), g);
-        spdlog::info("Playlist shuffled");
+        const uint64_t seed = result.count("seed") ? result["seed"].as<uint64_t>() : RandomShuffleSeed();
+        playlist.shuffle(seed, true);
+        spdlog::info("Playlist shuffled (seed {})", seed);
     }
 
-    // Create playlist object
-    Playlist playlist = Playlist::fromTracks(playlist_tracks);
-
     // Output playlist
-    if (save_to_file)
+    if (enqueue)
+    {
+        namespace fs = std::filesystem;
+
+        ControlClient client;
+        if (!client.connect(result["control-socket"].as<std::string>()))
+        {
+            return EndLibraryLoad(library_load, EXIT_FAILURE);
+        }
+
+        std::vector<std::string> paths;
+        for (size_t i = 0; i < playlist.size(); ++i)
+        {
+            std::string path(playlist.path(i));
+            std::error_code ec;
+            fs::path absolute = fs::absolute(path, ec);
+            paths.push_back(ec ? path : absolute.string());
+        }
+
+        // As few enqueue-list requests as fit in the player's line limit.
+        // JSON strings cannot carry paths that are not UTF-8; those go one
+        // by one as plain enqueue requests.
+        const std::string list_command = insert_next ? "insert-list" : "enqueue-list";
+        std::vector<std::pair<std::string, std::string>> requests;
+        nlohmann::json batch = nlohmann::json::array();
+        size_t batch_size = 0;
+        auto flush_batch = [&]()
+        {
+            if (!batch.empty())
+            {
+                requests.emplace_back(list_command, batch.dump());
+                batch = nlohmann::json::array();
+                batch_size = 0;
+            }
+        };
+        for (const auto &path : paths)
+        {
+            if (ValidUtf8Prefix(path) != path.size())
+            {
+                flush_batch();
+                requests.emplace_back(insert_next ? "insert" : "enqueue", path);
+                continue;
+            }
+            std::string encoded = nlohmann::json(path).dump();
+            if (batch_size + encoded.size() + list_command.size() + 3 > ControlServer::MAX_LINE)
+            {
+                flush_batch();
+            }
+            batch_size += encoded.size() + 1;
+            batch.push_back(path);
+        }
+        flush_batch();
+
+        // Each insert goes right after the current track, so the last
+        // part of the playlist is inserted first
+        if (insert_next)
+        {
+            std::reverse(requests.begin(), requests.end());
+        }
+
+        size_t queued = 0;
+        for (const auto &[command, argument] : requests)
+        {
+            auto reply = client.request(command, argument);
+            if (!reply)
+            {
+                std::cerr << "Error: Player closed the connection" << std::endl;
+                return EndLibraryLoad(library_load, EXIT_FAILURE);
+            }
+            if (!reply->value("ok", false))
+            {
+                std::cerr << "Warning: " << reply->value("error", std::string("track rejected")) << std::endl;
+                continue;
+            }
+            queued += reply->value("queued", size_t(1));
+            for (const auto &rejected : reply->value("rejected", nlohmann::json::array()))
+            {
+                std::cerr << "Warning: cannot read audio file: " << rejected.get<std::string>() << std::endl;
+            }
+        }
+        std::cerr << "Queued " << queued << " of " << paths.size() << " track(s)" << std::endl;
+    }
+    else if (save_to_file)
     {
         std::string filename = result["save"].as<std::string>();
 
@@ -381,7 +787,7 @@ int main(int argc, char *argv[])
         else
         {
             std::cerr << "Error: Failed to save playlist to file" << std::endl;
-            return EXIT_FAILURE;
+            return EndLibraryLoad(library_load, EXIT_FAILURE);
         }
     }
     else
@@ -390,5 +796,18 @@ int main(int argc, char *argv[])
         std::cout << playlist.toText() << std::endl;
     }
 
-    return EXIT_SUCCESS;
+    // Generation used part of the library; read the rest so the next run
+    // starts from a complete cache. The playlist is already out; close
+    // stdout first so a player reading it sees the end of it.
+    if (library_load && LibraryLoadPending(*library_load))
+    {
+        std::cout.flush();
+        int null_fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+        if (null_fd >= 0)
+        {
+            dup2(null_fd, STDOUT_FILENO);
+            close(null_fd);
+        }
+    }
+    return EndLibraryLoad(library_load, EXIT_SUCCESS, true, library_timeout);
 }
@@ -6,17 +6,24 @@
 #include "player.h"
 #include "metadata.h"
 #include "playlist.h"
+#include "metadata_index.h"
+#include "event_loop.h"
+#include "control_server.h"
+#include "player_control.h"
+#include "shuffle.h"
+#include "library_watcher.h"
 
 #include <csignal>
 #include <cstring>
+#include <unistd.h>
 
 #include <chrono>
 #include <filesystem>
 #include <iomanip>
 #include <iostream>
+#include <memory>
 #include <sstream>
 #include <string>
-#include <thread>
 
 #include <cxxopts.hpp>
 #include <colors.h>
@@ -24,10 +31,15 @@
 #include <spdlog/sinks/basic_file_sink.h>
 
 volatile sig_atomic_t signal_received = 0;
+EventLoop *event_loop = nullptr;
 
 void SignalHandler(int signum)
 {
     signal_received = signum;
+    if (event_loop)
+    {
+        event_loop->notify();
+    }
 }
 
 void Cleanup()
@@ -50,6 +62,7 @@ void PrintHelp()
               << " left - Back 10s\n"
               << "  n   - Next track\n"
               << "  p   - Previous track\n"
+              << "  z   - Shuffle upcoming tracks\n"
               << "  h   - Help\n"
               << "  q  - Quit\n"
               << std::endl;
@@ -262,6 +275,9 @@ bool HandleCommand(char ch,
             player.play();
         }
         break;
+    case 'z':
+        playlist.shuffle(RandomShuffleSeed());
+        break;
     case 'p':
         if (playlist.hasPrevious())
         {
@@ -318,13 +334,6 @@ bool CheckAutoAdvance(AudioPlayer &player,
     return false;
 }
 
-std::string readStdin()
-{
-    std::stringstream buffer;
-    buffer << std::cin.rdbuf();
-    return buffer.str();
-}
-
 int main(int argc, char *argv[])
 {
     // Parse command line arguments using cxxopts
@@ -337,7 +346,15 @@ int main(int argc, char *argv[])
         ("f,file", "Play a single audio file", cxxopts::value<std::string>())
         ("stdin", "Read playlist from stdin")
         ("r,repeat", "Repeat playlist")
+        ("trust-paths", "Use absolute playlist paths as written, without checking or canonicalizing them")
+        ("shuffle", "Shuffle the playlist, spreading out artists and albums")
+        ("seed", "Seed for --shuffle, to repeat an earlier order", cxxopts::value<uint64_t>())
         ("no-interactive", "Disable interactive controls (auto-play only)")
+        ("d,daemon", "Run headless and keep playing whatever is queued over the control socket")
+        ("control-socket", "Unix socket for remote control (empty to disable)",
+         cxxopts::value<std::string>()->default_value(ControlServer::defaultSocketPath()))
+        ("watch-library", "Keep the metadata cache of this music library up to date while running",
+         cxxopts::value<std::string>())
         ("verbose", "Display status and debug information")
         ("h,help", "Print usage");
     // clang-format on
@@ -366,35 +383,25 @@ int main(int argc, char *argv[])
     const bool repeat = result.count("repeat") > 0;
     const bool stdin_mode = result.count("stdin") > 0;
     const bool file_mode = result.count("file") > 0;
-    const bool interactive = result.count("no-interactive") == 0;
+    const bool daemon = result.count("daemon") > 0;
+    const bool interactive = result.count("no-interactive") == 0 && !daemon;
     const bool verbose = result.count("verbose") > 0;
+    const std::string control_socket = result["control-socket"].as<std::string>();
 
     // Initialize logger
     InitializeLogger(verbose);
 
     // Load playlist
     std::optional<Playlist> playlist_opt;
+    std::unique_ptr<PlaylistStream> stdin_stream;
 
     if (stdin_mode)
     {
-        // Read from stdin
-        std::string content = readStdin();
-
-        // Text format - parse paths
-        std::vector<std::string> paths;
-        std::istringstream stream(content);
-        std::string line;
-        while (std::getline(stream, line))
-        {
-            // Trim whitespace
-            line.erase(0, line.find_first_not_of(" \t\r\n"));
-            line.erase(line.find_last_not_of(" \t\r\n") + 1);
-            if (!line.empty() && line[0] != '#')
-            {
-                paths.push_back(line);
-            }
-        }
-        playlist_opt = Playlist::fromPaths(paths);
+        // Plain paths, or an M3U/PLS/XSPF playlist piped in. Playback
+        // starts with the first track; the rest is read while playing,
+        // from a copy of the descriptor since stdin may become the tty.
+        stdin_stream = std::make_unique<PlaylistStream>(dup(STDIN_FILENO));
+        playlist_opt = stdin_stream->start();
 
         if (!playlist_opt)
         {
@@ -434,6 +441,11 @@ int main(int argc, char *argv[])
             return EXIT_FAILURE;
         }
     }
+    else if (daemon)
+    {
+        // Start with an empty queue and wait for tracks
+        playlist_opt = Playlist::fromTracks({});
+    }
     else
     {
         std::cerr << "Error: Please specify a playlist file, --stdin, or --file" << std::endl;
@@ -441,32 +453,61 @@ int main(int argc, char *argv[])
         return EXIT_FAILURE;
     }
 
-    Playlist playlist = *playlist_opt;
+    Playlist playlist = std::move(*playlist_opt);
 
-    // Extract metadata for all tracks upfront (for text-based playlists)
-    playlist.extractAllMetadata();
+    // Metadata is read as tracks come up, with the next few resolved in
+    // the background, so startup costs one file however long the playlist.
+    // Tracks scanned by vibe-playlist come from its cache instead of TagLib.
+    playlist.setTrustAbsolutePaths(result.count("trust-paths") > 0);
+    playlist.setMetadataIndex(std::make_shared<MetadataIndex>());
 
-    if (playlist.empty())
+    // Shuffling keys unread tracks by their directories, so it costs no
+    // more I/O than playing in order
+    const bool shuffle = result.count("shuffle") > 0;
+    const uint64_t shuffle_seed = result.count("seed") ? result["seed"].as<uint64_t>() : RandomShuffleSeed();
+    if (shuffle)
+    {
+        playlist.shuffle(shuffle_seed, true);
+        spdlog::info("Playlist shuffled (seed {})", shuffle_seed);
+    }
+    playlist.enableLookAhead();
+
+    if (playlist.empty() && !daemon)
     {
         std::cerr << "Error: Playlist is empty" << std::endl;
         return EXIT_FAILURE;
     }
 
     AudioPlayer player;
+    EventLoop loop;
+    if (!loop.isValid())
+    {
+        return EXIT_FAILURE;
+    }
 
     // Setup signal handlers
+    event_loop = &loop;
     atexit(Cleanup);
     signal(SIGINT, SignalHandler);
     signal(SIGTERM, SignalHandler);
 
+    // Wake the loop from the audio thread when a track runs out
+    player.setTrackEndCallback([&loop]()
+                               { loop.notify(); });
+
     // Load first track
-    if (!player.loadFile(playlist.current().filepath))
+    if (!playlist.empty() && !player.loadFile(playlist.current().filepath))
     {
         return EXIT_FAILURE;
     }
 
     std::cout << "\nVibe Player - " << playlist.size() << " track(s)";
-    if (interactive)
+    if (daemon)
+    {
+        std::cout << " - Daemon mode, control with vibe-ctl on " << control_socket << "\n"
+                  << std::endl;
+    }
+    else if (interactive)
     {
         std::cout << " - Press 'h' for help, 'p' to play\n"
                   << std::endl;
@@ -484,36 +525,147 @@ int main(int argc, char *argv[])
     if (interactive)
     {
         set_raw_mode(true);
+
+        // Drain every pending key; quick_read may have buffered more than
+        // one byte, and poll() would not report those again
+        loop.watchFd(STDIN_FILENO, [&]()
+                     {
+            int ch;
+            while (running && (ch = quick_read()) != ERR)
+            {
+                HandleCommand(static_cast<char>(ch), player, playlist, running);
+            } });
+    }
+
+    // Remote control; a second player on the same socket just runs without
+    // it, but a daemon has no other way to be driven
+    ControlServer control(loop);
+    bool listening = !control_socket.empty() &&
+                     control.listen(control_socket, [&](const ControlRequest &request)
+                                    { return HandleControlRequest(request, player, playlist, running); });
+    if (daemon && !listening)
+    {
+        std::cerr << "Error: Daemon mode needs a free control socket" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // New and changed library files go into the cache as they land, so
+    // vibe-playlist never has to rescan. Scanning and extraction run on the
+    // watcher's own thread; the loop only hears when the index was rewritten.
+    std::unique_ptr<LibraryWatcher> watcher;
+    // Generation of the index the playlist has mapped; a cold cache saved
+    // by the initial scan already counts as a rewrite
+    uint64_t index_generation = 0;
+    if (result.count("watch-library"))
+    {
+        watcher = std::make_unique<LibraryWatcher>(result["watch-library"].as<std::string>());
+        if (!watcher->startInBackground([&loop]()
+                                        { loop.notify(); }))
+        {
+            std::cerr << "Error: Could not watch library: " << result["watch-library"].as<std::string>() << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    // Tracks still arriving on stdin
+    if (stdin_stream && !stdin_stream->finished())
+    {
+        int stream_fd = stdin_stream->fd();
+        loop.watchFd(stream_fd, [&, stream_fd]()
+                     {
+            stdin_stream->readAvailable(playlist);
+            if (stdin_stream->finished())
+            {
+                loop.unwatchFd(stream_fd);
+                // Tracks that arrived after startup join the shuffle
+                if (shuffle)
+                {
+                    playlist.shuffle(shuffle_seed);
+                }
+            } });
     }
 
     // Start playing automatically
-    player.play();
-    was_playing = true;
+    if (!playlist.empty())
+    {
+        player.play();
+        was_playing = true;
+    }
+
+    // The last queued track has played to the end, but more may follow
+    // (daemon mode, or a playlist still streaming in on stdin)
+    bool queue_finished = false;
 
     while (running && !signal_received)
     {
         // Print status
-        PrintStatus(player, playlist);
+        if (!daemon)
+        {
+            PrintStatus(player, playlist);
+        }
+        control.publishStatus(PlayerStatusJson(player, playlist));
 
-        // Check for input (only in interactive mode)
-        if (interactive)
+        // The status line only shows whole seconds, so tick once a second
+        // while playing and not at all while paused or stopped
+        loop.setTimerInterval(player.isPlaying() ? std::chrono::milliseconds(1000)
+                                                 : std::chrono::milliseconds(0));
+
+        // Sleep until a key, the track-end notification, a signal, the tick
+        // or a rewritten library index
+        if (!loop.runOnce())
+        {
+            break;
+        }
+
+        // Look queued tracks up in the index once it has been rewritten;
+        // changes that were only journaled leave the mapped one current
+        if (watcher)
         {
-            char ch;
-            if ((ch = quick_read()) != ERR)
+            if (watcher->indexGeneration() != index_generation)
             {
-                HandleCommand(ch, player, playlist, running);
+                index_generation = watcher->indexGeneration();
+                playlist.setMetadataIndex(std::make_shared<MetadataIndex>());
             }
         }
 
         // Check for auto-advance and playlist end
         if (CheckAutoAdvance(player, playlist, repeat, was_playing))
         {
-            // Playlist has ended, exit
-            running = false;
+            // Playlist has ended; a daemon idles until more is queued
+            if (daemon || (stdin_stream && !stdin_stream->finished()))
+            {
+                queue_finished = true;
+            }
+            else
+            {
+                running = false;
+            }
+        }
+
+        // Pick up tracks queued into an empty or finished queue
+        if (player.isPlaying())
+        {
+            queue_finished = false;
+        }
+        else if ((daemon || queue_finished) && !player.isPaused() && !playlist.empty())
+        {
+            bool start = !player.isLoaded() || (queue_finished && playlist.hasNext());
+            if (start)
+            {
+                if (player.isLoaded())
+                {
+                    playlist.advance();
+                }
+                queue_finished = false;
+                was_playing = PlayCurrentTrack(player, playlist);
+            }
         }
 
-        // Sleep briefly to avoid busy waiting
-        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        // The piped playlist ended without another track
+        if (queue_finished && !daemon && stdin_stream->finished() && !playlist.hasNext())
+        {
+            running = false;
+        }
     }
     std::cout << std::endl;
 
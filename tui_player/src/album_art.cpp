@@ -0,0 +1,386 @@
+/*
+ * vibe-player
+ * album_art.cpp
+ */
+
+#include "album_art.h"
+#include "album_art_cache.h"
+
+#include <algorithm>
+#include <filesystem>
+
+#include <notcurses/notcurses.h>
+#include <spdlog/spdlog.h>
+
+// TagLib includes for album art extraction
+#include <mpeg/mpegfile.h>
+#include <mpeg/id3v2/id3v2tag.h>
+#include <mpeg/id3v2/id3v2frame.h>
+#include <mpeg/id3v2/frames/attachedpictureframe.h>
+#include <flac/flacfile.h>
+#include <flac/flacpicture.h>
+#include <mp4/mp4file.h>
+#include <mp4/mp4tag.h>
+#include <mp4/mp4coverart.h>
+
+// Embedded covers are JPEG or PNG in practice; decode from memory only
+#define STB_IMAGE_IMPLEMENTATION
+#define STBI_ONLY_JPEG
+#define STBI_ONLY_PNG
+#define STBI_NO_STDIO
+#include <stb_image.h>
+
+#define STB_IMAGE_RESIZE_IMPLEMENTATION
+#include <stb_image_resize2.h>
+
+TagLib::ByteVector ExtractAlbumArt(const std::string &filepath)
+{
+    namespace fs = std::filesystem;
+    std::string ext = fs::path(filepath).extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+
+    // Try MP3/ID3v2
+    if (ext == ".mp3")
+    {
+        TagLib::MPEG::File file(filepath.c_str());
+        if (file.isValid() && file.ID3v2Tag())
+        {
+            auto frameList = file.ID3v2Tag()->frameList("APIC");
+            if (!frameList.isEmpty())
+            {
+                auto *frame = dynamic_cast<TagLib::ID3v2::AttachedPictureFrame *>(frameList.front());
+                if (frame)
+                {
+                    return frame->picture();
+                }
+            }
+        }
+    }
+    // Try FLAC
+    else if (ext == ".flac")
+    {
+        TagLib::FLAC::File file(filepath.c_str());
+        if (file.isValid())
+        {
+            auto pictureList = file.pictureList();
+            if (!pictureList.isEmpty())
+            {
+                return pictureList.front()->data();
+            }
+        }
+    }
+    // Try MP4/M4A
+    else if (ext == ".m4a" || ext == ".mp4")
+    {
+        TagLib::MP4::File file(filepath.c_str());
+        if (file.isValid() && file.tag())
+        {
+            auto itemMap = file.tag()->itemMap();
+            if (itemMap.contains("covr"))
+            {
+                auto coverList = itemMap["covr"].toCoverArtList();
+                if (!coverList.isEmpty())
+                {
+                    return coverList.front().data();
+                }
+            }
+        }
+    }
+
+    return TagLib::ByteVector();
+}
+
+std::optional<AlbumArtImage> DecodeAlbumArt(const TagLib::ByteVector &data)
+{
+    if (data.isEmpty())
+    {
+        return std::nullopt;
+    }
+
+    // The image type is sniffed from the data, so the MIME type is not needed
+    int width = 0, height = 0, channels = 0;
+    unsigned char *pixels = stbi_load_from_memory(
+        reinterpret_cast<const stbi_uc *>(data.data()), static_cast<int>(data.size()),
+        &width, &height, &channels, 4);
+
+    if (!pixels)
+    {
+        spdlog::warn("Failed to decode album art: {}", stbi_failure_reason());
+        return std::nullopt;
+    }
+
+    AlbumArtImage image;
+    image.width = width;
+    image.height = height;
+    image.rgba.assign(pixels, pixels + static_cast<size_t>(width) * height * 4);
+    stbi_image_free(pixels);
+
+    spdlog::debug("Decoded album art: {}x{} pixels", width, height);
+    return image;
+}
+
+struct ncvisual *CreateAlbumArtVisual(const AlbumArtImage &image)
+{
+    if (image.rgba.empty())
+    {
+        return nullptr;
+    }
+    return ncvisual_from_rgba(image.rgba.data(), image.height, image.width * 4, image.width);
+}
+
+AlbumArtImage ScaleAlbumArt(AlbumArtImage image, int max_width, int max_height)
+{
+    // Only ever scale down, preserving aspect ratio
+    double scale = 1.0;
+    if (max_width > 0)
+    {
+        scale = std::min(scale, static_cast<double>(max_width) / image.width);
+    }
+    if (max_height > 0)
+    {
+        scale = std::min(scale, static_cast<double>(max_height) / image.height);
+    }
+    if (scale >= 1.0 || image.rgba.empty())
+    {
+        return image;
+    }
+
+    AlbumArtImage scaled;
+    scaled.width = std::max(1, static_cast<int>(image.width * scale));
+    scaled.height = std::max(1, static_cast<int>(image.height * scale));
+    scaled.rgba.resize(static_cast<size_t>(scaled.width) * scaled.height * 4);
+    if (!stbir_resize_uint8_srgb(image.rgba.data(), image.width, image.height, 0,
+                                 scaled.rgba.data(), scaled.width, scaled.height, 0,
+                                 STBIR_RGBA))
+    {
+        spdlog::warn("Failed to scale album art to {}x{}", scaled.width, scaled.height);
+        return image;
+    }
+    return scaled;
+}
+
+AlbumArtLoader::AlbumArtLoader(std::function<void()> on_ready, AlbumArtCache *cache)
+    : on_ready_(std::move(on_ready)), cache_(cache), worker_(&AlbumArtLoader::run, this)
+{
+}
+
+AlbumArtLoader::~AlbumArtLoader()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    cv_.notify_one();
+    worker_.join();
+
+    for (auto &result : ready_)
+    {
+        if (result.visual)
+        {
+            ncvisual_destroy(result.visual);
+        }
+    }
+}
+
+bool AlbumArtLoader::setTargetSize(int width, int height)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (width == target_width_ && height == target_height_)
+    {
+        return false;
+    }
+
+    target_width_ = width;
+    target_height_ = height;
+
+    for (auto &result : ready_)
+    {
+        if (result.visual)
+        {
+            ncvisual_destroy(result.visual);
+        }
+    }
+    ready_.clear();
+    return true;
+}
+
+void AlbumArtLoader::request(const TrackMetadata &track, bool prefetch)
+{
+    // Tracks of the same album share one cache entry
+    Request req{track.filepath, ""};
+    if (track.artist && track.album)
+    {
+        req.cache_key = AlbumArtCache::albumKey(*track.artist, *track.album);
+    }
+    enqueue(std::move(req), prefetch);
+}
+
+void AlbumArtLoader::request(const std::string &filepath, bool prefetch)
+{
+    enqueue(Request{filepath, ""}, prefetch);
+}
+
+void AlbumArtLoader::enqueue(Request req, bool prefetch)
+{
+    const std::string &filepath = req.filepath;
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    for (const auto &result : ready_)
+    {
+        if (result.filepath == filepath &&
+            result.width == target_width_ && result.height == target_height_)
+        {
+            return;
+        }
+    }
+
+    auto queued = std::find_if(queue_.begin(), queue_.end(),
+                               [&filepath](const Request &r)
+                               { return r.filepath == filepath; });
+    if (queued != queue_.end())
+    {
+        if (prefetch)
+        {
+            return;
+        }
+        queue_.erase(queued);
+    }
+
+    if (prefetch)
+    {
+        queue_.push_back(std::move(req));
+    }
+    else
+    {
+        queue_.push_front(std::move(req));
+    }
+    cv_.notify_one();
+}
+
+std::optional<struct ncvisual *> AlbumArtLoader::take(const std::string &filepath)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto it = ready_.begin(); it != ready_.end(); ++it)
+    {
+        if (it->filepath == filepath &&
+            it->width == target_width_ && it->height == target_height_)
+        {
+            struct ncvisual *visual = it->visual;
+            ready_.erase(it);
+            return visual;
+        }
+    }
+    return std::nullopt;
+}
+
+struct ncvisual *AlbumArtLoader::load(const Request &request, int width, int height)
+{
+    if (!cache_)
+    {
+        auto image = DecodeAlbumArt(ExtractAlbumArt(request.filepath));
+        return image ? CreateAlbumArtVisual(ScaleAlbumArt(std::move(*image), width, height)) : nullptr;
+    }
+
+    // Cache entries are stored at a bucketed size slightly above the target;
+    // NCSCALE_SCALE absorbs the difference when blitting
+    int bucket_width = AlbumArtCache::bucketSize(width);
+    int bucket_height = AlbumArtCache::bucketSize(height);
+
+    // Without an album key the picture has to be read to hash it, but the
+    // expensive decode and scale can still be skipped
+    TagLib::ByteVector data;
+    std::string key = request.cache_key;
+    if (key.empty())
+    {
+        data = ExtractAlbumArt(request.filepath);
+        if (data.isEmpty())
+        {
+            return nullptr;
+        }
+        key = AlbumArtCache::contentKey(data);
+    }
+
+    if (auto cached = cache_->load(key, bucket_width, bucket_height))
+    {
+        return CreateAlbumArtVisual(*cached);
+    }
+
+    if (data.isEmpty())
+    {
+        data = ExtractAlbumArt(request.filepath);
+    }
+
+    auto image = DecodeAlbumArt(data);
+    if (!image)
+    {
+        // Remember albums without art so their other tracks skip TagLib
+        if (data.isEmpty() && !request.cache_key.empty())
+        {
+            cache_->save(key, bucket_width, bucket_height, AlbumArtImage());
+        }
+        return nullptr;
+    }
+
+    AlbumArtImage scaled = ScaleAlbumArt(std::move(*image), bucket_width, bucket_height);
+    cache_->save(key, bucket_width, bucket_height, scaled);
+    return CreateAlbumArtVisual(scaled);
+}
+
+void AlbumArtLoader::run()
+{
+    while (true)
+    {
+        Request req;
+        int width, height;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cv_.wait(lock, [this]()
+                     { return stopping_ || !queue_.empty(); });
+            if (stopping_)
+            {
+                return;
+            }
+            req = std::move(queue_.front());
+            queue_.pop_front();
+            width = target_width_;
+            height = target_height_;
+        }
+
+        const std::string &filepath = req.filepath;
+        struct ncvisual *visual = load(req, width, height);
+        spdlog::debug("Album art {} for: {}", visual ? "ready" : "not found", filepath);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+
+            // Replace any older result for the same track
+            for (auto it = ready_.begin(); it != ready_.end(); ++it)
+            {
+                if (it->filepath == filepath)
+                {
+                    if (it->visual)
+                    {
+                        ncvisual_destroy(it->visual);
+                    }
+                    ready_.erase(it);
+                    break;
+                }
+            }
+
+            ready_.push_back({filepath, width, height, visual});
+            while (ready_.size() > MAX_READY)
+            {
+                if (ready_.front().visual)
+                {
+                    ncvisual_destroy(ready_.front().visual);
+                }
+                ready_.pop_front();
+            }
+        }
+
+        if (on_ready_)
+        {
+            on_ready_();
+        }
+    }
+}
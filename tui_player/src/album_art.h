@@ -0,0 +1,112 @@
+/*
+ * vibe-player
+ * album_art.h
+ */
+
+#ifndef ALBUM_ART_H
+#define ALBUM_ART_H
+
+#include "metadata.h"
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <tbytevector.h>
+
+struct ncvisual;
+
+// Decoded album art, 8-bit RGBA with no row padding
+struct AlbumArtImage
+{
+    std::vector<unsigned char> rgba;
+    int width = 0;
+    int height = 0;
+};
+
+// Find the embedded picture (APIC, FLAC PICTURE or MP4 covr) in an audio file.
+// The returned ByteVector shares TagLib's buffer, no bytes are copied.
+// Returns an empty ByteVector if the file has no album art.
+TagLib::ByteVector ExtractAlbumArt(const std::string &filepath);
+
+// Decode JPEG/PNG bytes to RGBA in memory
+std::optional<AlbumArtImage> DecodeAlbumArt(const TagLib::ByteVector &data);
+
+// Scale an image down to fit max_width x max_height, preserving aspect ratio.
+// Images that already fit are returned unchanged.
+AlbumArtImage ScaleAlbumArt(AlbumArtImage image, int max_width, int max_height);
+
+// Wrap a decoded image in an ncvisual (caller owns the result)
+struct ncvisual *CreateAlbumArtVisual(const AlbumArtImage &image);
+
+class AlbumArtCache;
+
+// Background worker that extracts, decodes and pre-scales album art so the
+// UI thread only has to swap in a finished ncvisual. Scaled art is kept in
+// an on-disk AlbumArtCache so later tracks of an album skip the decode.
+class AlbumArtLoader
+{
+public:
+    // on_ready is called from the worker thread after each finished request.
+    // cache may be null to disable the on-disk cache.
+    AlbumArtLoader(std::function<void()> on_ready, AlbumArtCache *cache);
+    ~AlbumArtLoader();
+
+    AlbumArtLoader(const AlbumArtLoader &) = delete;
+    AlbumArtLoader &operator=(const AlbumArtLoader &) = delete;
+
+    // Pixel box that art is scaled down to fit.
+    // Returns true if the size changed; finished results are then discarded.
+    bool setTargetSize(int width, int height);
+
+    // Queue art for a track. Current requests run before any prefetch.
+    void request(const TrackMetadata &track, bool prefetch = false);
+    // Same for a track whose tags have not been read; its cache entry is
+    // found by the picture's contents instead of the album
+    void request(const std::string &filepath, bool prefetch = false);
+
+    // Hand over finished art for a track at the current target size.
+    // Returns nullopt if it is not ready yet. A ready result holds nullptr
+    // when the track has no art. The caller owns the returned visual.
+    std::optional<struct ncvisual *> take(const std::string &filepath);
+
+private:
+    struct Request
+    {
+        std::string filepath;
+        std::string cache_key; // Album key, or empty to hash the picture
+    };
+
+    struct Result
+    {
+        std::string filepath;
+        int width;
+        int height;
+        struct ncvisual *visual;
+    };
+
+    // Finished results kept around for prefetched tracks
+    static constexpr size_t MAX_READY = 4;
+
+    void enqueue(Request request, bool prefetch);
+    void run();
+    struct ncvisual *load(const Request &request, int width, int height);
+
+    std::function<void()> on_ready_;
+    AlbumArtCache *cache_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<Request> queue_;
+    std::deque<Result> ready_;
+    int target_width_ = 0;
+    int target_height_ = 0;
+    bool stopping_ = false;
+    std::thread worker_;
+};
+
+#endif // ALBUM_ART_H
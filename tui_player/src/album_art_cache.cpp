@@ -0,0 +1,258 @@
+/*
+ * vibe-player
+ * album_art_cache.cpp
+ */
+
+#include "album_art_cache.h"
+#include "fnv_hash.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+#include <unistd.h>
+
+#include <spdlog/spdlog.h>
+
+namespace
+{
+    // Entry file layout: header followed by width * height * 4 bytes of RGBA
+    struct EntryHeader
+    {
+        char magic[4];
+        uint32_t version;
+        uint32_t width;
+        uint32_t height;
+    };
+
+    constexpr char ENTRY_MAGIC[4] = {'V', 'P', 'A', 'A'};
+    constexpr uint32_t ENTRY_VERSION = 1;
+
+    // A temporary file this old belongs to a save that failed or a player
+    // that died; a save in progress takes milliseconds
+    constexpr auto STALE_TEMP_AGE = std::chrono::minutes(10);
+
+    std::string toHex(uint64_t value)
+    {
+        char buf[17];
+        snprintf(buf, sizeof(buf), "%016llx", static_cast<unsigned long long>(value));
+        return buf;
+    }
+}
+
+AlbumArtCache::AlbumArtCache(const std::string &cache_dir, uint64_t max_bytes)
+    : cache_dir_(cache_dir.empty() ? std::string(getenv("HOME") ? getenv("HOME") : ".") + "/.cache/tui-player/album_art" : cache_dir),
+      max_bytes_(max_bytes)
+{
+    ensureCacheDirectoryExists();
+}
+
+void AlbumArtCache::ensureCacheDirectoryExists()
+{
+    namespace fs = std::filesystem;
+    std::error_code ec;
+    fs::create_directories(cache_dir_, ec);
+    if (ec)
+    {
+        spdlog::warn("Could not create album art cache directory {}: {}", cache_dir_, ec.message());
+    }
+}
+
+int AlbumArtCache::bucketSize(int pixels)
+{
+    // Powers of two and the midpoints between them
+    static const int buckets[] = {32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024, 1536, 2048};
+    for (int bucket : buckets)
+    {
+        if (pixels <= bucket)
+        {
+            return bucket;
+        }
+    }
+    return pixels;
+}
+
+std::string AlbumArtCache::albumKey(const std::string &artist, const std::string &album)
+{
+    uint64_t hash = Fnv1aHash(artist);
+    hash = Fnv1aHash("\x1f", 1, hash);
+    hash = Fnv1aHash(album, hash);
+    return "a" + toHex(hash);
+}
+
+std::string AlbumArtCache::contentKey(const TagLib::ByteVector &data)
+{
+    return "c" + toHex(Fnv1aHash(data.data(), data.size()));
+}
+
+std::string AlbumArtCache::getEntryPath(const std::string &key, int width, int height) const
+{
+    return cache_dir_ + "/" + key + "_" + std::to_string(width) + "x" + std::to_string(height) + ".rgba";
+}
+
+std::optional<AlbumArtImage> AlbumArtCache::load(const std::string &key, int width, int height)
+{
+    namespace fs = std::filesystem;
+
+    std::string path = getEntryPath(key, width, height);
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open())
+    {
+        return std::nullopt;
+    }
+
+    // Images are scaled to fit the requested size, or are the empty "no
+    // art" marker; anything else, or a file of any other length, is
+    // corrupt and must not decide how much is allocated
+    EntryHeader header;
+    std::error_code size_ec;
+    uint64_t file_size = fs::file_size(path, size_ec);
+    bool valid = file.read(reinterpret_cast<char *>(&header), sizeof(header)) &&
+                 memcmp(header.magic, ENTRY_MAGIC, sizeof(ENTRY_MAGIC)) == 0 &&
+                 header.version == ENTRY_VERSION &&
+                 header.width <= static_cast<uint32_t>(std::max(width, 0)) &&
+                 header.height <= static_cast<uint32_t>(std::max(height, 0)) &&
+                 (header.width == 0) == (header.height == 0) &&
+                 !size_ec && file_size == sizeof(header) + static_cast<uint64_t>(header.width) * header.height * 4;
+    if (!valid)
+    {
+        spdlog::warn("Ignoring invalid album art cache entry: {}", path);
+        file.close();
+        std::error_code ec;
+        fs::remove(path, ec);
+        return std::nullopt;
+    }
+
+    AlbumArtImage image;
+    image.width = static_cast<int>(header.width);
+    image.height = static_cast<int>(header.height);
+    image.rgba.resize(static_cast<size_t>(header.width) * header.height * 4);
+    if (!file.read(reinterpret_cast<char *>(image.rgba.data()), image.rgba.size()))
+    {
+        spdlog::warn("Truncated album art cache entry: {}", path);
+        return std::nullopt;
+    }
+
+    // Touch the entry so eviction treats it as recently used
+    std::error_code ec;
+    fs::last_write_time(path, fs::file_time_type::clock::now(), ec);
+
+    spdlog::debug("Album art cache hit: {}", path);
+    return image;
+}
+
+bool AlbumArtCache::save(const std::string &key, int width, int height, const AlbumArtImage &image)
+{
+    namespace fs = std::filesystem;
+
+    // Write under a unique name and rename so concurrent players never see
+    // a partial entry
+    std::string path = getEntryPath(key, width, height);
+    std::string temp_path = path + ".tmp" + std::to_string(getpid());
+    {
+        std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+        if (!file.is_open())
+        {
+            spdlog::warn("Could not write album art cache entry: {}", temp_path);
+            return false;
+        }
+
+        EntryHeader header;
+        memcpy(header.magic, ENTRY_MAGIC, sizeof(ENTRY_MAGIC));
+        header.version = ENTRY_VERSION;
+        header.width = static_cast<uint32_t>(image.width);
+        header.height = static_cast<uint32_t>(image.height);
+        file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char *>(image.rgba.data()), image.rgba.size());
+        if (!file)
+        {
+            file.close();
+            std::error_code ec;
+            fs::remove(temp_path, ec);
+            return false;
+        }
+    }
+
+    std::error_code ec;
+    fs::rename(temp_path, path, ec);
+    if (ec)
+    {
+        spdlog::warn("Could not store album art cache entry {}: {}", path, ec.message());
+        fs::remove(temp_path, ec);
+        return false;
+    }
+
+    evict();
+    return true;
+}
+
+void AlbumArtCache::evict()
+{
+    namespace fs = std::filesystem;
+
+    struct Entry
+    {
+        fs::path path;
+        uint64_t size;
+        fs::file_time_type mtime;
+    };
+
+    std::vector<Entry> entries;
+    uint64_t total = 0;
+    std::error_code ec;
+    auto stale = fs::file_time_type::clock::now() - STALE_TEMP_AGE;
+    for (const auto &dirent : fs::directory_iterator(cache_dir_, ec))
+    {
+        // Left behind by save() as <entry>.rgba.tmp<pid>
+        if (dirent.path().extension().string().starts_with(".tmp"))
+        {
+            std::error_code temp_ec;
+            auto mtime = dirent.last_write_time(temp_ec);
+            if (!temp_ec && mtime < stale)
+            {
+                fs::remove(dirent.path(), temp_ec);
+            }
+            continue;
+        }
+        if (dirent.path().extension() != ".rgba")
+        {
+            continue;
+        }
+        std::error_code entry_ec;
+        uint64_t size = dirent.file_size(entry_ec);
+        auto mtime = dirent.last_write_time(entry_ec);
+        if (entry_ec)
+        {
+            continue;
+        }
+        entries.push_back({dirent.path(), size, mtime});
+        total += size;
+    }
+
+    if (total <= max_bytes_)
+    {
+        return;
+    }
+
+    // Least recently used first
+    std::sort(entries.begin(), entries.end(),
+              [](const Entry &a, const Entry &b)
+              { return a.mtime < b.mtime; });
+
+    for (const auto &entry : entries)
+    {
+        if (total <= max_bytes_)
+        {
+            break;
+        }
+        if (fs::remove(entry.path, ec))
+        {
+            total -= entry.size;
+            spdlog::debug("Evicted album art cache entry: {}", entry.path.string());
+        }
+    }
+}
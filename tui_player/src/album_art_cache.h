@@ -0,0 +1,51 @@
+/*
+ * vibe-player
+ * album_art_cache.h
+ */
+
+#ifndef ALBUM_ART_CACHE_H
+#define ALBUM_ART_CACHE_H
+
+#include "album_art.h"
+
+#include <cstdint>
+#include <optional>
+#include <string>
+
+// Persistent cache of pre-scaled album art as raw RGBA.
+// Entries are keyed by album (or picture content) and a size bucket, and the
+// least recently used entries are evicted once the cache exceeds max_bytes.
+class AlbumArtCache
+{
+public:
+    static constexpr uint64_t DEFAULT_MAX_BYTES = 64ull * 1024 * 1024;
+
+    explicit AlbumArtCache(const std::string &cache_dir = "", uint64_t max_bytes = DEFAULT_MAX_BYTES);
+
+    // Cached image for key at a bucketed size. An image with zero width means
+    // the album is known to have no art.
+    std::optional<AlbumArtImage> load(const std::string &key, int width, int height);
+
+    // Store an image (or an empty "no art" marker) and evict old entries
+    bool save(const std::string &key, int width, int height, const AlbumArtImage &image);
+
+    void setMaxBytes(uint64_t max_bytes) { max_bytes_ = max_bytes; }
+
+    // Round a pixel dimension up to a common size so nearby terminal
+    // geometries share entries
+    static int bucketSize(int pixels);
+
+    // Cache keys: artist+album when both are known, else the picture bytes
+    static std::string albumKey(const std::string &artist, const std::string &album);
+    static std::string contentKey(const TagLib::ByteVector &data);
+
+private:
+    std::string cache_dir_;
+    uint64_t max_bytes_;
+
+    std::string getEntryPath(const std::string &key, int width, int height) const;
+    void ensureCacheDirectoryExists();
+    void evict();
+};
+
+#endif // ALBUM_ART_CACHE_H
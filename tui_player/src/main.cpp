@@ -6,36 +6,44 @@
 #include "player.h"
 #include "metadata.h"
 #include "playlist.h"
+#include "metadata_index.h"
+#include "event_loop.h"
+#include "control_server.h"
+#include "player_control.h"
+#include "shuffle.h"
+#include "album_art.h"
+#include "album_art_cache.h"
 
 #include <csignal>
 #include <cstring>
+#include <unistd.h>
 
 #include <algorithm>
 #include <atomic>
 #include <chrono>
 #include <filesystem>
-#include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <memory>
 #include <sstream>
 #include <string>
-#include <thread>
 
 #include <cxxopts.hpp>
 #include <notcurses/notcurses.h>
 #include <spdlog/spdlog.h>
 #include <spdlog/sinks/basic_file_sink.h>
 
-// TagLib includes for album art extraction
-#include <mpeg/mpegfile.h>
-#include <mpeg/id3v2/id3v2tag.h>
-#include <mpeg/id3v2/id3v2frame.h>
-#include <mpeg/id3v2/frames/attachedpictureframe.h>
-#include <flac/flacfile.h>
-#include <flac/flacpicture.h>
-#include <mp4/mp4file.h>
-#include <mp4/mp4tag.h>
-#include <mp4/mp4coverart.h>
+// Last values drawn on the dynamic status rows, so an update only
+// rewrites the rows and progress bar cells that actually changed
+struct StatusCache {
+    std::string state_line;
+    std::string info_line;
+    int progress_x = -1;
+    int progress_width = -1;
+    int progress_filled = -1;
+
+    void invalidate() { *this = StatusCache(); }
+};
 
 // Structure to hold all UI planes
 struct UIPlanes {
@@ -44,6 +52,10 @@ struct UIPlanes {
     struct ncplane* help_plane = nullptr;
     struct ncplane* art_plane = nullptr;
     struct ncvisual* album_art_visual = nullptr;
+
+    // Album art is only blitted when the visual or its plane changes
+    bool art_dirty = true;
+    StatusCache status;
 };
 
 // Parse blitter name from command-line string
@@ -123,10 +135,15 @@ struct ncplane* BlitWithFallback(struct notcurses* nc, struct ncvisual* visual,
 
 volatile sig_atomic_t signal_received = 0;
 struct notcurses* nc = nullptr;
+EventLoop* event_loop = nullptr;
 
 void SignalHandler(int signum)
 {
     signal_received = signum;
+    if (event_loop)
+    {
+        event_loop->notify();
+    }
 }
 
 void Cleanup()
@@ -201,121 +218,33 @@ void InitializeLogger(bool verbose)
     }
 }
 
-// Extract album art from audio file and save to temporary file
-std::string ExtractAlbumArt(const std::string &filepath)
+// Draw one progress bar cell; index is relative to the inside of the brackets
+void DrawProgressCell(struct ncplane* status_plane, int progress_x, int index, int filled)
 {
-    namespace fs = std::filesystem;
-    std::string ext = fs::path(filepath).extension().string();
-    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
-
-    std::vector<unsigned char> image_data;
-    std::string mime_type;
-
-    // Try MP3/ID3v2
-    if (ext == ".mp3")
-    {
-        TagLib::MPEG::File file(filepath.c_str());
-        if (file.isValid() && file.ID3v2Tag())
-        {
-            auto frameList = file.ID3v2Tag()->frameList("APIC");
-            if (!frameList.isEmpty())
-            {
-                auto *frame = dynamic_cast<TagLib::ID3v2::AttachedPictureFrame *>(frameList.front());
-                if (frame)
-                {
-                    auto picture = frame->picture();
-                    image_data.assign(picture.data(), picture.data() + picture.size());
-                    mime_type = frame->mimeType().to8Bit();
-                }
-            }
-        }
-    }
-    // Try FLAC
-    else if (ext == ".flac")
-    {
-        TagLib::FLAC::File file(filepath.c_str());
-        if (file.isValid())
-        {
-            auto pictureList = file.pictureList();
-            if (!pictureList.isEmpty())
-            {
-                auto picture = pictureList.front();
-                auto data = picture->data();
-                image_data.assign(data.data(), data.data() + data.size());
-                mime_type = picture->mimeType().to8Bit();
-            }
-        }
-    }
-    // Try MP4/M4A
-    else if (ext == ".m4a" || ext == ".mp4")
+    if (index < filled)
     {
-        TagLib::MP4::File file(filepath.c_str());
-        if (file.isValid() && file.tag())
-        {
-            auto itemMap = file.tag()->itemMap();
-            if (itemMap.contains("covr"))
-            {
-                auto coverList = itemMap["covr"].toCoverArtList();
-                if (!coverList.isEmpty())
-                {
-                    auto cover = coverList.front();
-                    auto data = cover.data();
-                    image_data.assign(data.data(), data.data() + data.size());
-
-                    // Determine extension from format
-                    switch (cover.format())
-                    {
-                        case TagLib::MP4::CoverArt::JPEG:
-                            mime_type = "image/jpeg";
-                            break;
-                        case TagLib::MP4::CoverArt::PNG:
-                            mime_type = "image/png";
-                            break;
-                        default:
-                            mime_type = "image/jpeg";
-                            break;
-                    }
-                }
-            }
-        }
-    }
-
-    // If no album art found, return empty string
-    if (image_data.empty())
-    {
-        return "";
-    }
-
-    // Determine file extension from MIME type
-    std::string file_ext = ".jpg";
-    if (mime_type == "image/png")
-    {
-        file_ext = ".png";
+        ncplane_set_fg_rgb8(status_plane, 0x7F, 0xC8, 0xA0); // Sea green
+        ncplane_putstr_yx(status_plane, 5, progress_x + 1 + index, "━");
     }
-
-    // Save to temporary file
-    std::string home = std::getenv("HOME") ? std::getenv("HOME") : ".";
-    fs::path temp_path = fs::path(home) / ".cache" / "tui-player" / ("album_art" + file_ext);
-
-    try
+    else if (index == filled)
     {
-        std::ofstream out(temp_path, std::ios::binary);
-        out.write(reinterpret_cast<const char*>(image_data.data()), image_data.size());
-        out.close();
-
-        spdlog::debug("Extracted album art to: {}", temp_path.string());
-        return temp_path.string();
+        ncplane_set_fg_rgb8(status_plane, 0x98, 0xD8, 0xC8); // Lighter mint
+        ncplane_putstr_yx(status_plane, 5, progress_x + 1 + index, "▶");
     }
-    catch (const std::exception &e)
+    else
     {
-        spdlog::error("Failed to save album art: {}", e.what());
-        return "";
+        ncplane_set_fg_rgb8(status_plane, 0x50, 0x50, 0x48); // Dark warm gray
+        ncplane_putstr_yx(status_plane, 5, progress_x + 1 + index, "─");
     }
 }
 
-// Update only the dynamic status information (time, progress, volume, state)
-void DrawStatusUpdate(struct ncplane* status_plane, AudioPlayer &player, const Playlist &playlist)
+// Update only the dynamic status information (time, progress, volume, state).
+// Rows and progress cells that match the last draw are left untouched.
+void DrawStatusUpdate(UIPlanes& planes, AudioPlayer &player, const Playlist &playlist)
 {
+    struct ncplane* status_plane = planes.status_plane;
+    StatusCache& cache = planes.status;
+
     // If status_plane is null (terminal too small), skip drawing
     if (!status_plane)
     {
@@ -323,8 +252,6 @@ void DrawStatusUpdate(struct ncplane* status_plane, AudioPlayer &player, const P
     }
 
     // Get dimensions for centering
-    unsigned int rows, cols;
-    ncplane_dim_yx(status_plane, &rows, &cols);
     unsigned int term_cols;
     ncplane_dim_yx(ncplane_parent(status_plane), nullptr, &term_cols);
 
@@ -355,26 +282,27 @@ void DrawStatusUpdate(struct ncplane* status_plane, AudioPlayer &player, const P
         state_color = 0xF09A8A; // Soft coral
     }
 
-    // Clear only lines 4-6 (state, progress, volume - the dynamic parts)
-    ncplane_putstr_yx(status_plane, 4, 0, std::string(term_cols, ' ').c_str());
-    ncplane_putstr_yx(status_plane, 5, 0, std::string(term_cols, ' ').c_str());
-    ncplane_putstr_yx(status_plane, 6, 0, std::string(term_cols, ' ').c_str());
-
     // Line 4: State and time
     char time_buf[32];
     snprintf(time_buf, sizeof(time_buf), "  %02d:%02d / %02d:%02d",
              pos / 60000, (pos / 1000) % 60,
              (dur / 1000) / 60, (dur / 1000) % 60);
     std::string state_line = state + time_buf;
-    int state_x = (term_cols - state_line.length()) / 2;
+    if (state_line != cache.state_line)
+    {
+        int state_x = (term_cols - state_line.length()) / 2;
+
+        ncplane_erase_region(status_plane, 4, 0, 1, 0);
+        ncplane_set_fg_rgb8(status_plane, (state_color >> 16) & 0xFF,
+                            (state_color >> 8) & 0xFF, state_color & 0xFF);
+        ncplane_set_styles(status_plane, NCSTYLE_BOLD);
+        ncplane_putstr_yx(status_plane, 4, state_x, state.c_str());
+        ncplane_set_styles(status_plane, NCSTYLE_NONE);
+        ncplane_set_fg_rgb8(status_plane, 0x7F, 0xC8, 0xA0); // Sea green
+        ncplane_putstr(status_plane, time_buf);
 
-    ncplane_set_fg_rgb8(status_plane, (state_color >> 16) & 0xFF,
-                        (state_color >> 8) & 0xFF, state_color & 0xFF);
-    ncplane_set_styles(status_plane, NCSTYLE_BOLD);
-    ncplane_putstr_yx(status_plane, 4, state_x, state.c_str());
-    ncplane_set_styles(status_plane, NCSTYLE_NONE);
-    ncplane_set_fg_rgb8(status_plane, 0x7F, 0xC8, 0xA0); // Sea green
-    ncplane_putstr(status_plane, time_buf);
+        cache.state_line = std::move(state_line);
+    }
 
     // Progress bar (line 5) - centered with max width
     int progress_width = std::min(max_status_width, static_cast<int>(term_cols - 4));
@@ -384,28 +312,33 @@ void DrawStatusUpdate(struct ncplane* status_plane, AudioPlayer &player, const P
         int filled = static_cast<int>(progress * (progress_width - 2));
         int progress_x = (term_cols - progress_width) / 2;
 
-        ncplane_set_fg_rgb8(status_plane, 0x7F, 0xC8, 0xA0); // Sea green
-        ncplane_putstr_yx(status_plane, 5, progress_x, "[");
-        for (int i = 0; i < progress_width - 2; ++i)
+        if (progress_x != cache.progress_x || progress_width != cache.progress_width)
         {
-            if (i < filled)
-            {
-                ncplane_set_fg_rgb8(status_plane, 0x7F, 0xC8, 0xA0); // Sea green
-                ncplane_putstr(status_plane, "━");
-            }
-            else if (i == filled)
+            // Geometry changed: draw the whole bar
+            ncplane_erase_region(status_plane, 5, 0, 1, 0);
+            ncplane_set_fg_rgb8(status_plane, 0x7F, 0xC8, 0xA0); // Sea green
+            ncplane_putstr_yx(status_plane, 5, progress_x, "[");
+            for (int i = 0; i < progress_width - 2; ++i)
             {
-                ncplane_set_fg_rgb8(status_plane, 0x98, 0xD8, 0xC8); // Lighter mint
-                ncplane_putstr(status_plane, "▶");
+                DrawProgressCell(status_plane, progress_x, i, filled);
             }
-            else
+            ncplane_set_fg_rgb8(status_plane, 0x7F, 0xC8, 0xA0); // Sea green
+            ncplane_putstr_yx(status_plane, 5, progress_x + progress_width - 1, "]");
+        }
+        else if (filled != cache.progress_filled)
+        {
+            // Only the cells between the old and new marker change
+            int first = std::max(0, std::min(filled, cache.progress_filled));
+            int last = std::min(progress_width - 3, std::max(filled, cache.progress_filled));
+            for (int i = first; i <= last; ++i)
             {
-                ncplane_set_fg_rgb8(status_plane, 0x50, 0x50, 0x48); // Dark warm gray
-                ncplane_putstr(status_plane, "─");
+                DrawProgressCell(status_plane, progress_x, i, filled);
             }
         }
-        ncplane_set_fg_rgb8(status_plane, 0x7F, 0xC8, 0xA0); // Sea green
-        ncplane_putstr(status_plane, "]");
+
+        cache.progress_x = progress_x;
+        cache.progress_width = progress_width;
+        cache.progress_filled = filled;
     }
 
     // Line 6: Volume and track info - centered
@@ -419,9 +352,14 @@ void DrawStatusUpdate(struct ncplane* status_plane, AudioPlayer &player, const P
     {
         snprintf(info_buf, sizeof(info_buf), "Volume: %3d%%", (int)(vol * 100));
     }
-    int info_x = (term_cols - strlen(info_buf)) / 2;
-    ncplane_set_fg_rgb8(status_plane, 0xC4, 0xA7, 0xD6); // Soft purple
-    ncplane_putstr_yx(status_plane, 6, info_x, info_buf);
+    if (cache.info_line != info_buf)
+    {
+        int info_x = (term_cols - strlen(info_buf)) / 2;
+        ncplane_erase_region(status_plane, 6, 0, 1, 0);
+        ncplane_set_fg_rgb8(status_plane, 0xC4, 0xA7, 0xD6); // Soft purple
+        ncplane_putstr_yx(status_plane, 6, info_x, info_buf);
+        cache.info_line = info_buf;
+    }
 }
 
 void DrawUI(UIPlanes& planes, AudioPlayer &player, const Playlist &playlist, bool show_help, ncblitter_e blitter)
@@ -432,11 +370,11 @@ void DrawUI(UIPlanes& planes, AudioPlayer &player, const Playlist &playlist, boo
         return;
     }
 
-    // Clear planes
+    // Clear text planes; the art plane keeps its blitted image
     ncplane_erase(planes.stdplane);
     ncplane_erase(planes.status_plane);
     ncplane_erase(planes.help_plane);
-    ncplane_erase(planes.art_plane);
+    planes.status.invalidate();
 
     // Get dimensions
     unsigned int rows, cols;
@@ -449,19 +387,26 @@ void DrawUI(UIPlanes& planes, AudioPlayer &player, const Playlist &playlist, boo
     ncplane_putstr_yx(planes.stdplane, 0, (cols - title.length()) / 2, title.c_str());
     ncplane_set_styles(planes.stdplane, NCSTYLE_NONE);
 
-    // Draw album art if available
-    if (planes.album_art_visual)
+    // Draw album art only when it changed; re-blitting is the most expensive
+    // part of a redraw, especially with pixel blitters over SSH
+    if (planes.art_dirty)
     {
-        struct ncvisual_options vopts = {};
-        vopts.n = planes.art_plane;
-        vopts.scaling = NCSCALE_SCALE;
-        vopts.flags = 0;
-
-        // Render the visual with fallback support
-        struct ncplane* result = BlitWithFallback(nc, planes.album_art_visual, &vopts, blitter);
-        if (result == nullptr)
+        ncplane_erase(planes.art_plane);
+        planes.art_dirty = false;
+
+        if (planes.album_art_visual)
         {
-            spdlog::warn("Failed to blit album art visual with any blitter");
+            struct ncvisual_options vopts = {};
+            vopts.n = planes.art_plane;
+            vopts.scaling = NCSCALE_SCALE;
+            vopts.flags = 0;
+
+            // Render the visual with fallback support
+            struct ncplane* result = BlitWithFallback(nc, planes.album_art_visual, &vopts, blitter);
+            if (result == nullptr)
+            {
+                spdlog::warn("Failed to blit album art visual with any blitter");
+            }
         }
     }
 
@@ -549,7 +494,7 @@ void DrawUI(UIPlanes& planes, AudioPlayer &player, const Playlist &playlist, boo
     // Line 3: Empty line for spacing
 
     // Lines 4-6: Dynamic status (state, progress, volume) - drawn by DrawStatusUpdate
-    DrawStatusUpdate(planes.status_plane, player, playlist);
+    DrawStatusUpdate(planes, player, playlist);
 
     // Help text
     if (show_help)
@@ -566,7 +511,7 @@ void DrawUI(UIPlanes& planes, AudioPlayer &player, const Playlist &playlist, boo
             "  u       - Pause              n       - Next track",
             "  +/=/Up  - Volume up          p       - Previous track",
             "  -/Down  - Volume down        h       - Toggle help",
-            "  q       - Quit"
+            "  z       - Shuffle upcoming   q       - Quit"
         };
 
         for (size_t i = 0; i < sizeof(help_lines) / sizeof(help_lines[0]); ++i)
@@ -645,6 +590,10 @@ bool HandleCommand(char32_t ch,
             player.play();
         }
         break;
+    case 'z':
+    case 'Z':
+        playlist.shuffle(RandomShuffleSeed());
+        break;
     case 'p':
     case 'P':
         if (playlist.hasPrevious())
@@ -701,13 +650,6 @@ bool CheckAutoAdvance(AudioPlayer &player,
     return false;
 }
 
-std::string readStdin()
-{
-    std::stringstream buffer;
-    buffer << std::cin.rdbuf();
-    return buffer.str();
-}
-
 int main(int argc, char *argv[])
 {
     // Parse command line arguments using cxxopts
@@ -720,8 +662,15 @@ int main(int argc, char *argv[])
         ("f,file", "Play a single audio file", cxxopts::value<std::string>())
         ("stdin", "Read playlist from stdin")
         ("r,repeat", "Repeat playlist")
+        ("trust-paths", "Use absolute playlist paths as written, without checking or canonicalizing them")
+        ("shuffle", "Shuffle the playlist, spreading out artists and albums")
+        ("seed", "Seed for --shuffle, to repeat an earlier order", cxxopts::value<uint64_t>())
         ("b,blitter", "Image blitter for album art (default|ascii|half|quad|sextant|braille|pixel)",
          cxxopts::value<std::string>()->default_value("default"))
+        ("art-cache-size", "Album art cache size limit in MB (0 disables the cache)",
+         cxxopts::value<int>()->default_value("64"))
+        ("control-socket", "Unix socket for remote control (empty to disable)",
+         cxxopts::value<std::string>()->default_value(ControlServer::defaultSocketPath()))
         ("verbose", "Display status and debug information")
         ("h,help", "Print usage");
     // clang-format on
@@ -763,27 +712,15 @@ int main(int argc, char *argv[])
 
     // Load playlist
     std::optional<Playlist> playlist_opt;
+    std::unique_ptr<PlaylistStream> stdin_stream;
 
     if (stdin_mode)
     {
-        // Read from stdin
-        std::string content = readStdin();
-
-        // Text format - parse paths
-        std::vector<std::string> paths;
-        std::istringstream stream(content);
-        std::string line;
-        while (std::getline(stream, line))
-        {
-            // Trim whitespace
-            line.erase(0, line.find_first_not_of(" \t\r\n"));
-            line.erase(line.find_last_not_of(" \t\r\n") + 1);
-            if (!line.empty() && line[0] != '#')
-            {
-                paths.push_back(line);
-            }
-        }
-        playlist_opt = Playlist::fromPaths(paths);
+        // Plain paths, or an M3U/PLS/XSPF playlist piped in. Playback
+        // starts with the first track; the rest is read while playing,
+        // from a copy of the descriptor since stdin becomes the tty.
+        stdin_stream = std::make_unique<PlaylistStream>(dup(STDIN_FILENO));
+        playlist_opt = stdin_stream->start();
 
         if (!playlist_opt)
         {
@@ -827,10 +764,24 @@ int main(int argc, char *argv[])
         return EXIT_FAILURE;
     }
 
-    Playlist playlist = *playlist_opt;
+    Playlist playlist = std::move(*playlist_opt);
+
+    // Metadata is read as tracks come up, with the next few resolved in
+    // the background, so startup costs one file however long the playlist.
+    // Tracks scanned by vibe-playlist come from its cache instead of TagLib.
+    playlist.setTrustAbsolutePaths(result.count("trust-paths") > 0);
+    playlist.setMetadataIndex(std::make_shared<MetadataIndex>());
 
-    // Extract metadata for all tracks upfront (for text-based playlists)
-    playlist.extractAllMetadata();
+    // Shuffling keys unread tracks by their directories, so it costs no
+    // more I/O than playing in order
+    const bool shuffle = result.count("shuffle") > 0;
+    const uint64_t shuffle_seed = result.count("seed") ? result["seed"].as<uint64_t>() : RandomShuffleSeed();
+    if (shuffle)
+    {
+        playlist.shuffle(shuffle_seed, true);
+        spdlog::info("Playlist shuffled (seed {})", shuffle_seed);
+    }
+    playlist.enableLookAhead();
 
     if (playlist.empty())
     {
@@ -839,12 +790,21 @@ int main(int argc, char *argv[])
     }
 
     AudioPlayer player;
+    EventLoop loop;
+    if (!loop.isValid())
+    {
+        return EXIT_FAILURE;
+    }
 
     // Setup signal handlers
+    event_loop = &loop;
     atexit(Cleanup);
     signal(SIGINT, SignalHandler);
     signal(SIGTERM, SignalHandler);
 
+    // Wake the loop from the audio thread when a track runs out
+    player.setTrackEndCallback([&loop]() { loop.notify(); });
+
     // Load first track
     if (!player.loadFile(playlist.current().filepath))
     {
@@ -871,6 +831,37 @@ int main(int argc, char *argv[])
     ncplane_erase(planes.stdplane);
     notcurses_render(nc);
 
+    // Album art is extracted, decoded and scaled off the UI thread, with
+    // scaled covers kept on disk for the other tracks of an album
+    const int art_cache_mb = result["art-cache-size"].as<int>();
+    std::optional<AlbumArtCache> art_cache;
+    if (art_cache_mb > 0)
+    {
+        art_cache.emplace("", static_cast<uint64_t>(art_cache_mb) * 1024 * 1024);
+    }
+    AlbumArtLoader art_loader([&loop]() { loop.notify(); }, art_cache ? &*art_cache : nullptr);
+    bool art_pending = false;
+
+    // Queue art for the current track and prefetch the next one
+    auto requestAlbumArt = [&]() {
+        art_loader.request(playlist.current());
+        // The next track's tags may not be read yet; rather than read them
+        // on the UI thread, prefetch by path and key the cache by picture
+        if (playlist.hasNext())
+        {
+            size_t next = playlist.currentIndex() + 1;
+            if (playlist.isResolved(next))
+            {
+                art_loader.request(playlist.track(next), true);
+            }
+            else
+            {
+                art_loader.request(std::string(playlist.path(next)), true);
+            }
+        }
+        art_pending = true;
+    };
+
     // Lambda to create/recreate planes
     auto createPlanes = [&]() {
         // Destroy old planes if they exist
@@ -879,6 +870,7 @@ int main(int argc, char *argv[])
         if (planes.art_plane) ncplane_destroy(planes.art_plane);
 
         // Reset to nullptr to avoid using stale pointers
+        planes.status.invalidate();
         planes.status_plane = nullptr;
         planes.help_plane = nullptr;
         planes.art_plane = nullptr;
@@ -961,7 +953,8 @@ int main(int argc, char *argv[])
             }
         }
 
-        art_cols = std::min(art_cols, static_cast<int>(cols * 0.8));
+        int max_art_cols = std::max(10, static_cast<int>(cols * 0.8));
+        art_cols = std::min(art_cols, max_art_cols);
         art_cols = std::max(10, art_cols);
 
         spdlog::debug("Final art plane dimensions: {}x{} cells", art_cols, art_rows);
@@ -972,12 +965,30 @@ int main(int argc, char *argv[])
         art_opts.rows = art_rows;
         art_opts.cols = art_cols;
         planes.art_plane = ncplane_create(planes.stdplane, &art_opts);
+        planes.art_dirty = true;
         if (!planes.art_plane)
         {
             spdlog::error("Failed to create art plane");
             return;
         }
 
+        // Have the loader pre-scale art to the largest plane it could fill,
+        // in blitter pixels, so blitting never has to shrink a full-size cover
+        struct ncvgeom scale_geom = {};
+        struct ncvisual_options scale_vopts = {};
+        scale_vopts.blitter = selected_blitter;
+        unsigned int scale_y = 2, scale_x = 1; // Half-block
+        if (ncvisual_geom(nc, nullptr, &scale_vopts, &scale_geom) == 0 &&
+            scale_geom.scaley > 0 && scale_geom.scalex > 0)
+        {
+            scale_y = scale_geom.scaley;
+            scale_x = scale_geom.scalex;
+        }
+        if (art_loader.setTargetSize(max_art_cols * scale_x, art_rows * scale_y))
+        {
+            requestAlbumArt();
+        }
+
         // Help plane (positioned to the right of album art, or below if narrow terminal)
         struct ncplane_options help_opts = {};
         int art_right_edge = art_opts.x + art_cols;
@@ -1008,25 +1019,10 @@ int main(int argc, char *argv[])
         }
     };
 
-    // Extract album art for first track before creating planes
+    // Create initial planes; album art follows once the loader has it
     size_t current_track_index = playlist.currentIndex();
-    std::string art_path = ExtractAlbumArt(playlist.current().filepath);
-    spdlog::info("Album art extraction result: {}", art_path.empty() ? "none" : art_path);
-    if (!art_path.empty())
-    {
-        planes.album_art_visual = ncvisual_from_file(art_path.c_str());
-        if (!planes.album_art_visual)
-        {
-            spdlog::warn("Failed to load album art from: {}", art_path);
-        }
-        else
-        {
-            spdlog::info("Successfully loaded album art visual");
-        }
-    }
-
-    // Create initial planes (after loading album art)
     createPlanes();
+    requestAlbumArt();
 
     // Main event loop
     bool running = true;
@@ -1045,6 +1041,75 @@ int main(int argc, char *argv[])
     bool needs_full_redraw = true;  // Full redraw needed (track change, resize, help toggle)
     bool needs_status_update = false;  // Only status update needed (position change)
 
+    // Keyboard input: drain everything notcurses has queued, then redraw once
+    loop.watchFd(notcurses_inputready_fd(nc), [&]() {
+        ncinput ni;
+        char32_t ch;
+        while (running && (ch = notcurses_get_nblock(nc, &ni)) != 0 && ch != (char32_t)-1)
+        {
+            if (ch == NCKEY_RESIZE)
+            {
+                // Picks up the new geometry; the resize check below recreates planes
+                notcurses_refresh(nc, nullptr, nullptr);
+                continue;
+            }
+
+            // Store previous help state to detect toggle
+            bool prev_show_help = show_help;
+
+            HandleCommand(ch, player, playlist, running, show_help);
+
+            // Full redraw needed if help toggled or track changed
+            // For other commands (volume, seek, play/pause), status update is sufficient
+            if (show_help != prev_show_help || ch == 'n' || ch == 'N' || ch == 'p' || ch == 'P')
+            {
+                needs_full_redraw = true;
+            }
+            else
+            {
+                needs_status_update = true;
+            }
+        }
+    });
+
+    // Tracks still arriving on stdin; the status shows the track count
+    if (stdin_stream && !stdin_stream->finished())
+    {
+        int stream_fd = stdin_stream->fd();
+        loop.watchFd(stream_fd, [&, stream_fd]() {
+            if (stdin_stream->readAvailable(playlist) > 0)
+            {
+                needs_status_update = true;
+            }
+            if (stdin_stream->finished())
+            {
+                loop.unwatchFd(stream_fd);
+                // Tracks that arrived after startup join the shuffle
+                if (shuffle)
+                {
+                    playlist.shuffle(shuffle_seed);
+                }
+            }
+        });
+    }
+
+    // UI tick: advances the time and progress bar while playing
+    loop.setTimerCallback([&]() { needs_status_update = true; });
+
+    // Remote control; track changes are picked up by the index check below
+    ControlServer control(loop);
+    const std::string control_socket = result["control-socket"].as<std::string>();
+    if (!control_socket.empty())
+    {
+        control.listen(control_socket, [&](const ControlRequest &request) {
+            needs_status_update = true;
+            return HandleControlRequest(request, player, playlist, running);
+        });
+    }
+
+    // Played to the end of a playlist that is still streaming in
+    bool waiting_for_tracks = false;
+
     while (running && !signal_received)
     {
         {
@@ -1075,18 +1140,29 @@ int main(int argc, char *argv[])
                 ncvisual_destroy(planes.album_art_visual);
                 planes.album_art_visual = nullptr;
             }
+            planes.art_dirty = true;
+
+            requestAlbumArt();
+            needs_full_redraw = true;
+        }
 
-            // Extract and load new album art
-            art_path = ExtractAlbumArt(playlist.current().filepath);
-            if (!art_path.empty())
+        // Swap in album art once the background loader has it ready
+        if (art_pending)
+        {
+            if (auto visual = art_loader.take(playlist.current().filepath))
             {
-                planes.album_art_visual = ncvisual_from_file(art_path.c_str());
-                if (!planes.album_art_visual)
+                if (planes.album_art_visual)
                 {
-                    spdlog::warn("Failed to load album art from: {}", art_path);
+                    ncvisual_destroy(planes.album_art_visual);
                 }
+                planes.album_art_visual = *visual;
+                planes.art_dirty = true;
+                art_pending = false;
+
+                // Art plane aspect ratio follows the image
+                createPlanes();
+                needs_full_redraw = true;
             }
-            needs_full_redraw = true;
         }
 
         // Render based on what needs updating
@@ -1100,44 +1176,46 @@ int main(int argc, char *argv[])
         }
         else if (needs_status_update)
         {
-            DrawStatusUpdate(planes.status_plane, player, playlist);
+            DrawStatusUpdate(planes, player, playlist);
             notcurses_render(nc);
             needs_status_update = false;
         }
+        control.publishStatus(PlayerStatusJson(player, playlist));
 
-        // Use longer timeout when paused/stopped to reduce CPU usage
-        ncinput ni;
-        struct timespec ts = {0, 100000000};
-        char32_t ch = notcurses_get(nc, &ts, &ni);
+        // Only tick while playing; paused or stopped the loop sleeps until input
+        loop.setTimerInterval(player.isPlaying() ? std::chrono::milliseconds(250)
+                                                 : std::chrono::milliseconds(0));
 
-        if (ch != (char32_t)-1)
+        // Sleep until a key, the track-end notification, a signal or the tick
+        if (!loop.runOnce())
         {
-            // Store previous help state to detect toggle
-            bool prev_show_help = show_help;
-
-            HandleCommand(ch, player, playlist, running, show_help);
+            break;
+        }
 
-            // Full redraw needed if help toggled or track changed
-            // For other commands (volume, seek, play/pause), status update is sufficient
-            if (show_help != prev_show_help || ch == 'n' || ch == 'N' || ch == 'p' || ch == 'P')
+        // Check for auto-advance and playlist end
+        if (CheckAutoAdvance(player, playlist, repeat, was_playing))
+        {
+            // Playlist has ended, exit unless more is still being piped in
+            if (stdin_stream && !stdin_stream->finished())
             {
-                needs_full_redraw = true;
+                waiting_for_tracks = true;
             }
             else
             {
-                needs_status_update = true;
+                running = false;
             }
         }
 
-        // Check for auto-advance and playlist end
-        if (CheckAutoAdvance(player, playlist, repeat, was_playing))
+        if (waiting_for_tracks && playlist.hasNext())
+        {
+            waiting_for_tracks = false;
+            playlist.advance();
+            was_playing = PlayCurrentTrack(player, playlist);
+        }
+        else if (waiting_for_tracks && stdin_stream->finished())
         {
-            // Playlist has ended, exit
             running = false;
         }
-
-        // Sleep briefly to avoid busy waiting
-        std::this_thread::sleep_for(std::chrono::milliseconds(100));
     }
 
     // Cleanup